@@ -10,6 +10,7 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "debug.h"
+#include "util.h"
 
 enum {
     P = 1 << 6, // Padding byte (=)
@@ -102,6 +103,85 @@ invalid:
     return NULL;
 }
 
+/* Returns the number of decoded bytes, or -1 if invalid */
+static int
+decode_quad(struct base64_decoder *dec, const uint8_t q[4], uint8_t *out)
+{
+    unsigned a = reverse_lookup[q[0]];
+    unsigned b = reverse_lookup[q[1]];
+    unsigned c = reverse_lookup[q[2]];
+    unsigned d = reverse_lookup[q[3]];
+
+    unsigned u = a | b | c | d;
+    if (unlikely(u & I || dec->padded))
+        return -1;
+
+    int count = 3;
+
+    if (unlikely(u & P)) {
+        if (unlikely((a | b) & P || (c & P && !(d & P))))
+            return -1;
+
+        dec->padded = true;
+        count = c & P ? 1 : 2;
+
+        c &= 63;
+        d &= 63;
+    }
+
+    uint32_t v = a << 18 | b << 12 | c << 6 | d << 0;
+    out[0] = (v >> 16) & 0xff;
+    out[1] = (v >>  8) & 0xff;
+    out[2] = (v >>  0) & 0xff;
+    return count;
+}
+
+size_t
+base64_decode_partial(struct base64_decoder *dec, const char *_s, size_t len,
+                      uint8_t *out)
+{
+    const uint8_t *s = (const uint8_t *)_s;
+    size_t o = 0;
+
+    if (unlikely(dec->invalid))
+        return 0;
+
+    for (size_t i = 0; i < len;) {
+        const uint8_t *q;
+
+        if (dec->count == 0 && len - i >= 4) {
+            /* Decode straight from the input */
+            q = &s[i];
+            i += 4;
+        } else {
+            /* Quad split between chunks */
+            dec->quad[dec->count++] = s[i++];
+            if (dec->count < 4)
+                continue;
+            q = dec->quad;
+        }
+
+        dec->count = 0;
+
+        /* Note: always writes 3 bytes */
+        int count = decode_quad(dec, q, &out[o]);
+        if (unlikely(count < 0)) {
+            dec->invalid = true;
+            break;
+        }
+
+        o += count;
+    }
+
+    return o;
+}
+
+bool
+base64_decode_complete(const struct base64_decoder *dec)
+{
+    return !dec->invalid && dec->count == 0;
+}
+
 char *
 base64_encode(const uint8_t *data, size_t size)
 {
@@ -170,3 +250,62 @@ base64_encode_final(const uint8_t *data, size_t size, char result[4])
 
     LOG_DBG("base64: encode: %c%c%c%c", c0, c1, c2, c3);
 }
+
+UNITTEST
+{
+    static const char *const valid[] = {
+        "", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy", "/+/+Zm9vYmFyYmF6",
+    };
+
+    for (size_t i = 0; i < ALEN(valid); i++) {
+        const size_t len = strlen(valid[i]);
+
+        size_t expected_len;
+        char *expected = base64_decode(valid[i], &expected_len);
+        xassert(expected != NULL);
+
+        /* Feed the decoder with all possible chunk sizes */
+        for (size_t chunk = 1; chunk <= len + 1; chunk++) {
+            struct base64_decoder dec = {0};
+            uint8_t out[64];
+            size_t out_len = 0;
+
+            for (size_t ofs = 0; ofs < len; ofs += chunk) {
+                const size_t left = len - ofs;
+                out_len += base64_decode_partial(
+                    &dec, &valid[i][ofs], left < chunk ? left : chunk,
+                    &out[out_len]);
+            }
+
+            xassert(base64_decode_complete(&dec));
+            xassert(out_len == expected_len);
+            xassert(memcmp(out, expected, out_len) == 0);
+        }
+
+        free(expected);
+    }
+
+    static const char *const invalid[] = {
+        "Zm9", "Zm9vY", "Zm9v!m9v", "Zg==Zm9v", "Z===", "Zm=v",
+    };
+
+    for (size_t i = 0; i < ALEN(invalid); i++) {
+        xassert(base64_decode(invalid[i], NULL) == NULL);
+
+        for (size_t chunk = 1; chunk <= 8; chunk++) {
+            const size_t len = strlen(invalid[i]);
+            struct base64_decoder dec = {0};
+            uint8_t out[64];
+            size_t out_len = 0;
+
+            for (size_t ofs = 0; ofs < len; ofs += chunk) {
+                const size_t left = len - ofs;
+                out_len += base64_decode_partial(
+                    &dec, &invalid[i][ofs], left < chunk ? left : chunk,
+                    &out[out_len]);
+            }
+
+            xassert(!base64_decode_complete(&dec));
+        }
+    }
+}
@@ -1,8 +1,28 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
 char *base64_decode(const char *s, size_t *out_len);
 char *base64_encode(const uint8_t *data, size_t size);
 void base64_encode_final(const uint8_t *data, size_t size, char result[4]);
+
+/*
+ * Incremental decoding, for when the encoded data arrives in chunks
+ * of arbitrary size. Zero-initialize the decoder, then feed it with
+ * base64_decode_partial(). When all data has been fed to it,
+ * base64_decode_complete() tells whether the data was valid, i.e.
+ * whether base64_decode() would have succeeded.
+ */
+struct base64_decoder {
+    uint8_t quad[4];
+    uint8_t count;  /* Bytes in 'quad' */
+    bool padded;    /* Padding seen; no more data allowed */
+    bool invalid;
+};
+
+/* 'out' must have room for (len + 3) / 4 * 3 bytes. Returns the number of decoded bytes */
+size_t base64_decode_partial(
+    struct base64_decoder *dec, const char *s, size_t len, uint8_t *out);
+bool base64_decode_complete(const struct base64_decoder *dec);
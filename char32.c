@@ -20,6 +20,8 @@
 #include "macros.h"
 #include "xmalloc.h"
 
+#include "unicode-props.h"
+
 /*
  * For now, assume we can map directly to the corresponding wchar_t
  * functions. This is true if:
@@ -38,6 +40,56 @@ _Static_assert(
  #error "wchar_t does not use UTF-32"
 #endif
 
+UNITTEST
+{
+    xassert(c32width(U'a') == 1);
+    xassert(c32width(U'\0') == 0);
+    xassert(c32width(U'\n') == -1);
+    xassert(c32width(0x9b) == -1);          /* CSI (C1) */
+    xassert(c32width(0xad) == 1);           /* SOFT HYPHEN */
+    xassert(c32width(0x301) == 0);          /* COMBINING ACUTE ACCENT */
+    xassert(c32width(0x200b) == 0);         /* ZERO WIDTH SPACE */
+    xassert(c32width(0x200d) == 0);         /* ZERO WIDTH JOINER */
+    xassert(c32width(0xfe0f) == 0);         /* VS-16 */
+    xassert(c32width(0x4e00) == 2);         /* CJK */
+    xassert(c32width(0xff21) == 2);         /* FULLWIDTH A */
+    xassert(c32width(0x1f600) == 2);        /* GRINNING FACE */
+    xassert(c32width(0x20000) == 2);        /* CJK Extension B */
+    xassert(c32width(0x1f680) == 2);        /* ROCKET */
+    xassert(c32width(0x378) == 1);          /* Unassigned */
+    xassert(c32width(0x530) == 1);          /* Unassigned */
+    xassert(c32width(0x2fffd) == 1);        /* Unassigned, in a wide plane */
+    xassert(c32width(0xd800) == -1);        /* Surrogate */
+    xassert(c32width(0xfffe) == -1);        /* Noncharacter */
+    xassert(c32width(0x110000) == -1);
+    xassert(c32width((char32_t)-1) == -1);
+
+    xassert(c32swidth(U"a\u4e00b", 3) == 4);
+    xassert(c32swidth(U"a\u0301", 2) == 1);
+    xassert(c32swidth(U"a\nb", 3) == -1);
+    xassert(c32swidth(U"ab", 16) == 2);
+}
+
+UNITTEST
+{
+    xassert(c32fold(U'A') == U'a');
+    xassert(c32fold(U'a') == U'a');
+    xassert(c32fold(U'@') == U'@');
+    xassert(c32fold(U'[') == U'[');
+    xassert(c32fold(0xc5) == 0xe5);         /* Å -> å */
+    xassert(c32fold(0x391) == 0x3b1);       /* Α -> α */
+    xassert(c32fold(0x410) == 0x430);       /* А -> а */
+    xassert(c32fold(0xff21) == 0xff41);     /* Ａ -> ａ */
+    xassert(c32fold(0x10400) == 0x10428);   /* Deseret */
+    xassert(c32fold(0x4e00) == 0x4e00);
+
+    /* Must agree with the ASCII fast path */
+    for (char32_t c = 0; c < 0x80; c++)
+        xassert(c32props(c)->fold_delta == (int32_t)(c32fold(c) - c));
+    for (char32_t c = 0x20; c < 0x7f; c++)
+        xassert(c32props(c)->width == 1);
+}
+
 UNITTEST
 {
     xassert(c32len(U"") == 0);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <uchar.h>
 #include <stddef.h>
 #include <stdarg.h>
@@ -8,10 +9,6 @@
 #include <wchar.h>
 #include <wctype.h>
 
-#if defined(FOOT_GRAPHEME_CLUSTERING)
- #include <utf8proc.h>
-#endif
-
 static inline size_t c32len(const char32_t *s) {
     return wcslen((const wchar_t *)s);
 }
@@ -72,23 +69,81 @@ static inline bool isc32graph(char32_t c32) {
     return iswgraph((wint_t)c32);
 }
 
+/*
+ * Per-codepoint properties, looked up in a two-stage table generated
+ * at build time (scripts/generate-unicode-props.py): the first stage
+ * maps a block of 256 codepoints to a (de-duplicated) second stage
+ * block, which in turn holds an index into c32_props_table[].
+ */
+struct c32_props {
+    int32_t fold_delta;  /* Simple lower case mapping, as a delta */
+    int8_t width;        /* wcwidth(3) semantics */
+};
+
+#define C32_PROPS_BLOCK_SHIFT 8
+
+extern const struct c32_props c32_props_table[];
+extern const uint16_t c32_props_stage1[];
+extern const uint8_t c32_props_stage2[];
+
+static inline const struct c32_props *c32props(char32_t c) {
+    if (c > 0x10ffff)
+        c = 0xfffe;  /* Any noncharacter; width -1 */
+
+    const size_t block = c32_props_stage1[c >> C32_PROPS_BLOCK_SHIFT];
+    const size_t ofs = c & ((1u << C32_PROPS_BLOCK_SHIFT) - 1);
+    return &c32_props_table[c32_props_stage2[
+        (block << C32_PROPS_BLOCK_SHIFT) + ofs]];
+}
+
 static inline int c32width(char32_t c) {
-#if defined(FOOT_GRAPHEME_CLUSTERING)
-    return utf8proc_charwidth((utf8proc_int32_t)c);
-#else
-    return wcwidth((wchar_t)c);
-#endif
+    if (c >= 0x20 && c < 0x7f)
+        return 1;
+    return c32props(c)->width;
+}
+
+static inline char32_t c32fold(char32_t c) {
+    if (c < 0x80)
+        return c >= U'A' && c <= U'Z' ? c + 0x20 : c;
+    return c + c32props(c)->fold_delta;
 }
 
 static inline int c32swidth(const char32_t *s, size_t n) {
-#if defined(FOOT_GRAPHEME_CLUSTERING)
     int width = 0;
-    for (size_t i = 0; i < n; i++)
-        width += utf8proc_charwidth((utf8proc_int32_t)s[i]);
+    for (size_t i = 0; i < n && s[i] != U'\0'; i++) {
+        int w = c32width(s[i]);
+        if (w < 0)
+            return -1;
+        width += w;
+    }
     return width;
-#else
-    return wcswidth((const wchar_t *)s, n);
-#endif
+}
+
+/*
+ * Encodes a single codepoint as UTF-8, independent of the current
+ * locale. 'out' must have room for (at least) 4 bytes. Returns the
+ * number of bytes written. No NUL terminator is written.
+ */
+static inline size_t c32toutf8(char32_t c, char *out) {
+    if (c < 0x80) {
+        out[0] = c;
+        return 1;
+    } else if (c < 0x800) {
+        out[0] = 0xc0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3f);
+        return 2;
+    } else if (c < 0x10000) {
+        out[0] = 0xe0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3f);
+        out[2] = 0x80 | (c & 0x3f);
+        return 3;
+    } else {
+        out[0] = 0xf0 | (c >> 18);
+        out[1] = 0x80 | ((c >> 12) & 0x3f);
+        out[2] = 0x80 | ((c >> 6) & 0x3f);
+        out[3] = 0x80 | (c & 0x3f);
+        return 4;
+    }
 }
 
 size_t mbsntoc32(char32_t *dst, const char *src, size_t nms, size_t len);
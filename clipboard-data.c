@@ -0,0 +1,363 @@
+#include "clipboard-data.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#if defined(__linux__)
+ #include <sys/sendfile.h>
+#endif
+
+#define LOG_MODULE "clipboard-data"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "async.h"
+#include "debug.h"
+#include "macros.h"
+#include "xmalloc.h"
+
+#if !defined(MFD_NOEXEC_SEAL)
+ #define MFD_NOEXEC_SEAL 0
+#endif
+
+struct clipboard_data {
+    int fd;
+    size_t size;
+    bool sealed;
+    int ref_count;
+};
+
+struct clipboard_data *
+clipboard_data_new(void)
+{
+    int fd;
+
+#if defined(MEMFD_CREATE)
+    /* See shm.c */
+    errno = 0;
+    fd = memfd_create(
+        "foot-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_NOEXEC_SEAL);
+
+    if (fd < 0 && errno == EINVAL && MFD_NOEXEC_SEAL != 0)
+        fd = memfd_create("foot-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#elif defined(__FreeBSD__)
+    fd = shm_open(SHM_ANON, O_RDWR | O_CLOEXEC, 0600);
+#else
+    char name[] = "/tmp/foot-clipboard-XXXXXX";
+    fd = mkostemp(name, O_CLOEXEC);
+    if (fd >= 0)
+        unlink(name);
+#endif
+
+    if (fd < 0) {
+        LOG_ERRNO("failed to create clipboard backing memory file");
+        return NULL;
+    }
+
+    struct clipboard_data *data = xmalloc(sizeof(*data));
+    *data = (struct clipboard_data){
+        .fd = fd,
+        .ref_count = 1,
+    };
+    return data;
+}
+
+bool
+clipboard_data_append(struct clipboard_data *data, const void *_buf, size_t len)
+{
+    xassert(!data->sealed);
+
+    const uint8_t *buf = _buf;
+
+    while (len > 0) {
+        ssize_t ret = write(data->fd, buf, len);
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+
+            LOG_ERRNO("failed to write clipboard data");
+            return false;
+        }
+
+        buf += ret;
+        len -= ret;
+        data->size += ret;
+    }
+
+    return true;
+}
+
+bool
+clipboard_data_seal(struct clipboard_data *data)
+{
+    xassert(!data->sealed);
+
+#if defined(MEMFD_CREATE)
+    if (fcntl(data->fd, F_ADD_SEALS,
+              F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) < 0)
+    {
+        LOG_ERRNO("failed to seal clipboard data");
+        return false;
+    }
+#endif
+
+    data->sealed = true;
+    return true;
+}
+
+struct clipboard_data *
+clipboard_data_from_text(const char *text, size_t len)
+{
+    struct clipboard_data *data = clipboard_data_new();
+    if (data == NULL)
+        return NULL;
+
+    if (!clipboard_data_append(data, text, len) ||
+        !clipboard_data_seal(data))
+    {
+        clipboard_data_unref(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+struct clipboard_data *
+clipboard_data_ref(struct clipboard_data *data)
+{
+    if (data != NULL)
+        data->ref_count++;
+    return data;
+}
+
+void
+clipboard_data_unref(struct clipboard_data *data)
+{
+    if (data == NULL)
+        return;
+
+    xassert(data->ref_count > 0);
+    if (--data->ref_count > 0)
+        return;
+
+    close(data->fd);
+    free(data);
+}
+
+size_t
+clipboard_data_size(const struct clipboard_data *data)
+{
+    return data != NULL ? data->size : 0;
+}
+
+struct clipboard_send {
+    struct clipboard_data *data;
+    off_t offset;
+    bool no_sendfile;
+};
+
+/* Fallback, for when sendfile(2) isn't available, or fails */
+static ssize_t
+copy_some(struct clipboard_send *ctx, int fd, size_t left)
+{
+    uint8_t buf[64 * 1024];
+    ssize_t count = pread(
+        ctx->data->fd, buf, left < sizeof(buf) ? left : sizeof(buf), ctx->offset);
+
+    if (count <= 0)
+        return count < 0 ? -1 : 0;
+
+    /* Whatever isn't written is read again next time */
+    ssize_t ret = write(fd, buf, count);
+    if (ret > 0)
+        ctx->offset += ret;
+    return ret;
+}
+
+static enum async_write_status
+send_some(struct clipboard_send *ctx, int fd)
+{
+    const struct clipboard_data *data = ctx->data;
+
+    while ((size_t)ctx->offset < data->size) {
+        const size_t left = data->size - ctx->offset;
+        ssize_t ret = -1;
+
+#if defined(__linux__)
+        if (!ctx->no_sendfile) {
+            /* Doesn't touch the memfd's file offset; it's shared by
+             * all concurrent sends */
+            ret = sendfile(fd, data->fd, &ctx->offset, left);
+
+            if (ret < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                ctx->no_sendfile = true;
+                continue;
+            }
+        } else
+#endif
+            ret = copy_some(ctx, fd, left);
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return ASYNC_WRITE_REMAIN;
+            return ASYNC_WRITE_ERR;
+        }
+
+        if (ret == 0) {
+            /* Shouldn't happen, since the memfd is sealed */
+            errno = EIO;
+            return ASYNC_WRITE_ERR;
+        }
+
+        LOG_DBG("wrote %zd bytes of %zu (%zu left) to FD=%d",
+                ret, left, left - ret, fd);
+    }
+
+    return ASYNC_WRITE_DONE;
+}
+
+static bool
+fdm_send(struct fdm *fdm, int fd, int events, void *data)
+{
+    struct clipboard_send *ctx = data;
+
+    if (events & EPOLLHUP)
+        goto done;
+
+    switch (send_some(ctx, fd)) {
+    case ASYNC_WRITE_REMAIN:
+        return true;
+
+    case ASYNC_WRITE_DONE:
+        break;
+
+    case ASYNC_WRITE_ERR:
+        LOG_ERRNO(
+            "failed to asynchronously write %zu bytes of selection data to FD=%d",
+            ctx->data->size - (size_t)ctx->offset, fd);
+        break;
+    }
+
+done:
+    fdm_del(fdm, fd);
+    clipboard_data_unref(ctx->data);
+    free(ctx);
+    return true;
+}
+
+void
+clipboard_data_send(struct clipboard_data *data, struct fdm *fdm, int fd)
+{
+    if (data == NULL)
+        goto out;
+
+    xassert(data->sealed);
+
+    /* Make it NONBLOCK:ing right away - we don't want to block if the
+     * initial attempt to send the data synchronously fails */
+    int flags;
+    if ((flags = fcntl(fd, F_GETFL)) < 0 ||
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        LOG_ERRNO("failed to set O_NONBLOCK");
+        goto out;
+    }
+
+    struct clipboard_send send = {.data = data};
+
+    switch (send_some(&send, fd)) {
+    case ASYNC_WRITE_REMAIN: {
+        struct clipboard_send *ctx = xmalloc(sizeof(*ctx));
+        *ctx = send;
+        clipboard_data_ref(data);
+
+        if (fdm_add(fdm, fd, EPOLLOUT, &fdm_send, ctx))
+            return;
+
+        clipboard_data_unref(data);
+        free(ctx);
+        break;
+    }
+
+    case ASYNC_WRITE_DONE:
+        break;
+
+    case ASYNC_WRITE_ERR:
+        LOG_ERRNO("failed to write %zu bytes of selection data to FD=%d",
+                  data->size, fd);
+        break;
+    }
+
+out:
+    close(fd);
+}
+
+UNITTEST
+{
+    static const char text[] = "hello, world\n";
+
+    struct clipboard_data *data = clipboard_data_from_text(text, strlen(text));
+    xassert(data != NULL);
+    xassert(clipboard_data_size(data) == strlen(text));
+    xassert(data->sealed);
+
+#if defined(MEMFD_CREATE)
+    /* Sealed; no more writes */
+    xassert(write(data->fd, "x", 1) < 0);
+#endif
+
+    /* Shared by reference, sent any number of times */
+    xassert(clipboard_data_ref(data) == data);
+    xassert(data->ref_count == 2);
+
+    for (int i = 0; i < 2; i++) {
+        int fds[2];
+        xassert(pipe(fds) == 0);
+
+        /* Fits in the pipe; written synchronously, no FDM needed */
+        clipboard_data_send(data, NULL, fds[1]);
+
+        char buf[sizeof(text)] = {0};
+        xassert(read(fds[0], buf, sizeof(buf)) == (ssize_t)strlen(text));
+        xassert(strcmp(buf, text) == 0);
+
+        /* Write-end was closed */
+        xassert(read(fds[0], buf, sizeof(buf)) == 0);
+        close(fds[0]);
+    }
+
+    clipboard_data_unref(data);
+    xassert(data->ref_count == 1);
+    clipboard_data_unref(data);
+
+    /* Incrementally built */
+    data = clipboard_data_new();
+    xassert(data != NULL);
+    xassert(clipboard_data_append(data, "foo", 3));
+    xassert(clipboard_data_append(data, "bar", 3));
+    xassert(clipboard_data_seal(data));
+    xassert(clipboard_data_size(data) == 6);
+
+    struct clipboard_send send = {.data = data, .no_sendfile = true};
+    int fds[2];
+    xassert(pipe(fds) == 0);
+    xassert(send_some(&send, fds[1]) == ASYNC_WRITE_DONE);
+    close(fds[1]);
+
+    char buf[7] = {0};
+    xassert(read(fds[0], buf, sizeof(buf)) == 6);
+    xassert(strcmp(buf, "foobar") == 0);
+    close(fds[0]);
+
+    clipboard_data_unref(data);
+}
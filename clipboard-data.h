@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fdm.h"
+
+/*
+ * Clipboard (and primary selection) contents.
+ *
+ * The data is stored in a memfd, which is sealed once complete. It
+ * is reference counted, allowing the same data to be offered as both
+ * clipboard and primary selection, and to be sent to any number of
+ * clients, without ever being copied in memory. Data is sent
+ * straight from the memfd, with sendfile(2).
+ */
+struct clipboard_data;
+
+/* Empty, writable, data. Must be sealed before being sent */
+struct clipboard_data *clipboard_data_new(void);
+bool clipboard_data_append(
+    struct clipboard_data *data, const void *buf, size_t len);
+bool clipboard_data_seal(struct clipboard_data *data);
+
+/* Sealed data, with a copy of 'text' */
+struct clipboard_data *clipboard_data_from_text(const char *text, size_t len);
+
+struct clipboard_data *clipboard_data_ref(struct clipboard_data *data);
+void clipboard_data_unref(struct clipboard_data *data);
+
+size_t clipboard_data_size(const struct clipboard_data *data);
+
+/*
+ * Writes the data to 'fd'. Whatever can't be written right away is
+ * written asynchronously, from the FDM. Takes ownership of 'fd'
+ * (i.e. closes it when done). 'data' may be NULL, in which case
+ * nothing is written.
+ */
+void clipboard_data_send(struct clipboard_data *data, struct fdm *fdm, int fd);
@@ -18,6 +18,8 @@ cmd_scrollback_up(struct terminal *term, int rows)
     if (urls_mode_is_active(term))
         return;
 
+    term_reflow_pending_finish(term);
+
     const struct grid *grid = term->grid;
     const int view = grid->view;
     const int grid_rows = grid->num_rows;
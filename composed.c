@@ -4,65 +4,190 @@
 #include <stdbool.h>
 
 #include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+
+#define MIN_SIZE 256
+#define MIN_GC_THRESHOLD 4096
+
+static inline size_t
+slot_of(uint32_t key, size_t size)
+{
+    /* Keys are already hashed (see chain_key()); just mix in the high bits */
+    return (key ^ (key >> 15)) & (size - 1);
+}
 
 struct composed *
-composed_lookup(struct composed *root, uint32_t key)
+composed_lookup(const struct composed_table *table, uint32_t key)
 {
-    struct composed *node = root;
+    if (table->size == 0)
+        return NULL;
+
+    const size_t mask = table->size - 1;
+
+    for (size_t i = slot_of(key, table->size); ; i = (i + 1) & mask) {
+        struct composed *node = table->slots[i];
 
-    while (node != NULL) {
-        if (key == node->key)
+        if (node == NULL)
+            return NULL;
+        if (node->key == key)
             return node;
+    }
+}
 
-        node = key < node->key ? node->left : node->right;
+static void
+insert_no_resize(struct composed **slots, size_t size, struct composed *node)
+{
+    const size_t mask = size - 1;
+    size_t i = slot_of(node->key, size);
+
+    while (slots[i] != NULL) {
+        xassert(slots[i]->key != node->key);
+        i = (i + 1) & mask;
     }
 
-    return NULL;
+    slots[i] = node;
 }
 
-void
-composed_insert(struct composed **root, struct composed *node)
+static void
+rehash(struct composed_table *table, size_t new_size)
 {
-    node->left = node->right = NULL;
+    struct composed **slots = xcalloc(new_size, sizeof(slots[0]));
 
-    if (*root == NULL) {
-        *root = node;
-        return;
+    for (size_t i = 0; i < table->size; i++) {
+        if (table->slots[i] != NULL)
+            insert_no_resize(slots, new_size, table->slots[i]);
     }
 
-    uint32_t key = node->key;
+    free(table->slots);
+    table->slots = slots;
+    table->size = new_size;
+}
+
+void
+composed_insert(struct composed_table *table, struct composed *node)
+{
+    /* Keep the load factor below 3/4 */
+    if ((table->count + 1) * 4 > table->size * 3)
+        rehash(table, table->size > 0 ? table->size * 2 : MIN_SIZE);
 
-    struct composed *prev = NULL;
-    struct composed *n = *root;
+    if (table->gc_threshold == 0)
+        table->gc_threshold = MIN_GC_THRESHOLD;
 
-    while (n != NULL) {
-        xassert(n->key != node->key);
+    node->marked = false;
+    insert_no_resize(table->slots, table->size, node);
+    table->count++;
+}
 
-        prev = n;
-        n = key < n->key ? n->left : n->right;
+void
+composed_unmark_all(struct composed_table *table)
+{
+    for (size_t i = 0; i < table->size; i++) {
+        if (table->slots[i] != NULL)
+            table->slots[i]->marked = false;
     }
+}
 
-    xassert(prev != NULL);
-    xassert(n == NULL);
+void
+composed_mark(const struct composed_table *table, uint32_t key)
+{
+    struct composed *node = composed_lookup(table, key);
+    if (node != NULL)
+        node->marked = true;
+}
 
-    if (key < prev->key) {
-        xassert(prev->left == NULL);
-        prev->left = node;
-    } else {
-        xassert(prev->right == NULL);
-        prev->right = node;
+size_t
+composed_sweep(struct composed_table *table)
+{
+    size_t freed = 0;
+
+    for (size_t i = 0; i < table->size; i++) {
+        struct composed *node = table->slots[i];
+        if (node == NULL || node->marked)
+            continue;
+
+        free(node->chars);
+        free(node);
+        table->slots[i] = NULL;
+        freed++;
     }
+
+    xassert(freed <= table->count);
+    table->count -= freed;
+
+    /*
+     * Removing entries breaks probe sequences; rebuild the table,
+     * shrinking it if it has become mostly empty
+     */
+    size_t new_size = MIN_SIZE;
+    while (table->count * 2 > new_size)
+        new_size *= 2;
+
+    rehash(table, new_size);
+
+    /* Don't collect again until the number of live chains has doubled */
+    table->gc_threshold = max(MIN_GC_THRESHOLD, table->count * 2);
+    return freed;
 }
 
 void
-composed_free(struct composed *root)
+composed_free(struct composed_table *table)
 {
-    if (root == NULL)
-        return;
+    for (size_t i = 0; i < table->size; i++) {
+        struct composed *node = table->slots[i];
+        if (node == NULL)
+            continue;
+
+        free(node->chars);
+        free(node);
+    }
+
+    free(table->slots);
+    table->slots = NULL;
+    table->size = table->count = 0;
+    table->gc_threshold = 0;
+}
 
-    composed_free(root->left);
-    composed_free(root->right);
+UNITTEST
+{
+    struct composed_table table = {0};
+
+    for (uint32_t key = 0; key < 10000; key++) {
+        struct composed *node = xmalloc(sizeof(*node));
+        node->chars = xmalloc(2 * sizeof(node->chars[0]));
+        node->key = key * 7919;
+        node->count = 2;
+        node->width = 1;
+        composed_insert(&table, node);
+    }
+
+    xassert(table.count == 10000);
+    xassert(table.count * 4 <= table.size * 3);
+
+    for (uint32_t key = 0; key < 10000; key++) {
+        const struct composed *node = composed_lookup(&table, key * 7919);
+        xassert(node != NULL);
+        xassert(node->key == key * 7919);
+    }
+
+    xassert(composed_lookup(&table, 1) == NULL);
+
+    /* Keep every third chain alive */
+    composed_unmark_all(&table);
+    for (uint32_t key = 0; key < 10000; key += 3)
+        composed_mark(&table, key * 7919);
+
+    xassert(composed_sweep(&table) == 10000 - 3334);
+    xassert(table.count == 3334);
+    xassert(table.gc_threshold >= table.count);
+
+    for (uint32_t key = 0; key < 10000; key++) {
+        const struct composed *node = composed_lookup(&table, key * 7919);
+        xassert((node != NULL) == (key % 3 == 0));
+    }
 
-    free(root->chars);
-    free(root);
+    composed_free(&table);
+    xassert(table.count == 0);
+    xassert(composed_lookup(&table, 0) == NULL);
 }
@@ -1,18 +1,41 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <uchar.h>
 
 struct composed {
     char32_t *chars;
-    struct composed *left;
-    struct composed *right;
     uint32_t key;
     uint8_t count;
     uint8_t width;
+    bool marked;
 };
 
-struct composed *composed_lookup(struct composed *root, uint32_t key);
-void composed_insert(struct composed **root, struct composed *node);
+/*
+ * Open addressing (linear probing) hash table of composed character
+ * chains, indexed by their key.
+ *
+ * Chains are not reference counted. Instead, once 'count' reaches
+ * 'gc_threshold', the owner is expected to garbage collect the
+ * table: clear all marks with composed_unmark_all(), mark all chains
+ * that are still referenced with composed_mark(), and finally free
+ * the remaining ones with composed_sweep().
+ */
+struct composed_table {
+    struct composed **slots;
+    size_t size;          /* Number of slots; a power of 2, or 0 */
+    size_t count;         /* Number of chains in the table */
+    size_t gc_threshold;
+};
+
+struct composed *composed_lookup(
+    const struct composed_table *table, uint32_t key);
+void composed_insert(struct composed_table *table, struct composed *node);
+
+void composed_unmark_all(struct composed_table *table);
+void composed_mark(const struct composed_table *table, uint32_t key);
+size_t composed_sweep(struct composed_table *table);
 
-void composed_free(struct composed *root);
+void composed_free(struct composed_table *table);
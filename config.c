@@ -189,6 +189,7 @@ static const char *const search_binding_action_map[] = {
     [BIND_ACTION_SEARCH_CLIPBOARD_PASTE] = "clipboard-paste",
     [BIND_ACTION_SEARCH_PRIMARY_PASTE] = "primary-paste",
     [BIND_ACTION_SEARCH_UNICODE_INPUT] = "unicode-input",
+    [BIND_ACTION_SEARCH_TOGGLE_REGEX] = "toggle-regex",
 };
 
 static const char *const url_binding_action_map[] = {
@@ -2661,6 +2662,9 @@ parse_section_tweak(struct context *ctx)
         return true;
     }
 
+    else if (streq(key, "glyph-tile-cache-size-kb"))
+        return value_to_uint32(ctx, 10, &conf->tweak.glyph_tile_cache_size_kb);
+
     else if (streq(key, "box-drawing-base-thickness"))
         return value_to_float(ctx, &conf->tweak.box_drawing_base_thickness);
 
@@ -3075,6 +3079,7 @@ add_default_search_bindings(struct config *conf)
         {BIND_ACTION_SEARCH_CLIPBOARD_PASTE, m(XKB_MOD_NAME_CTRL), {{XKB_KEY_y}}},
         {BIND_ACTION_SEARCH_CLIPBOARD_PASTE, m("none"), {{XKB_KEY_XF86Paste}}},
         {BIND_ACTION_SEARCH_PRIMARY_PASTE, m(XKB_MOD_NAME_SHIFT), {{XKB_KEY_Insert}}},
+        {BIND_ACTION_SEARCH_TOGGLE_REGEX, m(XKB_MOD_NAME_ALT), {{XKB_KEY_r}}},
     };
 
     conf->bindings.search.count = ALEN(bindings);
@@ -3276,6 +3281,7 @@ config_load(struct config *conf, const char *conf_path,
             .delayed_render_lower_ns = 500000,         /* 0.5ms */
             .delayed_render_upper_ns = 16666666 / 2,   /* half a frame period (60Hz) */
             .max_shm_pool_size = 512 * 1024 * 1024,
+            .glyph_tile_cache_size_kb = 4096,
             .render_timer = RENDER_TIMER_NONE,
             .damage_whole_window = false,
             .box_drawing_base_thickness = 0.04,
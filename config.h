@@ -381,6 +381,7 @@ struct config {
         uint32_t delayed_render_lower_ns;
         uint32_t delayed_render_upper_ns;
         off_t max_shm_pool_size;
+        uint32_t glyph_tile_cache_size_kb;
         float box_drawing_base_thickness;
         bool box_drawing_solid_shades;
         bool font_monospace_warn;
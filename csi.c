@@ -1077,7 +1077,9 @@ csi_dispatch(struct terminal *term, uint8_t final)
 
             for (size_t c = 0; c < remaining; c++)
                 term->grid->cur_row->cells[term->grid->cursor.point.col + c].attrs.clean = 0;
-            term->grid->cur_row->dirty = true;
+            grid_row_dirty_range(
+                term->grid->cur_row, term->grid->cursor.point.col,
+                term->grid->cursor.point.col + remaining - 1);
 
             /* Erase the remainder of the line */
             const struct coord *cursor = &term->grid->cursor.point;
@@ -1105,7 +1107,9 @@ csi_dispatch(struct terminal *term, uint8_t final)
                     remaining * sizeof(term->grid->cur_row->cells[0]));
             for (size_t c = 0; c < remaining; c++)
                 term->grid->cur_row->cells[term->grid->cursor.point.col + count + c].attrs.clean = 0;
-            term->grid->cur_row->dirty = true;
+            grid_row_dirty_range(
+                term->grid->cur_row, term->grid->cursor.point.col + count,
+                term->grid->cursor.point.col + count + remaining - 1);
 
             /* Erase (insert space characters) */
             const struct coord *cursor = &term->grid->cursor.point;
@@ -1872,7 +1876,7 @@ csi_dispatch(struct terminal *term, uint8_t final)
 
             for (int r = top; r <= bottom; r++) {
                 struct row *row = grid_row(term->grid, r);
-                row->dirty = true;
+                grid_row_dirty_range(row, left, right);
 
                 for (int c = left; c <= right; c++) {
                     struct attributes *a = &row->cells[c].attrs;
@@ -1916,7 +1920,7 @@ csi_dispatch(struct terminal *term, uint8_t final)
 
             for (int r = top; r <= bottom; r++) {
                 struct row *row = grid_row(term->grid, r);
-                row->dirty = true;
+                grid_row_dirty_range(row, left, right);
 
                 for (int c = left; c <= right; c++) {
                     struct attributes *a = &row->cells[c].attrs;
@@ -2000,7 +2004,7 @@ csi_dispatch(struct terminal *term, uint8_t final)
             /* Paste into destination area */
             for (int r = 0; r < row_count; r++) {
                 struct row *row = grid_row(term->grid, dst_top + r);
-                row->dirty = true;
+                grid_row_dirty_range(row, dst_left, dst_left + cell_count - 1);
 
                 struct cell *cell = &row->cells[dst_left];
                 memcpy(cell, copy[r], cell_count * sizeof(copy[r][0]));
@@ -5,9 +5,12 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "char32.h"
+#include "util.h"
+#include "xmalloc.h"
 
+/* Text is accumulated as UTF-8, and handed out as-is */
 struct extraction_context {
-    char32_t *buf;
+    char *buf;
     size_t size;
     size_t idx;
     size_t tab_spaces_left;
@@ -37,11 +40,11 @@ extract_begin(enum selection_kind kind, bool strip_trailing_empty)
 }
 
 static bool
-ensure_size(struct extraction_context *ctx, size_t additional_chars)
+ensure_size(struct extraction_context *ctx, size_t additional_bytes)
 {
-    while (ctx->size < ctx->idx + additional_chars) {
+    while (ctx->size < ctx->idx + additional_bytes) {
         size_t new_size = ctx->size == 0 ? 512 : ctx->size * 2;
-        char32_t *new_buf = realloc(ctx->buf, new_size * sizeof(new_buf[0]));
+        char *new_buf = realloc(ctx->buf, new_size);
 
         if (new_buf == NULL)
             return false;
@@ -50,12 +53,30 @@ ensure_size(struct extraction_context *ctx, size_t additional_chars)
         ctx->size = new_size;
     }
 
-    xassert(ctx->size >= ctx->idx + additional_chars);
+    xassert(ctx->size >= ctx->idx + additional_bytes);
+    return true;
+}
+
+/* Insert pending newlines, and replace empty cells with spaces */
+static bool
+emit_pending(struct extraction_context *ctx)
+{
+    if (!ensure_size(ctx, ctx->newline_count + ctx->empty_count))
+        return false;
+
+    memset(&ctx->buf[ctx->idx], '\n', ctx->newline_count);
+    ctx->idx += ctx->newline_count;
+
+    memset(&ctx->buf[ctx->idx], ' ', ctx->empty_count);
+    ctx->idx += ctx->empty_count;
+
+    ctx->newline_count = 0;
+    ctx->empty_count = 0;
     return true;
 }
 
 bool
-extract_finish_wide(struct extraction_context *ctx, char32_t **text, size_t *len)
+extract_finish(struct extraction_context *ctx, char **text, size_t *len)
 {
     if (text == NULL)
         return false;
@@ -68,52 +89,34 @@ extract_finish_wide(struct extraction_context *ctx, char32_t **text, size_t *len
         goto err;
 
     if (!ctx->strip_trailing_empty) {
-        /* Insert pending newlines, and replace empty cells with spaces */
-        if (!ensure_size(ctx, ctx->newline_count + ctx->empty_count))
+        if (!emit_pending(ctx))
             goto err;
-
-        for (size_t i = 0; i < ctx->newline_count; i++)
-            ctx->buf[ctx->idx++] = U'\n';
-
-        for (size_t i = 0; i < ctx->empty_count; i++)
-            ctx->buf[ctx->idx++] = U' ';
     }
 
-    if (ctx->idx == 0) {
-        /* Selection of empty cells only */
-        if (!ensure_size(ctx, 1))
-            goto err;
-        ctx->buf[ctx->idx++] = U'\0';
-    } else {
-        xassert(ctx->idx > 0);
-        xassert(ctx->idx <= ctx->size);
-
+    if (ctx->idx > 0) {
         switch (ctx->selection_kind) {
         default:
-            if (ctx->buf[ctx->idx - 1] == U'\n')
-                ctx->buf[ctx->idx - 1] = U'\0';
+            if (ctx->buf[ctx->idx - 1] == '\n')
+                ctx->idx--;
             break;
 
         case SELECTION_LINE_WISE:
-            if (ctx->buf[ctx->idx - 1] != U'\n') {
+            if (ctx->buf[ctx->idx - 1] != '\n') {
                 if (!ensure_size(ctx, 1))
                     goto err;
-                ctx->buf[ctx->idx++] = U'\n';
+                ctx->buf[ctx->idx++] = '\n';
             }
             break;
-
-        }
-
-        if (ctx->buf[ctx->idx - 1] != U'\0') {
-            if (!ensure_size(ctx, 1))
-                goto err;
-            ctx->buf[ctx->idx++] = U'\0';
         }
     }
 
+    if (!ensure_size(ctx, 1))
+        goto err;
+    ctx->buf[ctx->idx] = '\0';
+
     *text = ctx->buf;
     if (len != NULL)
-        *len = ctx->idx - 1;
+        *len = ctx->idx;
     free(ctx);
     return true;
 
@@ -124,32 +127,120 @@ err:
 }
 
 bool
-extract_finish(struct extraction_context *ctx, char **text, size_t *len)
+extract_finish_wide(struct extraction_context *ctx, char32_t **text, size_t *len)
 {
     if (text == NULL)
         return false;
+
+    *text = NULL;
     if (len != NULL)
         *len = 0;
 
-    char32_t *wtext;
-    if (!extract_finish_wide(ctx, &wtext, NULL))
+    char *utf8;
+    size_t utf8_len;
+    if (!extract_finish(ctx, &utf8, &utf8_len))
         return false;
 
-    bool ret = false;
-
-    *text = ac32tombs(wtext);
-    if (*text == NULL) {
-        LOG_ERR("failed to convert selection to UTF-8");
-        goto out;
+    /* We encoded it ourselves; no need to validate */
+    char32_t *wtext = xmalloc((utf8_len + 1) * sizeof(wtext[0]));
+    size_t count = 0;
+
+    for (size_t i = 0; i < utf8_len; count++) {
+        const unsigned char c = utf8[i];
+
+        if (c < 0x80) {
+            wtext[count] = c;
+            i++;
+        } else if (c < 0xe0) {
+            wtext[count] = (c & 0x1f) << 6 | (utf8[i + 1] & 0x3f);
+            i += 2;
+        } else if (c < 0xf0) {
+            wtext[count] = (c & 0x0f) << 12 | (utf8[i + 1] & 0x3f) << 6 |
+                (utf8[i + 2] & 0x3f);
+            i += 3;
+        } else {
+            wtext[count] = (c & 0x07) << 18 | (utf8[i + 1] & 0x3f) << 12 |
+                (utf8[i + 2] & 0x3f) << 6 | (utf8[i + 3] & 0x3f);
+            i += 4;
+        }
     }
 
+    wtext[count] = U'\0';
+    free(utf8);
+
+    *text = wtext;
     if (len != NULL)
-        *len = strlen(*text);
-    ret = true;
+        *len = count;
+    return true;
+}
 
-out:
-    free(wtext);
-    return ret;
+/*
+ * Hands over the text extracted so far. The last character is kept,
+ * since extract_finish() needs it to decide what to do with a
+ * trailing newline. Pending newlines and empty cells are also kept,
+ * and emitted by later calls.
+ *
+ * This allows the text to be consumed in chunks, while extraction is
+ * still ongoing. Note that *text may be NULL (with *len 0), if
+ * nothing could be drained.
+ */
+bool
+extract_drain(struct extraction_context *ctx, char **text, size_t *len)
+{
+    *text = NULL;
+    *len = 0;
+
+    if (ctx->failed)
+        return false;
+
+    if (ctx->idx == 0)
+        return true;
+
+    /* Start of the last (UTF-8 encoded) character */
+    size_t last = ctx->idx - 1;
+    while (last > 0 && ((unsigned char)ctx->buf[last] & 0xc0) == 0x80)
+        last--;
+
+    if (last == 0)
+        return true;
+
+    /* Give away the current buffer, instead of copying from it */
+    char *new_buf = malloc(ctx->size);
+    if (unlikely(new_buf == NULL)) {
+        LOG_ERRNO("malloc() failed");
+        ctx->failed = true;
+        return false;
+    }
+
+    memcpy(new_buf, &ctx->buf[last], ctx->idx - last);
+    ctx->buf[last] = '\0';
+
+    *text = ctx->buf;
+    *len = last;
+
+    ctx->buf = new_buf;
+    ctx->idx -= last;
+    return true;
+}
+
+void
+extract_abort(struct extraction_context *ctx)
+{
+    if (ctx == NULL)
+        return;
+    free(ctx->buf);
+    free(ctx);
+}
+
+void
+extract_rebase_row(struct extraction_context *ctx, const struct row *old,
+                   const struct row *new)
+{
+    if (ctx->last_row != old)
+        return;
+
+    ctx->last_row = new;
+    ctx->last_cell = NULL;
 }
 
 bool
@@ -179,23 +270,21 @@ extract_one(const struct terminal *term, const struct row *row,
                 if (!ctx->strip_trailing_empty) {
                     if (!ensure_size(ctx, ctx->empty_count))
                         goto err;
-                    for (size_t i = 0; i < ctx->empty_count; i++)
-                        ctx->buf[ctx->idx++] = U' ';
+                    memset(&ctx->buf[ctx->idx], ' ', ctx->empty_count);
+                    ctx->idx += ctx->empty_count;
                 }
                 ctx->empty_count = 0;
             }
         } else {
             /* Always insert a linebreak */
-            if (!ensure_size(ctx, 1))
+            if (!ensure_size(ctx, 1 + ctx->empty_count))
                 goto err;
 
-            ctx->buf[ctx->idx++] = U'\n';
+            ctx->buf[ctx->idx++] = '\n';
 
             if (!ctx->strip_trailing_empty) {
-                if (!ensure_size(ctx, ctx->empty_count))
-                    goto err;
-                for (size_t i = 0; i < ctx->empty_count; i++)
-                    ctx->buf[ctx->idx++] = U' ';
+                memset(&ctx->buf[ctx->idx], ' ', ctx->empty_count);
+                ctx->idx += ctx->empty_count;
             }
             ctx->empty_count = 0;
         }
@@ -217,35 +306,31 @@ extract_one(const struct terminal *term, const struct row *row,
         return true;
     }
 
-    /* Insert pending newlines, and replace empty cells with spaces */
-    if (!ensure_size(ctx, ctx->newline_count + ctx->empty_count))
-        goto err;
-
-    for (size_t i = 0; i < ctx->newline_count; i++)
-        ctx->buf[ctx->idx++] = U'\n';
-
-    for (size_t i = 0; i < ctx->empty_count; i++)
-        ctx->buf[ctx->idx++] = U' ';
-
-    ctx->newline_count = 0;
-    ctx->empty_count = 0;
+    if (ctx->newline_count > 0 || ctx->empty_count > 0) {
+        if (!emit_pending(ctx))
+            goto err;
+    }
 
     if (cell->wc >= CELL_COMB_CHARS_LO && cell->wc <= CELL_COMB_CHARS_HI)
     {
         const struct composed *composed = composed_lookup(
-            term->composed, cell->wc - CELL_COMB_CHARS_LO);
+            &term->composed, cell->wc - CELL_COMB_CHARS_LO);
 
-        if (!ensure_size(ctx, composed->count))
+        if (!ensure_size(ctx, composed->count * 4))
             goto err;
 
         for (size_t i = 0; i < composed->count; i++)
-            ctx->buf[ctx->idx++] = composed->chars[i];
+            ctx->idx += c32toutf8(composed->chars[i], &ctx->buf[ctx->idx]);
     }
 
     else {
-        if (!ensure_size(ctx, 1))
+        if (!ensure_size(ctx, 4))
             goto err;
-        ctx->buf[ctx->idx++] = cell->wc;
+
+        if (likely(cell->wc < 0x80))
+            ctx->buf[ctx->idx++] = cell->wc;
+        else
+            ctx->idx += c32toutf8(cell->wc, &ctx->buf[ctx->idx]);
 
         if (cell->wc == U'\t') {
             int next_tab_stop = term->cols - 1;
@@ -269,3 +354,143 @@ err:
     ctx->failed = true;
     return false;
 }
+
+/*
+ * Extracts the cells [col_start, col_end) of a row. Equivalent to
+ * calling extract_one() for each cell, but runs of printable ASCII
+ * are copied straight into the buffer, when there's nothing
+ * pending (newlines, empty cells, tab expansion).
+ */
+bool
+extract_cells(const struct terminal *term, const struct row *row,
+              const struct cell *cells, int col_start, int col_end,
+              void *context)
+{
+    struct extraction_context *ctx = context;
+
+    for (int c = col_start; c < col_end; c++) {
+        if (row == ctx->last_row &&
+            ctx->newline_count == 0 &&
+            ctx->empty_count == 0 &&
+            ctx->tab_spaces_left == 0)
+        {
+            if (!ensure_size(ctx, col_end - c)) {
+                ctx->failed = true;
+                return false;
+            }
+
+            char *out = &ctx->buf[ctx->idx];
+            const int start = c;
+
+            for (; c < col_end; c++) {
+                const char32_t wc = cells[c].wc;
+                if (wc < 0x20 || wc >= 0x7f)
+                    break;
+                *out++ = wc;
+            }
+
+            if (c > start) {
+                ctx->idx += c - start;
+                ctx->last_cell = &cells[c - 1];
+            }
+
+            if (c == col_end)
+                break;
+        }
+
+        if (!extract_one(term, row, &cells[c], c, ctx))
+            return false;
+    }
+
+    return true;
+}
+
+UNITTEST
+{
+    struct terminal term = {.cols = 8};
+    tll_push_back(term.tab_stops, 0);
+    tll_push_back(term.tab_stops, 4);
+
+    static const char32_t rows_text[][8] = {
+        {U'f', U'o', U'o', 0, 0, U'b', U'a', U'r'},
+        {U'\t', U' ', U' ', U' ', U'x', U'é', U'y', 0},
+        {U'中', CELL_SPACER + 1, U'a', U'b', U' ', U'c', 0, 0},
+        {0, 0, 0, 0, 0, 0, 0, 0},
+        {U'😀', CELL_SPACER + 1, U'z', U'z', U'z', U'z', U'z', U'z'},
+    };
+
+    struct cell cells[ALEN(rows_text)][8] = {{{0}}};
+    struct row rows[ALEN(rows_text)] = {{0}};
+
+    for (size_t r = 0; r < ALEN(rows_text); r++) {
+        for (size_t c = 0; c < 8; c++)
+            cells[r][c].wc = rows_text[r][c];
+        rows[r].cells = cells[r];
+        rows[r].linebreak = r != 2;
+    }
+
+    const char *expected = "foo  bar\n\txéy\n中ab c\n\n😀zzzzzz";
+
+    /* Per-cell, and bulk, extraction must produce the same text */
+    struct extraction_context *ctx1 = extract_begin(SELECTION_NONE, true);
+    struct extraction_context *ctx2 = extract_begin(SELECTION_NONE, true);
+
+    for (size_t r = 0; r < ALEN(rows); r++) {
+        for (int c = 0; c < 8; c++)
+            xassert(extract_one(&term, &rows[r], &cells[r][c], c, ctx1));
+        xassert(extract_cells(&term, &rows[r], cells[r], 0, 8, ctx2));
+    }
+
+    char *text1, *text2;
+    size_t len1, len2;
+    xassert(extract_finish(ctx1, &text1, &len1));
+    xassert(extract_finish(ctx2, &text2, &len2));
+    xassert(strcmp(text1, expected) == 0);
+    xassert(strcmp(text2, expected) == 0);
+    xassert(len1 == strlen(expected));
+    xassert(len2 == strlen(expected));
+    free(text1);
+    free(text2);
+
+    /* Draining, in between rows, doesn't change the result */
+    struct extraction_context *ctx = extract_begin(SELECTION_NONE, true);
+    char *drained = xstrdup("");
+
+    for (size_t r = 0; r < ALEN(rows); r++) {
+        xassert(extract_cells(&term, &rows[r], cells[r], 0, 8, ctx));
+
+        char *chunk;
+        size_t chunk_len;
+        xassert(extract_drain(ctx, &chunk, &chunk_len));
+        xassert(chunk == NULL || strlen(chunk) == chunk_len);
+
+        if (chunk != NULL) {
+            char *new_drained = xstrjoin(drained, chunk);
+            free(drained);
+            free(chunk);
+            drained = new_drained;
+        }
+    }
+
+    char *rest;
+    xassert(extract_finish(ctx, &rest, NULL));
+    char *joined = xstrjoin(drained, rest);
+    xassert(strcmp(joined, expected) == 0);
+    free(joined);
+    free(rest);
+    free(drained);
+
+    /* Wide */
+    ctx = extract_begin(SELECTION_NONE, true);
+    for (size_t r = 0; r < ALEN(rows); r++)
+        xassert(extract_cells(&term, &rows[r], cells[r], 0, 8, ctx));
+
+    char32_t *wtext;
+    size_t wlen;
+    xassert(extract_finish_wide(ctx, &wtext, &wlen));
+    xassert(c32cmp(wtext, U"foo  bar\n\txéy\n中ab c\n\n😀zzzzzz") == 0);
+    xassert(wlen == c32len(wtext));
+    free(wtext);
+
+    tll_free(term.tab_stops);
+}
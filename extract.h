@@ -14,8 +14,22 @@ struct extraction_context *extract_begin(
 bool extract_one(
     const struct terminal *term, const struct row *row, const struct cell *cell,
     int col, void *context);
+bool extract_cells(
+    const struct terminal *term, const struct row *row,
+    const struct cell *cells, int col_start, int col_end, void *context);
 
+bool extract_drain(
+    struct extraction_context *context, char **text, size_t *len);
 bool extract_finish(
     struct extraction_context *context, char **text, size_t *len);
 bool extract_finish_wide(
     struct extraction_context *context, char32_t **text, size_t *len);
+void extract_abort(struct extraction_context *context);
+
+/*
+ * The rows being extracted have been copied; makes the context refer
+ * to 'new', instead of 'old', if that's the last row it has seen.
+ */
+void extract_rebase_row(
+    struct extraction_context *context, const struct row *old,
+    const struct row *new);
@@ -9,13 +9,68 @@
 #include "log.h"
 #include "debug.h"
 #include "macros.h"
+#include "misc.h"
 #include "sixel.h"
+#include "slab.h"
 #include "stride.h"
 #include "util.h"
 #include "xmalloc.h"
 
 #define TIME_REFLOW 0
 
+/*
+ * A compacted row stores each cell's character as a variable length
+ * integer (7 bits per byte, a single byte for ASCII). Trailing empty
+ * cells are not stored at all. The characters are followed by the
+ * cells' attributes, run-length encoded. The last run isn't stored
+ * either; its attributes ('fill') apply to all cells from 'fill_start'
+ * to the end of the row.
+ *
+ * Apart from 'cols', the encoding is thus independent of the row's
+ * width. This lets the reflow move a compacted line, that fits in the
+ * new width, as-is (see reflow_compact()).
+ *
+ * With typical terminal output, this is 10-30 times smaller than the
+ * expanded row.
+ */
+struct row_compact {
+    int cols;           /* Number of cells in the expanded row */
+    int text_cells;     /* Cells beyond this are empty (wc == 0) */
+    int used_cells;     /* Cells beyond this are empty, or padding spacers */
+    int attr_runs;      /* Runs (covering the cells before 'fill_start') */
+    int fill_start;
+    struct attributes fill;
+    size_t size;        /* Size of 'data' */
+    uint8_t data[];
+};
+
+/*
+ * Scrollback that hasn't yet been reflowed to the grid's current
+ * width.
+ *
+ * A resize only reflows the last part of the scrollback (everything
+ * from the oldest tracking point, and enough lines to fill the
+ * screen). The older rows are moved here, as they were, and reflowed
+ * afterwards, newest first, a chunk at a time (see
+ * grid_reflow_pending_step()). Each chunk ends up just above the
+ * already reflowed rows, in the free rows the deferred rows left
+ * behind. If new output uses up those rows in the meantime, the
+ * remaining deferred rows are dropped, just like they would have been
+ * scrolled out of a full scrollback.
+ *
+ * Since the rows are kept in the width they were laid out for,
+ * repeated resizes only ever reflow the last part of the scrollback.
+ */
+struct reflow_pending {
+    int cols;           /* Width the rows were laid out for */
+    int count;
+    int end;            /* Grid row just after the pending rows */
+    struct row *rows[]; /* Oldest first, ending with a hard linebreak */
+};
+
+/* Number of deferred rows reflowed at a time */
+#define REFLOW_CHUNK_ROWS 1024
+
 /*
  * "sb" (scrollback relative) coordinates
  *
@@ -265,8 +320,126 @@ range_delete(struct row_ranges *ranges, enum row_range_type type, size_t idx)
     ranges->count--;
 }
 
+/*
+ * Rows, and their cell arrays, are allocated from slabs (see slab.h);
+ * one for the row structs, and one per row width for the cells. This
+ * keeps adjacent rows close together in memory, avoids going through
+ * malloc() for every scrolled line, and lets the memory of erased
+ * scrollback be returned to the OS.
+ *
+ * A cell slab is destroyed when its last array is freed. This
+ * typically happens when the last grid of that width is reflowed, or
+ * destroyed.
+ */
+static struct slab *row_slab;
+static tll(struct slab *) cell_slabs;
+
+static struct row *
+row_struct_alloc(void)
+{
+    if (unlikely(row_slab == NULL))
+        row_slab = slab_new(sizeof(struct row));
+    return slab_alloc(row_slab);
+}
+
+static struct cell *
+cells_alloc(int cols)
+{
+    xassert(cols > 0);
+    const size_t size = cols * sizeof(struct cell);
+
+    tll_foreach(cell_slabs, it) {
+        if (slab_obj_size(it->item) == size)
+            return slab_alloc(it->item);
+    }
+
+    struct slab *slab = slab_new(size);
+    tll_push_front(cell_slabs, slab);
+    return slab_alloc(slab);
+}
+
+static void
+cells_free(struct cell *cells)
+{
+    if (cells == NULL)
+        return;
+
+    struct slab *slab = slab_of(cells);
+    slab_free(cells);
+
+    if (slab_live_count(slab) > 0)
+        return;
+
+    tll_foreach(cell_slabs, it) {
+        if (it->item == slab) {
+            tll_remove(cell_slabs, it);
+            break;
+        }
+    }
+    slab_destroy(slab);
+}
+
+static struct row *
+row_snapshot(const struct row *row, int num_cols)
+{
+    struct row *clone_row = row_struct_alloc();
+
+    clone_row->linebreak = row->linebreak;
+    clone_row->dirty = row->dirty;
+    clone_row->dirty_start = row->dirty_start;
+    clone_row->dirty_end = row->dirty_end;
+    clone_row->shell_integration = row->shell_integration;
+    clone_row->search_text = NULL;
+    clone_row->search_text_stale = false;
+
+    if (row->compact != NULL) {
+        clone_row->cells = NULL;
+        clone_row->compact = xmemdup(
+            row->compact, sizeof(*row->compact) + row->compact->size);
+    } else {
+        clone_row->compact = NULL;
+        clone_row->cells = cells_alloc(num_cols);
+
+        for (int c = 0; c < num_cols; c++)
+            clone_row->cells[c] = row->cells[c];
+    }
+
+    const struct row_data *extra = row->extra;
+
+    if (extra != NULL) {
+        struct row_data *clone_extra = xcalloc(1, sizeof(*clone_extra));
+        clone_row->extra = clone_extra;
+
+        range_ensure_size(&clone_extra->uri_ranges, extra->uri_ranges.count);
+        range_ensure_size(&clone_extra->underline_ranges, extra->underline_ranges.count);
+
+        for (int i = 0; i < extra->uri_ranges.count; i++) {
+            const struct row_range *range = &extra->uri_ranges.v[i];
+            range_append(
+                &clone_extra->uri_ranges,
+                range->start, range->end, ROW_RANGE_URI, &range->data);
+        }
+
+        for (int i = 0; i < extra->underline_ranges.count; i++) {
+            const struct row_range *range = &extra->underline_ranges.v[i];
+            range_append_by_ref(
+                &clone_extra->underline_ranges, range->start, range->end,
+                ROW_RANGE_UNDERLINE, &range->data);
+        }
+    } else
+        clone_row->extra = NULL;
+
+    return clone_row;
+}
+
+/*
+ * Only the rows in view (and the cursor's row, which the renderer
+ * dirties) are copied; the snapshot is used by URL mode, which neither
+ * scrolls, nor looks at anything outside the view. This keeps entering
+ * URL mode cheap, regardless of the scrollback size.
+ */
 struct grid *
-grid_snapshot(const struct grid *grid)
+grid_snapshot(const struct grid *grid, int screen_rows)
 {
     struct grid *clone = xmalloc(sizeof(*clone));
     clone->num_rows = grid->num_rows;
@@ -277,56 +450,49 @@ grid_snapshot(const struct grid *grid)
     clone->saved_cursor = grid->saved_cursor;
     clone->kitty_kbd = grid->kitty_kbd;
     clone->rows = xcalloc(grid->num_rows, sizeof(clone->rows[0]));
+    clone->uncompact_gen = grid->uncompact_gen;
+    clone->compacted_gen = grid->compacted_gen;
+    clone->pending_compact = grid->pending_compact;
+    clone->reflow_pending = NULL;
     memset(&clone->scroll_damage, 0, sizeof(clone->scroll_damage));
     memset(&clone->sixel_images, 0, sizeof(clone->sixel_images));
 
     tll_foreach(grid->scroll_damage, it)
         tll_push_back(clone->scroll_damage, it->item);
 
-    for (int r = 0; r < grid->num_rows; r++) {
+    const int mask = grid->num_rows - 1;
+
+    for (int i = 0; i < screen_rows; i++) {
+        const int r = (grid->view + i) & mask;
         const struct row *row = grid->rows[r];
 
         if (row == NULL)
             continue;
 
-        struct row *clone_row = xmalloc(sizeof(*row));
-        clone->rows[r] = clone_row;
-
-        clone_row->cells = xmalloc(grid->num_cols * sizeof(clone_row->cells[0]));
-        clone_row->linebreak = row->linebreak;
-        clone_row->dirty = row->dirty;
-        clone_row->shell_integration = row->shell_integration;
-
-        for (int c = 0; c < grid->num_cols; c++)
-            clone_row->cells[c] = row->cells[c];
-
-        const struct row_data *extra = row->extra;
+        clone->rows[r] = row_snapshot(row, grid->num_cols);
+    }
 
-        if (extra != NULL) {
-            struct row_data *clone_extra = xcalloc(1, sizeof(*clone_extra));
-            clone_row->extra = clone_extra;
+    /* The cursor may be outside the view, when scrolled back */
+    const int cursor_row = (grid->offset + grid->cursor.point.row) & mask;
+    if (clone->rows[cursor_row] == NULL && grid->rows[cursor_row] != NULL) {
+        clone->rows[cursor_row] = row_snapshot(
+            grid->rows[cursor_row], grid->num_cols);
+    }
 
-            range_ensure_size(&clone_extra->uri_ranges, extra->uri_ranges.count);
-            range_ensure_size(&clone_extra->underline_ranges, extra->underline_ranges.count);
+    /* Same calculations as in render_sixel_images() */
+    const int scrollback_end = (grid->offset + screen_rows) & mask;
+    const int view_start = (grid->view - scrollback_end + grid->num_rows) & mask;
+    const int view_end = view_start + screen_rows - 1;
 
-            for (int i = 0; i < extra->uri_ranges.count; i++) {
-                const struct row_range *range = &extra->uri_ranges.v[i];
-                range_append(
-                    &clone_extra->uri_ranges,
-                    range->start, range->end, ROW_RANGE_URI, &range->data);
-            }
+    tll_foreach(grid->sixel_images, it) {
+        const int start = (it->item.pos.row - scrollback_end + grid->num_rows) & mask;
+        const int end = start + it->item.rows - 1;
 
-            for (int i = 0; i < extra->underline_ranges.count; i++) {
-                const struct row_range *range = &extra->underline_ranges.v[i];
-                range_append_by_ref(
-                    &clone_extra->underline_ranges, range->start, range->end,
-                    ROW_RANGE_UNDERLINE, &range->data);
-            }
-        } else
-            clone_row->extra = NULL;
-    }
+        if (start > view_end)
+            continue;
+        if (end < view_start)
+            break;
 
-    tll_foreach(grid->sixel_images, it) {
         int original_width = it->item.original.width;
         int original_height = it->item.original.height;
         pixman_image_t *original_pix = it->item.original.pix;
@@ -404,6 +570,8 @@ grid_free(struct grid *grid)
     for (int r = 0; r < grid->num_rows; r++)
         grid_row_free(grid->rows[r]);
 
+    grid_reflow_pending_discard(grid);
+
     tll_foreach(grid->sixel_images, it) {
         sixel_destroy(&it->item);
         tll_remove(grid->sixel_images, it);
@@ -432,20 +600,26 @@ grid_swap_row(struct grid *grid, int row_a, int row_b)
 struct row *
 grid_row_alloc(int cols, bool initialize)
 {
-    struct row *row = xmalloc(sizeof(*row));
+    struct row *row = row_struct_alloc();
     row->dirty = false;
+    row->dirty_start = 0;
+    row->dirty_end = -1;
     row->linebreak = false;
     row->extra = NULL;
+    row->compact = NULL;
+    row->search_text = NULL;
+    row->search_text_stale = false;
     row->shell_integration.prompt_marker = false;
     row->shell_integration.cmd_start = -1;
     row->shell_integration.cmd_end = -1;
 
+    row->cells = cells_alloc(cols);
+
     if (initialize) {
-        row->cells = xcalloc(cols, sizeof(row->cells[0]));
+        memset(row->cells, 0, cols * sizeof(row->cells[0]));
         for (size_t c = 0; c < cols; c++)
             row->cells[c].attrs.clean = 1;
-    } else
-        row->cells = xmalloc(cols * sizeof(row->cells[0]));
+    }
 
     return row;
 }
@@ -458,8 +632,359 @@ grid_row_free(struct row *row)
 
     grid_row_reset_extra(row);
     free(row->extra);
-    free(row->cells);
-    free(row);
+    free(row->compact);
+    free(row->search_text);
+    cells_free(row->cells);
+    slab_free(row);
+}
+
+static inline size_t
+varint_encode(uint8_t *out, uint32_t v)
+{
+    size_t len = 0;
+    while (v >= 0x80) {
+        out[len++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    out[len++] = v;
+    return len;
+}
+
+static inline uint32_t
+varint_decode(const uint8_t **p)
+{
+    uint32_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t b = *(*p)++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+}
+
+static inline uint64_t
+attrs_as_u64(const struct attributes *attrs)
+{
+    uint64_t v;
+    memcpy(&v, attrs, sizeof(v));
+    return v;
+}
+
+/* Encodes the cells in compact form. Returns NULL if that doesn't save memory */
+static struct row_compact *
+row_compact_encode(const struct cell *cells, int cols)
+{
+    /* Worst case: 5 bytes per character, and one attribute run per cell */
+    static uint8_t *buf = NULL;
+    static size_t buf_size = 0;
+
+    const size_t max_size = cols * (5 + 5 + sizeof(struct attributes));
+    if (max_size > buf_size) {
+        free(buf);
+        buf = xmalloc(max_size);
+        buf_size = max_size;
+    }
+
+    int text_cells = cols;
+    while (text_cells > 0 && cells[text_cells - 1].wc == 0)
+        text_cells--;
+
+    /* Same predicate as the reflow slow path uses; see resize_and_reflow() */
+    int used_cells = text_cells;
+    while (used_cells > 0 &&
+           (cells[used_cells - 1].wc == 0 ||
+            cells[used_cells - 1].wc == CELL_SPACER))
+    {
+        used_cells--;
+    }
+
+    size_t len = 0;
+    for (int c = 0; c < text_cells; c++) {
+        const char32_t wc = cells[c].wc;
+        if (likely(wc < 0x80))
+            buf[len++] = wc;
+        else
+            len += varint_encode(&buf[len], wc);
+    }
+
+    /* The 'clean' bit is not preserved; expanded rows are always
+     * fully dirty */
+    const uint64_t clean_mask = attrs_as_u64(&(struct attributes){.clean = 1});
+
+    int attr_runs = 0;
+    int fill_start = 0;
+    uint64_t attrs;
+
+    for (int c = 0;; attr_runs++) {
+        attrs = attrs_as_u64(&cells[c].attrs) & ~clean_mask;
+
+        int run = 1;
+        while (c + run < cols &&
+               (attrs_as_u64(&cells[c + run].attrs) & ~clean_mask) == attrs)
+        {
+            run++;
+        }
+
+        if (c + run == cols) {
+            /* Last run; stored as the 'fill' attributes */
+            fill_start = c;
+            break;
+        }
+
+        len += varint_encode(&buf[len], run);
+        memcpy(&buf[len], &attrs, sizeof(attrs));
+        len += sizeof(attrs);
+
+        c += run;
+    }
+
+    xassert(len <= max_size);
+
+    if (sizeof(struct row_compact) + len >= cols * sizeof(cells[0])) {
+        /* Not worth it */
+        return NULL;
+    }
+
+    struct row_compact *compact = xmalloc(sizeof(*compact) + len);
+    compact->cols = cols;
+    compact->text_cells = text_cells;
+    compact->used_cells = used_cells;
+    compact->attr_runs = attr_runs;
+    compact->fill_start = fill_start;
+    memcpy(&compact->fill, &attrs, sizeof(attrs));
+    compact->size = len;
+    memcpy(compact->data, buf, len);
+    return compact;
+}
+
+void
+grid_row_compact(struct row *row, int cols)
+{
+    if (row->compact != NULL)
+        return;
+
+    struct row_compact *compact = row_compact_encode(row->cells, cols);
+    if (compact == NULL)
+        return;
+
+    cells_free(row->cells);
+    row->cells = NULL;
+    row->compact = compact;
+}
+
+/* Copies the row's text, attributes and line properties; nothing else */
+static struct row *
+row_snapshot_compact(const struct row *row, int num_cols)
+{
+    struct row *clone_row = row_struct_alloc();
+    *clone_row = (struct row){
+        .linebreak = row->linebreak,
+        .dirty_end = -1,
+        .shell_integration = row->shell_integration,
+    };
+
+    if (row->compact != NULL) {
+        clone_row->compact = xmemdup(
+            row->compact, sizeof(*row->compact) + row->compact->size);
+    } else if ((clone_row->compact = row_compact_encode(row->cells, num_cols)) == NULL) {
+        clone_row->cells = cells_alloc(num_cols);
+        memcpy(clone_row->cells, row->cells, num_cols * sizeof(row->cells[0]));
+    }
+
+    return clone_row;
+}
+
+/*
+ * Copies the rows [start, end] (absolute row numbers, wrapping
+ * around), in compact form, for consumers that read them after the
+ * grid has changed (e.g. pipe commands). Only the rows' text,
+ * attributes and line properties are copied.
+ */
+struct grid *
+grid_snapshot_rows(const struct grid *grid, int start, int end)
+{
+    struct grid *clone = xcalloc(1, sizeof(*clone));
+    clone->num_rows = grid->num_rows;
+    clone->num_cols = grid->num_cols;
+    clone->offset = grid->offset;
+    clone->view = grid->view;
+    clone->rows = xcalloc(grid->num_rows, sizeof(clone->rows[0]));
+
+    const int mask = grid->num_rows - 1;
+
+    for (int r = start;; r = (r + 1) & mask) {
+        const struct row *row = grid->rows[r];
+        if (row != NULL)
+            clone->rows[r] = row_snapshot_compact(row, grid->num_cols);
+
+        if (r == end)
+            break;
+    }
+
+    return clone;
+}
+
+static void
+row_compact_decode(const struct row_compact *compact, struct cell *cells)
+{
+    const uint8_t *p = compact->data;
+
+    for (int c = 0; c < compact->text_cells; c++)
+        cells[c].wc = varint_decode(&p);
+    for (int c = compact->text_cells; c < compact->cols; c++)
+        cells[c].wc = 0;
+
+    for (int i = 0, c = 0; i < compact->attr_runs; i++) {
+        const int run = varint_decode(&p);
+
+        struct attributes attrs;
+        memcpy(&attrs, p, sizeof(attrs));
+        p += sizeof(attrs);
+
+        xassert(c + run <= compact->fill_start);
+        for (int j = 0; j < run; j++)
+            cells[c++].attrs = attrs;
+    }
+
+    for (int c = compact->fill_start; c < compact->cols; c++)
+        cells[c].attrs = compact->fill;
+
+    xassert(p == &compact->data[compact->size]);
+}
+
+void
+_grid_row_uncompact(struct grid *grid, struct row *row)
+{
+    xassert(row->compact != NULL);
+    xassert(row->cells == NULL);
+
+    struct cell *cells = cells_alloc(row->compact->cols);
+    row_compact_decode(row->compact, cells);
+
+    free(row->compact);
+    row->compact = NULL;
+    row->cells = cells;
+    grid_row_dirty(row);
+    grid->uncompact_gen++;
+}
+
+const struct cell *
+grid_row_peek_cells(const struct row *row, struct cell *scratch)
+{
+    if (row->compact == NULL)
+        return row->cells;
+
+    row_compact_decode(row->compact, scratch);
+    return scratch;
+}
+
+static void
+row_mark_composed(const struct row *row, int cols,
+                  const struct composed_table *composed)
+{
+    if (row->compact != NULL) {
+        /* No need to decode the attributes */
+        const uint8_t *p = row->compact->data;
+        for (int c = 0; c < row->compact->text_cells; c++) {
+            const char32_t wc = varint_decode(&p);
+            if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI)
+                composed_mark(composed, wc - CELL_COMB_CHARS_LO);
+        }
+        return;
+    }
+
+    for (int c = 0; c < cols; c++) {
+        const char32_t wc = row->cells[c].wc;
+        if (wc >= CELL_COMB_CHARS_LO && wc <= CELL_COMB_CHARS_HI)
+            composed_mark(composed, wc - CELL_COMB_CHARS_LO);
+    }
+}
+
+void
+grid_mark_composed(const struct grid *grid,
+                   const struct composed_table *composed)
+{
+    for (int r = 0; r < grid->num_rows; r++) {
+        const struct row *row = grid->rows[r];
+        if (row != NULL)
+            row_mark_composed(row, grid->num_cols, composed);
+    }
+
+    const struct reflow_pending *pending = grid->reflow_pending;
+    if (pending != NULL) {
+        for (int r = 0; r < pending->count; r++)
+            row_mark_composed(pending->rows[r], pending->cols, composed);
+    }
+}
+
+void
+_grid_row_discard_compact(struct row *row)
+{
+    xassert(row->compact != NULL);
+    xassert(row->cells == NULL);
+
+    row->cells = cells_alloc(row->compact->cols);
+    free(row->compact);
+    row->compact = NULL;
+}
+
+static void
+compact_scrollback(struct grid *grid, int screen_rows)
+{
+    const int mask = grid->num_rows - 1;
+
+    for (int r = 0; r < grid->num_rows; r++) {
+        struct row *row = grid->rows[r];
+        if (row == NULL || row->compact != NULL)
+            continue;
+
+        /* Skip rows on screen, and rows in view */
+        if (((r - grid->offset) & mask) < screen_rows ||
+            ((r - grid->view) & mask) < screen_rows)
+        {
+            continue;
+        }
+
+        grid_row_compact(row, grid->num_cols);
+    }
+
+    grid->compacted_gen = grid->uncompact_gen;
+    grid->pending_compact = 0;
+}
+
+/* Compacts the rows scrolled out since the last compaction */
+static void
+compact_scrolled_out(struct grid *grid, int screen_rows)
+{
+    const int mask = grid->num_rows - 1;
+    const int count = min(grid->pending_compact, grid->num_rows - screen_rows);
+    int skipped = 0;
+
+    for (int i = 1; i <= count; i++) {
+        const int r = (grid->offset - i) & mask;
+        struct row *row = grid->rows[r];
+        if (row == NULL || row->compact != NULL)
+            continue;
+
+        /* Skip rows in view; they would just be expanded again */
+        if (((r - grid->view) & mask) < screen_rows) {
+            skipped = i;
+            continue;
+        }
+
+        grid_row_compact(row, grid->num_cols);
+    }
+
+    grid->pending_compact = skipped;
+}
+
+void
+grid_compact_scrollback(struct grid *grid, int screen_rows)
+{
+    if (grid->compacted_gen != grid->uncompact_gen)
+        compact_scrollback(grid, screen_rows);
+    else if (grid->pending_compact > 0)
+        compact_scrolled_out(grid, screen_rows);
 }
 
 void
@@ -473,6 +998,9 @@ grid_resize_without_reflow(
 
     struct row **new_grid = xcalloc(new_rows, sizeof(new_grid[0]));
 
+    /* The scrollback is thrown away */
+    grid_reflow_pending_discard(grid);
+
     tll(struct sixel) untranslated_sixels = tll_init();
     tll_foreach(grid->sixel_images, it)
         tll_push_back(untranslated_sixels, it->item);
@@ -485,7 +1013,7 @@ grid_resize_without_reflow(
         const int old_row_idx = (grid->offset + r) & (old_rows - 1);
         const int new_row_idx = (new_offset + r) & (new_rows - 1);
 
-        const struct row *old_row = old_grid[old_row_idx];
+        const struct row *old_row = grid_row_uncompact(grid, old_grid[old_row_idx]);
         xassert(old_row != NULL);
 
         struct row *new_row = grid_row_alloc(new_cols, false);
@@ -496,6 +1024,8 @@ grid_resize_without_reflow(
                sizeof(struct cell) * min(old_cols, new_cols));
 
         new_row->dirty = old_row->dirty;
+        new_row->dirty_start = old_row->dirty_start;
+        new_row->dirty_end = old_row->dirty_end;
         new_row->linebreak = false;
         new_row->shell_integration.prompt_marker = old_row->shell_integration.prompt_marker;
         new_row->shell_integration.cmd_start = min(old_row->shell_integration.cmd_start, new_cols - 1);
@@ -505,7 +1035,7 @@ grid_resize_without_reflow(
             /* Clear "new" columns */
             memset(&new_row->cells[old_cols], 0,
                    sizeof(struct cell) * (new_cols - old_cols));
-            new_row->dirty = true;
+            grid_row_dirty_range(new_row, old_cols, new_cols - 1);
         } else if (old_cols > new_cols) {
             /* Make sure we don't cut a multi-column character in two */
             for (int i = new_cols; i > 0 && old_row->cells[i].wc > CELL_SPACER; i--)
@@ -571,7 +1101,7 @@ grid_resize_without_reflow(
         new_grid[(new_offset + r) & (new_rows - 1)] = new_row;
 
         memset(new_row->cells, 0, sizeof(struct cell) * new_cols);
-        new_row->dirty = true;
+        grid_row_dirty(new_row);
     }
 
 #if defined(_DEBUG)
@@ -691,6 +1221,106 @@ reflow_range_end(struct row_range *range, enum row_range_type type,
     new_range->end = new_col_idx;
 }
 
+/*
+ * Reflow fast path, for a compacted row holding a complete logical
+ * line. Returns the line's compacted form for the new width; with the
+ * same content a regular reflow, followed by grid_row_compact(), would
+ * have given it. Returns NULL if the line doesn't fit in 'new_cols',
+ * in which case the caller must take the slow path.
+ *
+ * Cells after the line's last non-empty cell are erased by the reflow.
+ * Typically, they already are, and the compacted row is simply
+ * re-used (the returned pointer is 'old' itself). Otherwise, it is
+ * re-encoded, without being expanded.
+ */
+static struct row_compact *
+reflow_compact(struct row_compact *old, int new_cols)
+{
+    const int used_cells = old->used_cells;
+
+    if (used_cells > new_cols)
+        return NULL;
+
+    if (old->text_cells == used_cells &&
+        old->fill_start <= used_cells &&
+        attrs_as_u64(&old->fill) == 0)
+    {
+        old->cols = new_cols;
+        return old;
+    }
+
+    /* Skip to the end of the text we're keeping */
+    const uint8_t *p = old->data;
+    for (int c = 0; c < used_cells; c++)
+        varint_decode(&p);
+
+    const size_t text_len = p - old->data;
+
+    for (int c = used_cells; c < old->text_cells; c++)
+        varint_decode(&p);
+
+    uint8_t buf[text_len + (old->attr_runs + 1) * (5 + sizeof(uint64_t))];
+    memcpy(buf, old->data, text_len);
+
+    size_t len = text_len;
+    int attr_runs = 0;
+    int fill_start = 0;
+    uint64_t last_attrs = 0;
+    size_t last_run_ofs = 0;
+
+    /* Attribute runs of the cells we're keeping */
+    for (int i = 0; i <= old->attr_runs && fill_start < used_cells; i++) {
+        int run;
+        uint64_t attrs;
+
+        if (i < old->attr_runs) {
+            run = varint_decode(&p);
+            memcpy(&attrs, p, sizeof(attrs));
+            p += sizeof(attrs);
+        } else {
+            run = used_cells - fill_start;
+            attrs = attrs_as_u64(&old->fill);
+        }
+
+        run = min(run, used_cells - fill_start);
+
+        last_run_ofs = len;
+        last_attrs = attrs;
+        len += varint_encode(&buf[len], run);
+        memcpy(&buf[len], &attrs, sizeof(attrs));
+        len += sizeof(attrs);
+
+        attr_runs++;
+        fill_start += run;
+    }
+
+    if (attr_runs > 0 && last_attrs == 0) {
+        /* Last run is merged into the (empty) fill */
+        const uint8_t *q = &buf[last_run_ofs];
+        fill_start -= varint_decode(&q);
+        len = last_run_ofs;
+        attr_runs--;
+    }
+
+    xassert(len <= sizeof(buf));
+
+    if (sizeof(struct row_compact) + len >= new_cols * sizeof(struct cell)) {
+        /* grid_row_compact() wouldn't have compacted it */
+        return NULL;
+    }
+
+    struct row_compact *compact = xmalloc(sizeof(*compact) + len);
+    compact->cols = new_cols;
+    compact->text_cells = used_cells;
+    compact->used_cells = used_cells;
+    compact->attr_runs = attr_runs;
+    compact->fill_start = fill_start;
+    compact->fill = (struct attributes){0};
+    compact->size = len;
+    memcpy(compact->data, buf, len);
+    return compact;
+}
+
 static struct row *
 _line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
            int *row_idx, int *col_idx, int row_count, int col_count)
@@ -706,6 +1336,9 @@ _line_wrap(struct grid *old_grid, struct row **new_grid, struct row *row,
         new_grid[*row_idx] = new_row;
     } else {
         /* Scrollback is full, need to reuse a row */
+        if (new_row->compact != NULL)
+            _grid_row_discard_compact(new_row);
+
         grid_row_reset_extra(new_row);
         new_row->linebreak = false;
         new_row->shell_integration.prompt_marker = false;
@@ -809,18 +1442,13 @@ tp_cmp(const void *_a, const void *_b)
     return 0;
 }
 
-void
-grid_resize_and_reflow(
+static void
+resize_and_reflow(
     struct grid *grid, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows,
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count])
 {
-#if defined(TIME_REFLOW) && TIME_REFLOW
-    struct timespec start;
-    clock_gettime(CLOCK_MONOTONIC, &start);
-#endif
-
     struct row *const *old_grid = grid->rows;
     const int old_rows = grid->num_rows;
     const int old_cols = grid->num_cols;
@@ -897,7 +1525,7 @@ grid_resize_and_reflow(
         const size_t old_row_idx = (offset + r) & (old_rows - 1);
 
         /* Unallocated (empty) rows we can simply skip */
-        const struct row *old_row = old_grid[old_row_idx];
+        struct row *old_row = old_grid[old_row_idx];
         if (old_row == NULL)
             continue;
 
@@ -918,14 +1546,67 @@ grid_resize_and_reflow(
             grid, new_grid, new_row, &new_row_idx, &new_col_idx,    \
             new_rows, new_cols)
 
-        /* Find last non-empty cell */
-        int col_count = 0;
-        for (int c = old_cols - 1; c >= 0; c--) {
-            const struct cell *cell = &old_row->cells[c];
-            if (!(cell->wc == 0 || cell->wc == CELL_SPACER)) {
-                col_count = c + 1;
-                break;
-            }
+        /*
+         * Most of the scrollback consists of compacted, single-row,
+         * lines. Unless something (URIs, tracking points etc.) needs
+         * to be mapped, these are moved to the new grid as-is (see
+         * reflow_compact()), instead of being expanded, copied, and
+         * re-compacted.
+         */
+        struct row_compact *compact;
+        if (old_row->compact != NULL &&
+            old_row->linebreak &&
+            old_row->extra == NULL &&
+            old_row->shell_integration.cmd_start < 0 &&
+            old_row->shell_integration.cmd_end < 0 &&
+            (*next_tp)->row != old_row_idx &&
+            new_col_idx == 0 &&
+            new_row->extra == NULL &&
+            r + 1 < old_rows &&
+            (compact = reflow_compact(old_row->compact, new_cols)) != NULL)
+        {
+            if (compact != old_row->compact) {
+                free(old_row->compact);
+                old_row->compact = compact;
+            }
+
+            if (compact->used_cells == 0)
+                old_row->shell_integration.prompt_marker = false;
+            old_row->search_text_stale = true;
+
+            /* The old row takes the (still empty) new row's place... */
+            grid->rows[old_row_idx] = NULL;
+            new_grid[new_row_idx] = old_row;
+
+            /* ...which moves down one step */
+            new_row_idx = (new_row_idx + 1) & (new_rows - 1);
+
+            struct row *overwritten = new_grid[new_row_idx];
+            if (overwritten != NULL) {
+                /* Scrollback is full */
+                tll_foreach(grid->sixel_images, it) {
+                    if (it->item.pos.row == new_row_idx) {
+                        sixel_destroy(&it->item);
+                        tll_remove(grid->sixel_images, it);
+                    }
+                }
+                grid_row_free(overwritten);
+            }
+
+            new_grid[new_row_idx] = new_row;
+            continue;
+        }
+
+        grid_row_uncompact(grid, old_row);
+
+        /* Find last non-empty cell */
+        int col_count = 0;
+        for (int c = old_cols - 1; c >= 0; c--) {
+            const struct cell *cell = &old_row->cells[c];
+            if (!(cell->wc == 0 || cell->wc == CELL_SPACER)) {
+                col_count = c + 1;
+                break;
+            }
         }
 
         if (!old_row->linebreak && col_count > 0) {
@@ -1236,11 +1917,13 @@ grid_resize_and_reflow(
     while (new_grid[grid->offset] == NULL)
         grid->offset = (grid->offset + 1) & (new_rows - 1);
 
-    /* Ensure all visible rows have been allocated */
+    /* Ensure all visible rows have been allocated (and expanded) */
     for (int r = 0; r < new_screen_rows; r++) {
         int idx = (grid->offset + r) & (new_rows - 1);
         if (new_grid[idx] == NULL)
             new_grid[idx] = grid_row_alloc(new_cols, true);
+        else
+            grid_row_uncompact(grid, new_grid[idx]);
     }
 
     /* Free old grid (rows already free:d) */
@@ -1280,6 +1963,9 @@ grid_resize_and_reflow(
     grid->cursor.point = cursor;
     grid->saved_cursor.point = saved_cursor;
 
+    /* All rows have been re-created, expanded */
+    compact_scrollback(grid, new_screen_rows);
+
     grid->cursor.lcf = false;
     grid->saved_cursor.lcf = false;
 
@@ -1288,19 +1974,299 @@ grid_resize_and_reflow(
         sixel_destroy(&it->item);
     tll_free(untranslated_sixels);
 
+}
+
+/* Number of cells the reflow copies from the row */
+static int
+row_reflow_cells(const struct row *row, int cols)
+{
+    int used_cells = 0;
+
+    if (row->compact != NULL)
+        used_cells = row->compact->used_cells;
+    else {
+        for (int c = cols - 1; c >= 0; c--) {
+            const char32_t wc = row->cells[c].wc;
+            if (!(wc == 0 || wc == CELL_SPACER)) {
+                used_cells = c + 1;
+                break;
+            }
+        }
+    }
+
+    /* Logical lines aren't truncated */
+    return !row->linebreak && used_cells > 0 ? cols : used_cells;
+}
+
+/*
+ * Moves the scrollback rows that don't have to be reflowed right
+ * away, to a new reflow_pending. That is, all rows before both the
+ * row 'keep_sb' (scrollback relative), and the logical lines needed
+ * to fill the new screen.
+ *
+ * Returns NULL, leaving the grid as it is, if that's too few rows to
+ * be worth it.
+ */
+static struct reflow_pending *
+reflow_defer_scrollback(struct grid *grid, int old_screen_rows,
+                        int new_cols, int new_screen_rows, int keep_sb)
+{
+    /* Sixels are mapped to their new rows by the reflow itself */
+    if (tll_length(grid->sixel_images) > 0)
+        return NULL;
+
+    const int mask = grid->num_rows - 1;
+    const int old_cols = grid->num_cols;
+    const int sb_start = grid->offset + old_screen_rows;
+
+    /*
+     * Walk the logical lines, bottom up, counting (a lower bound of)
+     * the number of rows they'll need in the new width
+     */
+    int split = -1;
+    int new_line_rows = 0;
+    int cells = 0;
+
+    for (int sb = grid->num_rows - 1; sb > 0; sb--) {
+        const struct row *row = grid->rows[(sb_start + sb) & mask];
+        const struct row *prev = grid->rows[(sb_start + sb - 1) & mask];
+        xassert(row != NULL);
+
+        if (keep_sb - sb > REFLOW_CHUNK_ROWS) {
+            /* Very long logical line; not worth looking further */
+            return NULL;
+        }
+
+        cells += row_reflow_cells(row, old_cols);
+
+        if (prev != NULL && !prev->linebreak)
+            continue;
+
+        /* A logical line starts at this row */
+        new_line_rows += max(1, (cells + new_cols - 1) / new_cols);
+        cells = 0;
+
+        if (prev == NULL) {
+            /* Reached the scrollback start */
+            return NULL;
+        }
+
+        if (sb <= keep_sb && new_line_rows >= new_screen_rows) {
+            split = sb;
+            break;
+        }
+    }
+
+    if (split < 0)
+        return NULL;
+
+    int first = 0;
+    while (grid->rows[(sb_start + first) & mask] == NULL)
+        first++;
+
+    const int count = split - first;
+    if (count < REFLOW_CHUNK_ROWS)
+        return NULL;
+
+    struct reflow_pending *pending = xmalloc(
+        sizeof(*pending) + count * sizeof(pending->rows[0]));
+    pending->cols = old_cols;
+    pending->count = count;
+    pending->end = -1;
+
+    for (int i = 0; i < count; i++) {
+        const int r = (sb_start + first + i) & mask;
+        xassert(grid->rows[r] != NULL);
+
+        pending->rows[i] = grid->rows[r];
+        grid->rows[r] = NULL;
+    }
+
+    xassert(pending->rows[count - 1]->linebreak);
+    return pending;
+}
+
+/* Number of free rows just above the already reflowed scrollback */
+static int
+reflow_pending_space(const struct grid *grid)
+{
+    const struct reflow_pending *pending = grid->reflow_pending;
+    const int mask = grid->num_rows - 1;
+
+    int space = 0;
+    while (space < grid->num_rows &&
+           grid->rows[(pending->end - space - 1) & mask] == NULL)
+    {
+        space++;
+    }
+
+    return space;
+}
+
+void
+grid_resize_and_reflow(
+    struct grid *grid, int new_rows, int new_cols,
+    int old_screen_rows, int new_screen_rows,
+    size_t tracking_points_count,
+    struct coord *const _tracking_points[static tracking_points_count])
+{
+#if defined(TIME_REFLOW) && TIME_REFLOW
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const int old_rows = grid->num_rows;
+#endif
+
+    if (grid->reflow_pending != NULL && reflow_pending_space(grid) == 0)
+        grid_reflow_pending_discard(grid);
+
+    if (grid->reflow_pending == NULL) {
+        /* Oldest row that must be reflowed right away */
+        const int num_rows = grid->num_rows;
+        const int mask = num_rows - 1;
+        const int sb_start = grid->offset + old_screen_rows;
+
+        const int cursor_row = grid->offset + grid->cursor.point.row;
+        const int saved_cursor_row = grid->offset + grid->saved_cursor.point.row;
+
+        int keep_sb = (grid->view - sb_start + num_rows) & mask;
+        keep_sb = min(keep_sb, (cursor_row - sb_start + num_rows) & mask);
+        keep_sb = min(keep_sb, (saved_cursor_row - sb_start + num_rows) & mask);
+
+        for (size_t i = 0; i < tracking_points_count; i++) {
+            const int row = _tracking_points[i]->row;
+            keep_sb = min(keep_sb, (row - sb_start + num_rows) & mask);
+        }
+
+        grid->reflow_pending = reflow_defer_scrollback(
+            grid, old_screen_rows, new_cols, new_screen_rows, keep_sb);
+    }
+
+    resize_and_reflow(
+        grid, new_rows, new_cols, old_screen_rows, new_screen_rows,
+        tracking_points_count, _tracking_points);
+
+    /* The first reflowed row is placed first in the new grid */
+    if (grid->reflow_pending != NULL)
+        grid->reflow_pending->end = 0;
+
 #if defined(TIME_REFLOW) && TIME_REFLOW
     struct timespec stop;
     clock_gettime(CLOCK_MONOTONIC, &stop);
 
     struct timespec diff;
     timespec_sub(&stop, &start, &diff);
-    LOG_INFO("reflowed %d -> %d rows in %lds %ldns",
+    LOG_INFO("reflowed %d -> %d rows (%d deferred) in %lds %ldns",
              old_rows, new_rows,
+             grid->reflow_pending != NULL ? grid->reflow_pending->count : 0,
              (long)diff.tv_sec,
              diff.tv_nsec);
 #endif
 }
 
+/*
+ * Reflows the (up to) 'max_rows' newest pending rows, rounded up to
+ * whole logical lines. Returns false when there's nothing left to
+ * reflow.
+ */
+static bool
+reflow_pending_chunk(struct grid *grid, int max_rows)
+{
+    struct reflow_pending *pending = grid->reflow_pending;
+    if (pending == NULL)
+        return false;
+
+    const int space = reflow_pending_space(grid);
+    if (space == 0) {
+        grid_reflow_pending_discard(grid);
+        return false;
+    }
+
+    int start = max(pending->count - max_rows, 0);
+    while (start > 0 && !pending->rows[start - 1]->linebreak)
+        start--;
+
+    const int count = pending->count - start;
+
+    /*
+     * Reflow the chunk as a grid of its own, with a single screen
+     * row: its last row. The cursor is placed on that row, since
+     * resize_and_reflow() tracks it.
+     */
+    const int chunk_rows = 1 << (32 - __builtin_clz(count));
+    struct grid chunk = {
+        .num_rows = chunk_rows,
+        .num_cols = pending->cols,
+        .offset = count,
+        .view = count,
+        .cursor = {.point = {.row = chunk_rows - 1}},
+        .saved_cursor = {.point = {.row = chunk_rows - 1}},
+        .rows = xcalloc(chunk_rows, sizeof(chunk.rows[0])),
+    };
+
+    memcpy(chunk.rows, &pending->rows[start], count * sizeof(chunk.rows[0]));
+    pending->count = start;
+
+    /* Only the last 'space' rows can be kept */
+    resize_and_reflow(
+        &chunk, 1 << (32 - __builtin_clz(space)), grid->num_cols, 0, 1,
+        0, (struct coord *[]){NULL});
+
+    const int mask = grid->num_rows - 1;
+    const int chunk_mask = chunk.num_rows - 1;
+
+    /* Move the reflowed rows, newest first, to the free rows */
+    int r = chunk.offset;
+    for (int i = 0;
+         i < space && chunk.rows[r] != NULL;
+         i++, r = (r - 1) & chunk_mask)
+    {
+        struct row *row = chunk.rows[r];
+        chunk.rows[r] = NULL;
+        grid_row_compact(row, grid->num_cols);
+
+        pending->end = (pending->end - 1) & mask;
+        xassert(grid->rows[pending->end] == NULL);
+        grid->rows[pending->end] = row;
+    }
+
+    /* Rows that didn't fit; the scrollback is full */
+    const bool full = chunk.rows[r] != NULL;
+    grid_free(&chunk);
+
+    if (full || pending->count == 0) {
+        grid_reflow_pending_discard(grid);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+grid_reflow_pending_step(struct grid *grid)
+{
+    return reflow_pending_chunk(grid, REFLOW_CHUNK_ROWS);
+}
+
+void
+grid_reflow_pending_finish(struct grid *grid)
+{
+    reflow_pending_chunk(grid, INT_MAX);
+}
+
+void
+grid_reflow_pending_discard(struct grid *grid)
+{
+    struct reflow_pending *pending = grid->reflow_pending;
+    if (pending == NULL)
+        return;
+
+    for (int r = 0; r < pending->count; r++)
+        grid_row_free(pending->rows[r]);
+
+    free(pending);
+    grid->reflow_pending = NULL;
+}
+
 static bool
 ranges_match(const struct row_range *r1, const struct row_range *r2,
              enum row_range_type type)
@@ -1592,6 +2558,120 @@ grid_row_range_erase(struct row_ranges *ranges, enum row_range_type type,
     }
 }
 
+/*
+ * Like grid_row_range_put(), but for all columns in [start, end]
+ */
+static void
+grid_row_range_put_span(struct row_ranges *ranges, int start, int end,
+                        const union row_range_data *data,
+                        enum row_range_type type)
+{
+    xassert(start <= end);
+
+    if (start < end)
+        grid_row_range_erase(ranges, type, start + 1, end);
+
+    grid_row_range_put(ranges, start, data, type);
+
+    /* Since everything after 'start' has been erased, the range
+     * covering 'start' now ends there. Extend it to cover the
+     * entire span */
+    for (int i = ranges->count - 1; i >= 0; i--) {
+        struct row_range *r = &ranges->v[i];
+
+        if (r->start > start)
+            continue;
+
+        xassert(r->end == start);
+        r->end = end;
+
+        if (i + 1 < ranges->count) {
+            const struct row_range *next = &ranges->v[i + 1];
+
+            if (ranges_match(r, next, type) && r->end + 1 == next->start) {
+                r->end = next->end;
+                range_delete(ranges, type, i + 1);
+            }
+        }
+        break;
+    }
+}
+
+void
+grid_row_uri_range_put_span(struct row *row, int start, int end,
+                            const char *uri, uint64_t id)
+{
+    ensure_row_has_extra_data(row);
+
+    grid_row_range_put_span(
+        &row->extra->uri_ranges, start, end,
+        &(union row_range_data){.uri = {.id = id, .uri = (char *)uri}},
+        ROW_RANGE_URI);
+
+    verify_no_overlapping_ranges(row->extra);
+    verify_ranges_are_sorted(row->extra);
+}
+
+void
+grid_row_underline_range_put_span(struct row *row, int start, int end,
+                                  struct underline_range_data data)
+{
+    ensure_row_has_extra_data(row);
+
+    grid_row_range_put_span(
+        &row->extra->underline_ranges, start, end,
+        &(union row_range_data){.underline = data},
+        ROW_RANGE_UNDERLINE);
+
+    verify_no_overlapping_ranges(row->extra);
+    verify_ranges_are_sorted(row->extra);
+}
+
+UNITTEST
+{
+    struct row_data row_data = {.uri_ranges = {0}};
+    struct row row = {.extra = &row_data};
+
+#define verify_range(idx, _start, _end, _id)                     \
+    do {                                                         \
+        xassert(idx < row_data.uri_ranges.count);                \
+        xassert(row_data.uri_ranges.v[idx].start == _start);     \
+        xassert(row_data.uri_ranges.v[idx].end == _end);         \
+        xassert(row_data.uri_ranges.v[idx].uri.id == _id);       \
+    } while (0)
+
+    grid_row_uri_range_put_span(&row, 0, 9, "http://foo.bar", 123);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 0, 9, 123);
+
+    /* Extend tail */
+    grid_row_uri_range_put_span(&row, 10, 14, "http://foo.bar", 123);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 0, 14, 123);
+
+    /* Splice */
+    grid_row_uri_range_put_span(&row, 3, 5, "http://splice", 456);
+    xassert(row_data.uri_ranges.count == 3);
+    verify_range(0, 0, 2, 123);
+    verify_range(1, 3, 5, 456);
+    verify_range(2, 6, 14, 123);
+
+    /* Replace the splice, and merge with its neighbours */
+    grid_row_uri_range_put_span(&row, 3, 5, "http://foo.bar", 123);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 0, 14, 123);
+
+    /* Cover everything */
+    grid_row_uri_range_put_span(&row, 0, 20, "http://all", 789);
+    xassert(row_data.uri_ranges.count == 1);
+    verify_range(0, 0, 20, 789);
+
+    grid_row_ranges_destroy(&row_data.uri_ranges, ROW_RANGE_URI);
+    free(row_data.uri_ranges.v);
+
+#undef verify_range
+}
+
 void
 grid_row_uri_range_erase(struct row *row, int start, int end)
 {
@@ -1693,3 +2773,391 @@ UNITTEST
     grid_row_ranges_destroy(&row_data.uri_ranges, ROW_RANGE_URI);
     free(row_data.uri_ranges.v);
 }
+
+UNITTEST
+{
+    const int cols = 80;
+    struct row *row = grid_row_alloc(cols, true);
+
+    /* ASCII, a wide character (+ spacer), a combining character
+     * reference, and a couple of attribute runs */
+    const char32_t text[] = {
+        U'f', U'o', U'o', U' ', 0x4e2d, CELL_SPACER + 1,
+        CELL_COMB_CHARS_LO + 42, U'x',
+    };
+
+    for (size_t i = 0; i < ALEN(text); i++)
+        row->cells[i].wc = text[i];
+    for (int c = 0; c < 3; c++) {
+        row->cells[c].attrs.bold = true;
+        row->cells[c].attrs.fg = 0x123456;
+    }
+    row->cells[cols - 1].attrs.selected = true;
+
+    struct cell expected[cols];
+    memcpy(expected, row->cells, sizeof(expected));
+    for (int c = 0; c < cols; c++)
+        expected[c].attrs.clean = 0;
+
+    grid_row_compact(row, cols);
+    xassert(row->compact != NULL);
+    xassert(row->cells == NULL);
+    xassert(row->compact->text_cells == ALEN(text));
+
+    struct cell scratch[cols];
+    const struct cell *peeked = grid_row_peek_cells(row, scratch);
+    xassert(peeked == scratch);
+    xassert(memcmp(peeked, expected, sizeof(expected)) == 0);
+    xassert(row->compact != NULL);
+
+    struct grid grid = {0};
+    xassert(grid_row_uncompact(&grid, row) == row);
+    xassert(row->compact == NULL);
+    xassert(row->dirty);
+    xassert(grid.uncompact_gen == 1);
+    xassert(memcmp(row->cells, expected, sizeof(expected)) == 0);
+
+    /* Rows that don't compress well are left as is */
+    for (int c = 0; c < cols; c++) {
+        row->cells[c].wc = 0x10000 + c;
+        row->cells[c].attrs.fg = c;
+    }
+
+    struct cell *cells = row->cells;
+    grid_row_compact(row, cols);
+    xassert(row->compact == NULL);
+    xassert(row->cells == cells);
+
+    grid_row_free(row);
+}
+
+UNITTEST
+{
+    const int cols = 80;
+    const int new_cols = 40;
+
+    /* Text, followed by a trailing spacer, and colored, empty cells */
+    struct row *row = grid_row_alloc(cols, true);
+    const char32_t text[] = {U'l', U's', U' ', U'-', U'l', CELL_SPACER};
+    for (size_t i = 0; i < ALEN(text); i++)
+        row->cells[i].wc = text[i];
+    for (int c = 3; c < cols; c++)
+        row->cells[c].attrs.bg = 0x112233;
+
+    struct cell expected[new_cols];
+    memset(expected, 0, sizeof(expected));
+    for (int c = 0; c < 5; c++) {
+        expected[c] = row->cells[c];
+        expected[c].attrs.clean = 0;
+    }
+
+    grid_row_compact(row, cols);
+    xassert(row->compact != NULL);
+    xassert(row->compact->text_cells == 6);
+    xassert(row->compact->used_cells == 5);
+
+    /* Too narrow */
+    xassert(reflow_compact(row->compact, 4) == NULL);
+
+    /* Cells after the last non-empty one are erased */
+    struct row_compact *compact = reflow_compact(row->compact, new_cols);
+    xassert(compact != NULL);
+    xassert(compact != row->compact);
+    xassert(compact->cols == new_cols);
+
+    free(row->compact);
+    row->compact = compact;
+
+    struct cell cells[new_cols];
+    xassert(grid_row_peek_cells(row, cells) == cells);
+    xassert(memcmp(cells, expected, sizeof(expected)) == 0);
+
+    /* A line without anything to erase is re-used as-is */
+    xassert(reflow_compact(compact, 20) == compact);
+    xassert(compact->cols == 20);
+
+    struct cell narrow[20];
+    grid_row_peek_cells(row, narrow);
+    xassert(memcmp(narrow, expected, sizeof(narrow)) == 0);
+
+    grid_row_free(row);
+
+    /* Any mix of trailing empty cells and spacers is unused */
+    row = grid_row_alloc(cols, true);
+    const char32_t mixed[] = {U'a', U'b', CELL_SPACER, 0, CELL_SPACER};
+    for (size_t i = 0; i < ALEN(mixed); i++)
+        row->cells[i].wc = mixed[i];
+
+    grid_row_compact(row, cols);
+    xassert(row->compact != NULL);
+    xassert(row->compact->text_cells == 5);
+    xassert(row->compact->used_cells == 2);
+    grid_row_free(row);
+}
+
+UNITTEST
+{
+    /*
+     * Lines of 15 characters ("0000xxxxxxxxxxx", "0001xxxxxxxxxxx"
+     * etc), reflowed from 20 to 10 columns. Only the last lines are
+     * reflowed right away.
+     */
+    const int cols = 20;
+    const int new_cols = 10;
+    const int screen_rows = 10;
+    const int lines = 1500;
+
+    struct grid grid = {
+        .num_rows = 4096,
+        .num_cols = cols,
+        .offset = lines - screen_rows,
+        .view = lines - screen_rows,
+        .rows = xcalloc(4096, sizeof(grid.rows[0])),
+    };
+
+    for (int r = 0; r < lines; r++) {
+        struct row *row = grid_row_alloc(cols, true);
+        row->cells[0].wc = U'0' + r / 1000 % 10;
+        row->cells[1].wc = U'0' + r / 100 % 10;
+        row->cells[2].wc = U'0' + r / 10 % 10;
+        row->cells[3].wc = U'0' + r % 10;
+        for (int c = 4; c < 15; c++)
+            row->cells[c].wc = U'x';
+        row->linebreak = true;
+        grid_row_compact(row, cols);
+        grid.rows[r] = row;
+    }
+
+    grid.cur_row = grid.rows[grid.offset];
+
+    grid_resize_and_reflow(
+        &grid, grid.num_rows, new_cols, screen_rows, screen_rows,
+        0, (struct coord *[]){NULL});
+
+    xassert(grid.reflow_pending != NULL);
+    xassert(grid.reflow_pending->count >= REFLOW_CHUNK_ROWS);
+
+    int reflowed = 0;
+    for (int r = 0; r < grid.num_rows; r++)
+        reflowed += grid.rows[r] != NULL;
+    xassert(reflowed == (lines - grid.reflow_pending->count) * 2);
+
+    while (grid_reflow_pending_step(&grid))
+        ;
+
+    xassert(grid.reflow_pending == NULL);
+
+    const int sb_start = grid_sb_start_ignore_uninitialized(&grid, screen_rows);
+    for (int sb = 0; sb < lines * 2; sb++) {
+        const struct row *row = grid.rows[
+            grid_row_sb_to_abs_precalc_sb_start(&grid, sb_start, sb)];
+        xassert(row != NULL);
+
+        struct cell scratch[new_cols];
+        const struct cell *cells = grid_row_peek_cells(row, scratch);
+        const int line = sb / 2;
+
+        if (sb % 2 == 0) {
+            xassert(cells[0].wc == U'0' + line / 1000 % 10);
+            xassert(cells[1].wc == U'0' + line / 100 % 10);
+            xassert(cells[2].wc == U'0' + line / 10 % 10);
+            xassert(cells[3].wc == U'0' + line % 10);
+            xassert(cells[9].wc == U'x');
+            xassert(!row->linebreak);
+        } else {
+            xassert(cells[4].wc == U'x');
+            xassert(cells[5].wc == 0);
+            xassert(row->linebreak);
+        }
+    }
+
+    grid_free(&grid);
+}
+
+UNITTEST
+{
+    const int cols = 8;
+    const int screen_rows = 4;
+
+    struct grid grid = {
+        .num_rows = 16,
+        .num_cols = cols,
+        .offset = 10,
+        .view = 14,
+        .cursor = {.point = {.row = 1}},
+        .rows = xcalloc(16, sizeof(grid.rows[0])),
+    };
+
+    for (int r = 0; r < grid.num_rows; r++) {
+        grid.rows[r] = grid_row_alloc(cols, true);
+        grid.rows[r]->cells[0].wc = U'a' + r;
+    }
+
+    /* The view wraps around the end of the ring buffer */
+    struct grid *snapshot = grid_snapshot(&grid, screen_rows);
+    xassert(snapshot->num_rows == grid.num_rows);
+    xassert(snapshot->view == grid.view);
+
+    for (int r = 0; r < grid.num_rows; r++) {
+        const bool in_view = r >= 14 || r < 2;
+        const bool is_cursor_row = r == 11;
+
+        if (!in_view && !is_cursor_row) {
+            xassert(snapshot->rows[r] == NULL);
+            continue;
+        }
+
+        xassert(snapshot->rows[r] != NULL);
+        xassert(snapshot->rows[r] != grid.rows[r]);
+        xassert(snapshot->rows[r]->cells[0].wc == U'a' + r);
+    }
+
+    /* Scrolled back; the cursor's row is outside the view */
+    const struct row *cursor_row = grid_row(snapshot, snapshot->cursor.point.row);
+    xassert(cursor_row != NULL);
+    xassert(cursor_row->cells[0].wc == U'a' + 11);
+
+    grid_free(snapshot);
+    free(snapshot);
+    grid_free(&grid);
+}
+
+UNITTEST
+{
+    /* Expanding a row only marks its own grid for re-compaction */
+    const int cols = 80;
+    struct grid grids[2];
+
+    for (size_t i = 0; i < ALEN(grids); i++) {
+        grids[i] = (struct grid){
+            .num_rows = 4,
+            .num_cols = cols,
+            .rows = xcalloc(4, sizeof(grids[i].rows[0])),
+        };
+
+        for (int r = 0; r < grids[i].num_rows; r++) {
+            grids[i].rows[r] = grid_row_alloc(cols, true);
+            grids[i].rows[r]->cells[0].wc = U'a' + r;
+        }
+
+        /* Everything but the (single row) screen */
+        compact_scrollback(&grids[i], 1);
+        xassert(grids[i].rows[0]->compact == NULL);
+        xassert(grids[i].rows[2]->compact != NULL);
+    }
+
+    struct grid *a = &grids[0];
+    struct grid *b = &grids[1];
+
+    grid_row_uncompact(a, a->rows[2]);
+    grid_row_uncompact(b, b->rows[2]);
+    xassert(a->rows[2]->compact == NULL);
+    xassert(b->rows[2]->compact == NULL);
+
+    /* 'b' was expanded after 'a' was; 'a' must still be re-compacted */
+    grid_compact_scrollback(b, 1);
+    xassert(b->rows[2]->compact != NULL);
+    xassert(a->compacted_gen != a->uncompact_gen);
+
+    grid_compact_scrollback(a, 1);
+    xassert(a->rows[2]->compact != NULL);
+
+    /* Expanding a row in 'b' doesn't affect 'a' */
+    grid_row_uncompact(b, b->rows[3]);
+    xassert(a->compacted_gen == a->uncompact_gen);
+
+    for (size_t i = 0; i < ALEN(grids); i++)
+        grid_free(&grids[i]);
+}
+
+UNITTEST
+{
+    /* Rows scrolled out are compacted in a batch, except those in view */
+    const int cols = 80;
+    struct grid grid = {
+        .num_rows = 8,
+        .num_cols = cols,
+        .offset = 4,    /* Screen covers rows 4,5 */
+        .view = 1,      /* View covers rows 1,2 */
+        .rows = xcalloc(8, sizeof(grid.rows[0])),
+    };
+
+    for (int r = 0; r < grid.num_rows; r++)
+        grid.rows[r] = grid_row_alloc(cols, true);
+
+    grid.pending_compact = 3;   /* Rows 3,2,1 */
+    grid_compact_scrollback(&grid, 2);
+
+    xassert(grid.rows[3]->compact != NULL);
+    xassert(grid.rows[2]->compact == NULL);
+    xassert(grid.rows[1]->compact == NULL);
+    xassert(grid.rows[0]->compact == NULL);
+    xassert(grid.rows[4]->compact == NULL);
+    xassert(grid.pending_compact == 3);
+
+    /* Back at the bottom */
+    grid.view = grid.offset;
+    grid_compact_scrollback(&grid, 2);
+
+    xassert(grid.rows[2]->compact != NULL);
+    xassert(grid.rows[1]->compact != NULL);
+    xassert(grid.rows[0]->compact == NULL);
+    xassert(grid.rows[4]->compact == NULL);
+    xassert(grid.pending_compact == 0);
+
+    /* Never more than the scrollback */
+    grid.pending_compact = grid.num_rows;
+    grid_compact_scrollback(&grid, 2);
+
+    xassert(grid.rows[0]->compact != NULL);
+    xassert(grid.rows[4]->compact == NULL);
+    xassert(grid.rows[5]->compact == NULL);
+    xassert(grid.pending_compact == 0);
+
+    grid_free(&grid);
+}
+
+UNITTEST
+{
+    /* Copies of the rows [6, 1], wrapping around, in compact form */
+    const int cols = 80;
+    struct grid grid = {
+        .num_rows = 8,
+        .num_cols = cols,
+        .rows = xcalloc(8, sizeof(grid.rows[0])),
+    };
+
+    for (int r = 0; r < grid.num_rows; r++) {
+        grid.rows[r] = grid_row_alloc(cols, true);
+        grid.rows[r]->cells[0].wc = U'a' + r;
+        grid.rows[r]->linebreak = r % 2;
+    }
+
+    grid_row_compact(grid.rows[7], cols);
+
+    struct grid *snapshot = grid_snapshot_rows(&grid, 6, 1);
+
+    for (int r = 0; r < grid.num_rows; r++) {
+        const struct row *row = snapshot->rows[r];
+
+        if (r >= 2 && r <= 5) {
+            xassert(row == NULL);
+            continue;
+        }
+
+        struct cell scratch[cols];
+        const struct cell *cells = grid_row_peek_cells(row, scratch);
+
+        xassert(row->compact != NULL);
+        xassert(row->linebreak == grid.rows[r]->linebreak);
+        xassert(cells[0].wc == U'a' + r);
+        xassert(cells[1].wc == 0);
+    }
+
+    /* The source rows are left as they were */
+    xassert(grid.rows[6]->compact == NULL);
+
+    grid_free(snapshot);
+    free(snapshot);
+    grid_free(&grid);
+}
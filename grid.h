@@ -1,16 +1,61 @@
 #pragma once
 
+#include <limits.h>
 #include <stddef.h>
 #include "debug.h"
 #include "terminal.h"
 
-struct grid *grid_snapshot(const struct grid *grid);
+struct grid *grid_snapshot(const struct grid *grid, int screen_rows);
+struct grid *grid_snapshot_rows(const struct grid *grid, int start, int end);
 void grid_free(struct grid *grid);
 
 void grid_swap_row(struct grid *grid, int row_a, int row_b);
 struct row *grid_row_alloc(int cols, bool initialize);
 void grid_row_free(struct row *row);
 
+/*
+ * Compacted rows
+ *
+ * Rows in the scrollback are stored in a compact form; 'cells' is
+ * NULL, and 'compact' holds an encoded copy of the cells. A
+ * compacted row *must* be expanded, with grid_row_uncompact(),
+ * before its cells are accessed. Expanded rows are marked dirty.
+ *
+ * grid_row() and grid_row_in_view() do this automatically. Code
+ * accessing grid->rows[] directly must do it explicitly.
+ */
+void grid_row_compact(struct row *row, int cols);
+void _grid_row_uncompact(struct grid *grid, struct row *row);
+void _grid_row_discard_compact(struct row *row);
+
+/* Expands a compacted row of 'grid'. Returns the row (which may be NULL) */
+static inline struct row *
+grid_row_uncompact(struct grid *grid, struct row *row)
+{
+    if (row != NULL && unlikely(row->compact != NULL))
+        _grid_row_uncompact(grid, row);
+    return row;
+}
+
+/*
+ * Returns the row's cells, without expanding it. A compacted row is
+ * decoded into 'scratch', which must have room for all the row's
+ * cells. Useful when walking large parts of the scrollback.
+ */
+const struct cell *grid_row_peek_cells(
+    const struct row *row, struct cell *scratch);
+
+/*
+ * Compacts scrollback rows that have been scrolled out, or expanded
+ * (for example, by scrollback search), since the last time this was
+ * called. Rows in view are left alone.
+ */
+void grid_compact_scrollback(struct grid *grid, int screen_rows);
+
+/* Marks all composed character chains referenced by the grid's cells */
+void grid_mark_composed(
+    const struct grid *grid, const struct composed_table *composed);
+
 void grid_resize_without_reflow(
     struct grid *grid, int new_rows, int new_cols,
     int old_screen_rows, int new_screen_rows);
@@ -21,6 +66,21 @@ void grid_resize_and_reflow(
     size_t tracking_points_count,
     struct coord *const _tracking_points[static tracking_points_count]);
 
+/*
+ * A reflow only reflows the last part of a large scrollback right
+ * away; the older rows are reflowed afterwards, newest first.
+ *
+ * grid_reflow_pending_step() reflows the next chunk, and returns
+ * false when there is nothing left to reflow. Until then, the rows
+ * above the reflowed part are unallocated, like in a scrollback that
+ * isn't yet full. grid_reflow_pending_finish() reflows all of it, and
+ * must be called before moving the view into, or walking, the
+ * scrollback.
+ */
+bool grid_reflow_pending_step(struct grid *grid);
+void grid_reflow_pending_finish(struct grid *grid);
+void grid_reflow_pending_discard(struct grid *grid);
+
 /* Convert row numbers between scrollback-relative and absolute coordinates */
 int grid_row_abs_to_sb(const struct grid *grid, int screen_rows, int abs_row);
 int grid_row_sb_to_abs(const struct grid *grid, int screen_rows, int sb_rel_row);
@@ -57,6 +117,16 @@ _grid_row_maybe_alloc(struct grid *grid, int row_no, bool alloc_if_null)
     }
 
     xassert(row != NULL);
+
+    if (unlikely(row->compact != NULL)) {
+        /* grid_row_and_alloc() callers always erase the row; don't
+         * bother decoding its old content */
+        if (alloc_if_null)
+            _grid_row_discard_compact(row);
+        else
+            _grid_row_uncompact(grid, row);
+    }
+
     return row;
 }
 
@@ -81,15 +151,44 @@ grid_row_in_view(struct grid *grid, int row_no)
     struct row *row = grid->rows[real_row];
 
     xassert(row != NULL);
-    return row;
+    return grid_row_uncompact(grid, row);
+}
+
+/* Marks columns [start, end] (inclusive) of the row dirty */
+static inline void
+grid_row_dirty_range(struct row *row, int start, int end)
+{
+    row->search_text_stale = true;
+
+    if (!row->dirty) {
+        row->dirty = true;
+        row->dirty_start = start;
+        row->dirty_end = end;
+    } else {
+        if (start < row->dirty_start)
+            row->dirty_start = start;
+        if (end > row->dirty_end)
+            row->dirty_end = end;
+    }
+}
+
+/* Marks the whole row dirty */
+static inline void
+grid_row_dirty(struct row *row)
+{
+    grid_row_dirty_range(row, 0, INT_MAX);
 }
 
 void grid_row_uri_range_put(
     struct row *row, int col, const char *uri, uint64_t id);
+void grid_row_uri_range_put_span(
+    struct row *row, int start, int end, const char *uri, uint64_t id);
 void grid_row_uri_range_erase(struct row *row, int start, int end);
 
 void grid_row_underline_range_put(
     struct row *row, int col, struct underline_range_data data);
+void grid_row_underline_range_put_span(
+    struct row *row, int start, int end, struct underline_range_data data);
 void grid_row_underline_range_erase(struct row *row, int start, int end);
 
 static inline void
@@ -47,6 +47,9 @@ struct pipe_context {
     char *text;
     size_t idx;
     size_t left;
+
+    /* Source of more text, once 'text' has been written */
+    struct term_text_stream *stream;
 };
 
 static bool
@@ -58,6 +61,19 @@ fdm_write_pipe(struct fdm *fdm, int fd, int events, void *data)
         goto pipe_closed;
 
     xassert(events & EPOLLOUT);
+
+    while (ctx->left == 0) {
+        free(ctx->text);
+        ctx->text = NULL;
+        ctx->idx = 0;
+
+        if (ctx->stream == NULL ||
+            !term_text_stream_next(ctx->stream, &ctx->text, &ctx->left))
+        {
+            goto pipe_closed;
+        }
+    }
+
     ssize_t written = write(fd, &ctx->text[ctx->idx], ctx->left);
 
     if (written < 0) {
@@ -69,12 +85,13 @@ fdm_write_pipe(struct fdm *fdm, int fd, int events, void *data)
     ctx->idx += written;
     ctx->left -= written;
 
-    if (ctx->left == 0)
+    if (ctx->left == 0 && ctx->stream == NULL)
         goto pipe_closed;
 
     return true;
 
 pipe_closed:
+    term_text_stream_destroy(ctx->stream);
     free(ctx->text);
     free(ctx);
     fdm_del(fdm, fd);
@@ -240,6 +257,7 @@ execute_binding(struct seat *seat, struct terminal *term,
 
         char *text = NULL;
         size_t len = 0;
+        struct term_text_stream *stream = NULL;
 
         if (pipe(pipe_fd) < 0) {
             LOG_ERRNO("failed to create pipe");
@@ -257,7 +275,8 @@ execute_binding(struct seat *seat, struct terminal *term,
         bool success;
         switch (action) {
         case BIND_ACTION_PIPE_SCROLLBACK:
-            success = term_scrollback_to_text(term, &text, &len);
+            stream = term_scrollback_stream(term);
+            success = stream != NULL;
             break;
 
         case BIND_ACTION_PIPE_VIEW:
@@ -271,7 +290,8 @@ execute_binding(struct seat *seat, struct terminal *term,
             break;
 
         case BIND_ACTION_PIPE_COMMAND_OUTPUT:
-            success = term_command_output_to_text(term, &text, &len);
+            stream = term_command_output_stream(term);
+            success = stream != NULL;
             break;
 
         default:
@@ -317,6 +337,7 @@ execute_binding(struct seat *seat, struct terminal *term,
         *ctx = (struct pipe_context){
             .text = text,
             .left = len,
+            .stream = stream,
         };
 
         /* Asynchronously write the output to the pipe */
@@ -335,6 +356,7 @@ execute_binding(struct seat *seat, struct terminal *term,
         if (pipe_fd[1] >= 0)
             close(pipe_fd[1]);
         free(text);
+        term_text_stream_destroy(stream);
         free(ctx);
         return true;
     }
@@ -364,6 +386,8 @@ execute_binding(struct seat *seat, struct terminal *term,
         if (term->grid != &term->normal)
             return false;
 
+        term_reflow_pending_finish(term);
+
         struct grid *grid = term->grid;
         const int sb_start =
             grid_sb_start_ignore_uninitialized(grid, term->rows);
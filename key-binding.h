@@ -93,6 +93,7 @@ enum bind_action_search {
     BIND_ACTION_SEARCH_CLIPBOARD_PASTE,
     BIND_ACTION_SEARCH_PRIMARY_PASTE,
     BIND_ACTION_SEARCH_UNICODE_INPUT,
+    BIND_ACTION_SEARCH_TOGGLE_REGEX,
     BIND_ACTION_SEARCH_COUNT,
 };
 
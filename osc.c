@@ -11,6 +11,7 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 #include "base64.h"
+#include "clipboard-data.h"
 #include "config.h"
 #include "macros.h"
 #include "notify.h"
@@ -24,24 +25,24 @@
 #define UNHANDLED() LOG_DBG("unhandled: OSC: %.*s", (int)term->vt.osc.idx, term->vt.osc.data)
 
 static void
-osc_to_clipboard(struct terminal *term, const char *target,
-                 const char *base64_data)
+parse_clipboard_targets(const char *target, bool *to_clipboard,
+                        bool *to_primary)
 {
-    bool to_clipboard = false;
-    bool to_primary = false;
+    *to_clipboard = false;
+    *to_primary = false;
 
     if (target[0] == '\0')
-        to_clipboard = true;
+        *to_clipboard = true;
 
     for (const char *t = target; *t != '\0'; t++) {
         switch (*t) {
         case 'c':
-            to_clipboard = true;
+            *to_clipboard = true;
             break;
 
         case 's':
         case 'p':
-            to_primary = true;
+            *to_primary = true;
             break;
 
         default:
@@ -49,58 +50,87 @@ osc_to_clipboard(struct terminal *term, const char *target,
             break;
         }
     }
+}
 
-    /* Find a seat in which the terminal has focus */
-    struct seat *seat = NULL;
+static bool
+osc_copy_allowed(const struct terminal *term)
+{
+    return term->conf->security.osc52 == OSC52_ENABLED ||
+           term->conf->security.osc52 == OSC52_COPY_ENABLED;
+}
+
+/* Find a seat in which the terminal has focus */
+static struct seat *
+osc_clipboard_seat(struct terminal *term)
+{
     tll_foreach(term->wl->seats, it) {
-        if (it->item.kbd_focus == term) {
-            seat = &it->item;
-            break;
-        }
+        if (it->item.kbd_focus == term)
+            return &it->item;
     }
 
-    if (seat == NULL) {
-        LOG_WARN("OSC52: client tried to write to clipboard data while window was unfocused");
-        return;
-    }
+    LOG_WARN("OSC52: client tried to write to clipboard data while window was unfocused");
+    return NULL;
+}
+
+static void
+osc_set_clipboard(struct terminal *term, struct seat *seat,
+                  bool to_clipboard, bool to_primary,
+                  struct clipboard_data *data)
+{
+    /* Shared by the clipboard and primary selection */
+    if (to_clipboard)
+        data_to_clipboard(seat, term, data, seat->kbd.serial);
+    if (to_primary)
+        data_to_primary(seat, term, data, seat->kbd.serial);
+}
+
+static void
+osc_unset_clipboard(struct seat *seat, bool to_clipboard, bool to_primary)
+{
+    if (to_clipboard)
+        selection_clipboard_unset(seat);
+    if (to_primary)
+        selection_primary_unset(seat);
+}
+
+static void
+osc_to_clipboard(struct terminal *term, const char *target,
+                 const char *base64_data)
+{
+    bool to_clipboard, to_primary;
+    parse_clipboard_targets(target, &to_clipboard, &to_primary);
 
-    const bool copy_allowed = term->conf->security.osc52 == OSC52_ENABLED
-                              || term->conf->security.osc52 == OSC52_COPY_ENABLED;
+    struct seat *seat = osc_clipboard_seat(term);
+    if (seat == NULL)
+        return;
 
-    if (!copy_allowed) {
+    if (!osc_copy_allowed(term)) {
         LOG_DBG("ignoring copy request: disabled in configuration");
         return;
     }
 
-    char *decoded = base64_decode(base64_data, NULL);
+    size_t len;
+    char *decoded = base64_decode(base64_data, &len);
     if (decoded == NULL) {
         if (errno == EINVAL)
             LOG_WARN("OSC: invalid clipboard data: %s", base64_data);
         else
             LOG_ERRNO("base64_decode() failed");
 
-        if (to_clipboard)
-            selection_clipboard_unset(seat);
-        if (to_primary)
-            selection_primary_unset(seat);
+        osc_unset_clipboard(seat, to_clipboard, to_primary);
         return;
     }
 
     LOG_DBG("decoded: %s", decoded);
 
-    if (to_clipboard) {
-        char *copy = xstrdup(decoded);
-        if (!text_to_clipboard(seat, term, copy, seat->kbd.serial))
-            free(copy);
-    }
+    struct clipboard_data *data = clipboard_data_from_text(decoded, len);
+    free(decoded);
 
-    if (to_primary) {
-        char *copy = xstrdup(decoded);
-        if (!text_to_primary(seat, term, copy, seat->kbd.serial))
-            free(copy);
-    }
+    if (data == NULL)
+        return;
 
-    free(decoded);
+    osc_set_clipboard(term, seat, to_clipboard, to_primary, data);
+    clipboard_data_unref(data);
 }
 
 struct clip_context {
@@ -293,6 +323,124 @@ osc_selection(struct terminal *term, char *string)
         osc_to_clipboard(term, string, p);
 }
 
+/*
+ * Streaming OSC 52 (copy to clipboard). The base64 encoded payload is
+ * decoded as it arrives, directly into the clipboard data.
+ */
+struct osc52_stream {
+    struct osc_stream stream;
+
+    char *target;
+    bool to_clipboard;
+    bool to_primary;
+
+    size_t len;  /* Payload bytes received */
+    bool query;  /* Payload starts with '?' */
+
+    struct base64_decoder decoder;
+    struct clipboard_data *data;  /* NULL if copying isn't allowed */
+};
+
+static void
+osc52_stream_put(struct terminal *term, struct osc_stream *_stream,
+                 const uint8_t *buf, size_t len)
+{
+    struct osc52_stream *stream = (struct osc52_stream *)_stream;
+
+    if (stream->len == 0 && len > 0 && buf[0] == '?')
+        stream->query = true;
+    stream->len += len;
+
+    if (stream->data == NULL)
+        return;
+
+    while (len > 0) {
+        uint8_t decoded[3 * 1024];
+        const size_t count = min(len, sizeof(decoded) / 3 * 4);
+
+        const size_t decoded_len = base64_decode_partial(
+            &stream->decoder, (const char *)buf, count, decoded);
+
+        if (!clipboard_data_append(stream->data, decoded, decoded_len)) {
+            clipboard_data_unref(stream->data);
+            stream->data = NULL;
+            return;
+        }
+
+        buf += count;
+        len -= count;
+    }
+}
+
+static void
+osc52_stream_end(struct terminal *term, struct osc_stream *_stream)
+{
+    struct osc52_stream *stream = (struct osc52_stream *)_stream;
+
+    if (stream->query && stream->len == 1) {
+        osc_from_clipboard(term, stream->target);
+        return;
+    }
+
+    struct seat *seat = osc_clipboard_seat(term);
+    if (seat == NULL)
+        return;
+
+    if (!osc_copy_allowed(term)) {
+        LOG_DBG("ignoring copy request: disabled in configuration");
+        return;
+    }
+
+    if (stream->data == NULL)
+        return;
+
+    if (!base64_decode_complete(&stream->decoder)) {
+        LOG_WARN("OSC: invalid clipboard data (%zu bytes)", stream->len);
+        osc_unset_clipboard(seat, stream->to_clipboard, stream->to_primary);
+        return;
+    }
+
+    if (!clipboard_data_seal(stream->data))
+        return;
+
+    osc_set_clipboard(
+        term, seat, stream->to_clipboard, stream->to_primary, stream->data);
+}
+
+static void
+osc52_stream_destroy(struct osc_stream *_stream)
+{
+    struct osc52_stream *stream = (struct osc52_stream *)_stream;
+    clipboard_data_unref(stream->data);
+    free(stream->target);
+    free(stream);
+}
+
+static struct osc_stream *
+osc52_stream_begin(struct terminal *term, const char *args)
+{
+    /* The payload is preceded by a single parameter; the targets */
+    if (strchr(args, ';') != NULL)
+        return NULL;
+
+    struct osc52_stream *stream = xmalloc(sizeof(*stream));
+    *stream = (struct osc52_stream){
+        .stream = {
+            .put = &osc52_stream_put,
+            .end = &osc52_stream_end,
+            .destroy = &osc52_stream_destroy,
+        },
+        .target = xstrdup(args),
+        .data = osc_copy_allowed(term) ? clipboard_data_new() : NULL,
+    };
+
+    parse_clipboard_targets(
+        stream->target, &stream->to_clipboard, &stream->to_primary);
+
+    LOG_DBG("clipboard: target = %s (streaming)", stream->target);
+    return &stream->stream;
+}
+
 static void
 osc_flash(struct terminal *term)
 {
@@ -1548,6 +1696,92 @@ osc_dispatch(struct terminal *term)
     }
 }
 
+/* OSCs that are handled as they arrive, instead of at the terminator */
+static const struct {
+    unsigned param;
+    struct osc_stream *(*begin)(struct terminal *term, const char *args);
+} stream_handlers[] = {
+    {52, &osc52_stream_begin},
+};
+
+void
+osc_stream_begin(struct terminal *term)
+{
+    struct vt *vt = &term->vt;
+
+    xassert(vt->osc.stream == NULL);
+    xassert(vt->osc.idx > 0);
+    xassert(vt->osc.data[vt->osc.idx - 1] == ';');
+
+    unsigned param = 0;
+    size_t i = 0;
+
+    for (; i < vt->osc.idx; i++) {
+        const uint8_t c = vt->osc.data[i];
+        if (c == ';')
+            break;
+        if (!isdigit(c))
+            return;
+
+        param *= 10;
+        param += c - '0';
+    }
+
+    /* Only the parameter so far; wait for its arguments */
+    if (i == 0 || i == vt->osc.idx - 1)
+        return;
+
+    for (size_t j = 0; j < ALEN(stream_handlers); j++) {
+        if (stream_handlers[j].param != param)
+            continue;
+
+        /* Arguments, without the trailing ';' */
+        vt->osc.data[vt->osc.idx - 1] = '\0';
+        struct osc_stream *stream = stream_handlers[j].begin(
+            term, (const char *)&vt->osc.data[i + 1]);
+        vt->osc.data[vt->osc.idx - 1] = ';';
+
+        if (stream != NULL) {
+            /* Handler has consumed everything up to here */
+            vt->osc.stream = stream;
+            vt->osc.idx = 0;
+        }
+        return;
+    }
+}
+
+void
+osc_stream_put(struct terminal *term)
+{
+    struct vt *vt = &term->vt;
+    struct osc_stream *stream = vt->osc.stream;
+
+    xassert(stream != NULL);
+    stream->put(term, stream, vt->osc.data, vt->osc.idx);
+    vt->osc.idx = 0;
+}
+
+void
+osc_stream_end(struct terminal *term)
+{
+    struct osc_stream *stream = term->vt.osc.stream;
+
+    osc_stream_put(term);
+    stream->end(term, stream);
+    osc_stream_destroy(term);
+}
+
+void
+osc_stream_destroy(struct terminal *term)
+{
+    struct osc_stream *stream = term->vt.osc.stream;
+    if (stream == NULL)
+        return;
+
+    stream->destroy(stream);
+    term->vt.osc.stream = NULL;
+}
+
 bool
 osc_ensure_size(struct terminal *term, size_t required_size)
 {
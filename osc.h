@@ -5,3 +5,34 @@
 
 bool osc_ensure_size(struct terminal *term, size_t required_size);
 void osc_dispatch(struct terminal *term);
+
+/*
+ * Streaming OSC handlers.
+ *
+ * Some OSCs (e.g. OSC 52) may carry large payloads. Instead of
+ * buffering the entire string, and dispatching it at the terminator,
+ * the VT parser calls osc_stream_begin() for each ';' in the first
+ * OSC_STREAM_PREFIX_MAX bytes. If a streaming handler claims the
+ * OSC, it consumes everything received so far, and vt.osc.stream is
+ * set. The VT parser then calls osc_stream_put() whenever
+ * OSC_STREAM_CHUNK_SIZE bytes have been buffered, and
+ * osc_stream_end() (instead of osc_dispatch()) at the terminator.
+ */
+#define OSC_STREAM_PREFIX_MAX 64
+#define OSC_STREAM_CHUNK_SIZE (64 * 1024)
+
+struct osc_stream {
+    /* Consumes a chunk of the OSC string */
+    void (*put)(struct terminal *term, struct osc_stream *stream,
+                const uint8_t *data, size_t len);
+
+    /* The OSC has been terminated */
+    void (*end)(struct terminal *term, struct osc_stream *stream);
+
+    void (*destroy)(struct osc_stream *stream);
+};
+
+void osc_stream_begin(struct terminal *term);
+void osc_stream_put(struct terminal *term);
+void osc_stream_end(struct terminal *term);
+void osc_stream_destroy(struct terminal *term);
@@ -11,8 +11,14 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 
+#if defined(FOOT_BENCH)
+ #include <getopt.h>
+ #include <time.h>
+#endif
+
 #include "async.h"
 #include "config.h"
+#include "grid.h"
 #include "key-binding.h"
 #include "reaper.h"
 #include "sixel.h"
@@ -24,11 +30,58 @@ extern bool fdm_ptmx(struct fdm *fdm, int fd, int events, void *data);
 static void
 usage(const char *prog_name)
 {
+#if defined(FOOT_BENCH)
+    printf(
+        "Usage: %s [OPTIONS...] stimuli-file1 stimuli-file2 ... stimuli-fileN\n"
+        "\n"
+        "Replays each stimuli file through the VT parser, and reports its\n"
+        "throughput. Each file is reported as a separate category, named\n"
+        "after the file.\n"
+        "\n"
+        "Options:\n"
+        "  -i,--iterations=COUNT     number of times to replay each file (10)\n"
+        "  -h,--help                 show this help and exit\n",
+        prog_name);
+#else
     printf(
         "Usage: %s stimuli-file1 stimuli-file2 ... stimuli-fileN\n",
         prog_name);
+#endif
+}
+
+#if defined(FOOT_BENCH_COUNT_ALLOCS)
+/*
+ * Linked with --wrap=malloc etc, to count the number of allocations
+ * done by the VT parser and the grid
+ */
+static size_t alloc_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
 }
 
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+#endif
+
 enum async_write_status
 async_write(int fd, const void *data, size_t len, size_t *idx)
 {
@@ -121,11 +174,9 @@ slave_spawn(
     return 0;
 }
 
-int
-render_worker_thread(void *_ctx)
-{
-    return 0;
-}
+bool render_workers_init(struct terminal *term) { return true; }
+void render_workers_destroy(struct terminal *term) {}
+void render_tile_caches_flush(struct terminal *term) {}
 
 struct extraction_context *
 extract_begin(enum selection_kind kind, bool strip_trailing_empty)
@@ -141,12 +192,28 @@ extract_one(
     return true;
 }
 
+bool
+extract_cells(
+    const struct terminal *term, const struct row *row,
+    const struct cell *cells, int col_start, int col_end, void *context)
+{
+    return true;
+}
+
 bool
 extract_finish(struct extraction_context *context, char **text, size_t *len)
 {
     return true;
 }
 
+bool
+extract_drain(struct extraction_context *context, char **text, size_t *len)
+{
+    return true;
+}
+
+void extract_abort(struct extraction_context *context) {}
+
 void cmd_scrollback_up(struct terminal *term, int rows) {}
 void cmd_scrollback_down(struct terminal *term, int rows) {}
 
@@ -242,10 +309,123 @@ key_binding_unref(struct key_binding_manager *mgr, const struct config *conf)
 {
 }
 
+static bool
+feed(struct terminal *term, int mem_fd, off_t size)
+{
+    lseek(mem_fd, 0, SEEK_SET);
+
+    while (lseek(mem_fd, 0, SEEK_CUR) < size) {
+        if (!fdm_ptmx(NULL, -1, EPOLLIN, term)) {
+            fprintf(stderr, "error: fdm_ptmx() failed\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#if defined(FOOT_BENCH)
+static bool
+bench(struct terminal *term, const char *path, int mem_fd, off_t size,
+      int iterations)
+{
+    double total = 0.;
+    double best = 0.;
+#if defined(FOOT_BENCH_COUNT_ALLOCS)
+    size_t allocs = 0;
+#endif
+
+    for (int i = 0; i < iterations; i++) {
+#if defined(FOOT_BENCH_COUNT_ALLOCS)
+        const size_t allocs_before = alloc_count;
+#endif
+
+        struct timespec start, stop;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if (!feed(term, mem_fd, size))
+            return false;
+
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+
+#if defined(FOOT_BENCH_COUNT_ALLOCS)
+        allocs += alloc_count - allocs_before;
+#endif
+
+        const double secs =
+            (stop.tv_sec - start.tv_sec) +
+            (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+        total += secs;
+        if (i == 0 || secs < best)
+            best = secs;
+    }
+
+    /* Category is the file's basename, without extension */
+    const char *name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+    const char *ext = strrchr(name, '.');
+    const int name_len = ext != NULL && ext != name
+        ? (int)(ext - name) : (int)strlen(name);
+
+    const double mean = total / iterations;
+
+    printf("%-20.*s %10lld %10.1f %10.1f %10.3f",
+           name_len, name, (long long)size,
+           size / best / 1e6, size / mean / 1e6,
+           best * 1e9 / size);
+
+#if defined(FOOT_BENCH_COUNT_ALLOCS)
+    printf(" %12zu\n", allocs / iterations);
+#else
+    printf(" %12s\n", "n/a");
+#endif
+
+    return true;
+}
+#endif
+
 int
-main(int argc, const char *const *argv)
+main(int argc, char *const *argv)
 {
-    if (argc < 2) {
+#if defined(FOOT_BENCH)
+    static const struct option longopts[] = {
+        {"iterations", required_argument, NULL, 'i'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL,         no_argument,       NULL,   0},
+    };
+
+    int iterations = 10;
+
+    while (true) {
+        int c = getopt_long(argc, argv, "+i:h", longopts, NULL);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'i':
+            iterations = atoi(optarg);
+            if (iterations <= 0) {
+                fprintf(stderr, "error: %s: invalid iteration count\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+
+        case '?':
+            return EXIT_FAILURE;
+        }
+    }
+
+    const int first_file = optind;
+#else
+    const int first_file = 1;
+#endif
+
+    if (argc <= first_file) {
         usage(argv[0]);
         return EXIT_FAILURE;
     }
@@ -268,10 +448,8 @@ main(int argc, const char *const *argv)
     struct row **alt_rows = calloc(grid_row_count, sizeof(alt_rows[0]));
 
     for (int i = 0; i < grid_row_count; i++) {
-        normal_rows[i] = calloc(1, sizeof(*normal_rows[i]));
-        normal_rows[i]->cells = calloc(col_count, sizeof(normal_rows[i]->cells[0]));
-        alt_rows[i] = calloc(1, sizeof(*alt_rows[i]));
-        alt_rows[i]->cells = calloc(col_count, sizeof(alt_rows[i]->cells[0]));
+        normal_rows[i] = grid_row_alloc(col_count, true);
+        alt_rows[i] = grid_row_alloc(col_count, true);
     }
 
     struct config conf = {
@@ -331,11 +509,17 @@ main(int argc, const char *const *argv)
         },
     };
 
+    term_update_ascii_printer(&term);
     tll_push_back(wayl.terms, &term);
 
     int ret = EXIT_FAILURE;
 
-    for (int i = 1; i < argc; i++) {
+#if defined(FOOT_BENCH)
+    printf("%-20s %10s %10s %10s %10s %12s\n",
+           "category", "bytes", "MB/s", "MB/s-mean", "ns/byte", "allocs");
+#endif
+
+    for (int i = first_file; i < argc; i++) {
         struct stat st;
         if (stat(argv[i], &st) < 0) {
             fprintf(stderr, "error: %s: failed to stat: %s\n",
@@ -350,7 +534,7 @@ main(int argc, const char *const *argv)
             goto out;
         }
 
-        int fd = open(argv[1], O_RDONLY);
+        int fd = open(argv[i], O_RDONLY);
         if (fd < 0) {
             fprintf(stderr, "error: %s: failed to open: %s\n",
                     argv[i], strerror(errno));
@@ -390,18 +574,21 @@ main(int argc, const char *const *argv)
         free(data);
 
         term.ptmx = mem_fd;
-        lseek(mem_fd, 0, SEEK_SET);
 
+#if defined(FOOT_BENCH)
+        if (!bench(&term, argv[i], mem_fd, st.st_size, iterations)) {
+            close(mem_fd);
+            goto out;
+        }
+#else
         printf("Feeding VT parser with %s (%lld bytes)\n",
                argv[i], (long long)st.st_size);
 
-        while (lseek(mem_fd, 0, SEEK_CUR) < st.st_size) {
-            if (!fdm_ptmx(NULL, -1, EPOLLIN, &term)) {
-                fprintf(stderr, "error: fdm_ptmx() failed\n");
-                close(mem_fd);
-                goto out;
-            }
+        if (!feed(&term, mem_fd, st.st_size)) {
+            close(mem_fd);
+            goto out;
         }
+#endif
         close(mem_fd);
     }
 
@@ -411,13 +598,8 @@ out:
     tll_free(wayl.terms);
 
     for (int i = 0; i < grid_row_count; i++) {
-        if (normal_rows[i] != NULL)
-            free(normal_rows[i]->cells);
-        free(normal_rows[i]);
-
-        if (alt_rows[i] != NULL)
-            free(alt_rows[i]->cells);
-        free(alt_rows[i]);
+        grid_row_free(normal_rows[i]);
+        grid_row_free(alt_rows[i]);
     }
 
     free(normal_rows);
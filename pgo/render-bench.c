@@ -0,0 +1,456 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <fcft/fcft.h>
+
+#define LOG_MODULE "render-bench"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "config.h"
+#include "grid.h"
+#include "render.h"
+#include "shm.h"
+#include "sixel.h"
+#include "terminal.h"
+#include "user-notification.h"
+#include "util.h"
+#include "vt.h"
+#include "xmalloc.h"
+
+/*
+ * Headless render benchmark.
+ *
+ * Instantiates a terminal without a Wayland connection, fills its
+ * grid with (pseudo random) colored text, and then times rendering
+ * of the grid to memfd backed buffers, using the same code path as
+ * the real renderer, minus the surface commit.
+ */
+
+enum frame_type {
+    FRAME_FULL,
+    FRAME_SINGLE_ROW,
+    FRAME_SCROLL,
+    FRAME_COUNT,
+};
+
+static const char *const frame_type_names[FRAME_COUNT] = {
+    [FRAME_FULL] = "full",
+    [FRAME_SINGLE_ROW] = "single-row",
+    [FRAME_SCROLL] = "scroll",
+};
+
+static void
+usage(const char *prog_name)
+{
+    printf(
+        "Usage: %s [OPTIONS...]\n"
+        "\n"
+        "Renders a grid filled with colored text to an off-screen buffer,\n"
+        "and reports the number of frames per second, and the time spent\n"
+        "per rendered row, for full, single row and scroll damage frames.\n"
+        "\n"
+        "Options:\n"
+        "  -c,--config=PATH          load configuration from PATH (defaults only)\n"
+        "  -f,--frames=COUNT         number of frames, per damage type (100)\n"
+        "  -s,--size=WIDTHxHEIGHT    buffer size, in pixels (1920x1080)\n"
+        "  -w,--workers=LIST         comma separated list of render worker\n"
+        "                            counts to benchmark (1,2,4,8)\n"
+        "  -h,--help                 show this help and exit\n",
+        prog_name);
+}
+
+static uint32_t rand_state = 1;
+
+static uint32_t
+next_rand(void)
+{
+    /* xorshift32; we want the same content on every run */
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+/* Emits a line of source-code looking text, with syntax highlighting */
+static void
+write_line(struct terminal *term, int cols)
+{
+    static const char *const words[] = {
+        "struct", "return", "const", "static", "terminal", "render",
+        "buffer", "row", "cell", "grid", "if", "for", "while", "NULL",
+        "xassert", "pixman_image_t", "int", "size_t", "bool", "damage",
+    };
+    static const struct {
+        const char *text;
+        int width;
+    } extra[] = {
+        {"漢字", 4}, {"│", 1}, {"├──", 3}, {"└─", 2}, {"═══", 3},
+        {"ä", 1}, {"é", 1}, {"€", 1}, {"→", 1}, {"…", 1},
+    };
+
+    char line[4096];
+    size_t len = 0;
+    int width = 0;
+
+    int indent = (next_rand() % 6) * 4;
+    memset(line, ' ', indent);
+    len += indent;
+    width += indent;
+
+    const int target = next_rand() % (cols - 1);
+
+    while (width < target && len < sizeof(line) - 64) {
+        const char *text;
+        int text_width;
+
+        if (next_rand() % 16 == 0) {
+            size_t idx = next_rand() % ALEN(extra);
+            text = extra[idx].text;
+            text_width = extra[idx].width;
+        } else {
+            text = words[next_rand() % ALEN(words)];
+            text_width = strlen(text);
+        }
+
+        if (width + text_width + 1 > cols)
+            break;
+
+        switch (next_rand() % 8) {
+        case 0: len += sprintf(&line[len], "\033[1;34m"); break;
+        case 1: len += sprintf(&line[len], "\033[38;5;%um", next_rand() % 256); break;
+        case 2: len += sprintf(&line[len], "\033[38:2::%u:%u:%um",
+                               next_rand() % 256, next_rand() % 256,
+                               next_rand() % 256); break;
+        case 3: len += sprintf(&line[len], "\033[3;2m"); break;
+        case 4: len += sprintf(&line[len], "\033[4;32m"); break;
+        case 5: len += sprintf(&line[len], "\033[7m"); break;
+        default: break;
+        }
+
+        len += sprintf(&line[len], "%s\033[m ", text);
+        width += text_width + 1;
+    }
+
+    vt_from_slave(term, (const uint8_t *)"\r\n", 2);
+    vt_from_slave(term, (const uint8_t *)line, len);
+}
+
+static struct fcft_font *
+load_font(const struct config *conf, const char *attrs)
+{
+    const struct config_font_list *list = &conf->fonts[0];
+    const char *names[list->count];
+
+    for (size_t i = 0; i < list->count; i++)
+        names[i] = list->arr[i].pattern;
+
+    struct fcft_font *font = fcft_from_name(list->count, names, attrs);
+    if (font == NULL)
+        LOG_ERR("failed to load font: %s (%s)", names[0], attrs);
+    return font;
+}
+
+static double
+frame(struct terminal *term, struct buffer_chain *chain)
+{
+    struct buffer *buf = shm_get_buffer(chain, term->width, term->height, false);
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    render_grid_to_buffer(term, buf, &damage);
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    pixman_region32_fini(&damage);
+
+    /* Never attached to a surface; release it immediately */
+    shm_did_not_use_buf(buf);
+
+    return (stop.tv_sec - start.tv_sec) +
+           (stop.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static bool
+bench(struct terminal *term, int worker_count, int frame_count)
+{
+    term->render.workers.count = worker_count;
+
+    if (!render_workers_init(term)) {
+        render_workers_destroy(term);
+        return false;
+    }
+
+    struct buffer_chain *chain = shm_chain_new(NULL, true, 1 + worker_count);
+
+    /* Warm up; instantiates the buffer, and rasterizes glyphs */
+    term_damage_view(term);
+    frame(term, chain);
+
+    for (enum frame_type type = 0; type < FRAME_COUNT; type++) {
+        double total = 0.;
+        size_t rows = 0;
+
+        for (int i = 0; i < frame_count; i++) {
+            switch (type) {
+            case FRAME_FULL:
+                term_damage_view(term);
+                rows += term->rows;
+                break;
+
+            case FRAME_SINGLE_ROW: {
+                int r = i % term->rows;
+                term_damage_rows_in_view(term, r, r);
+                rows++;
+                break;
+            }
+
+            case FRAME_SCROLL:
+                write_line(term, term->cols);
+                rows++;
+                break;
+
+            case FRAME_COUNT:
+                BUG("invalid frame type");
+                break;
+            }
+
+            total += frame(term, chain);
+        }
+
+        printf("%7d %-12s %8d %12.1f %12.3f\n",
+               worker_count, frame_type_names[type], frame_count,
+               frame_count / total, total * 1e6 / rows);
+    }
+
+    shm_chain_free(chain);
+    render_workers_destroy(term);
+    return true;
+}
+
+int
+main(int argc, char *const *argv)
+{
+    static const struct option longopts[] = {
+        {"config",  required_argument, NULL, 'c'},
+        {"frames",  required_argument, NULL, 'f'},
+        {"size",    required_argument, NULL, 's'},
+        {"workers", required_argument, NULL, 'w'},
+        {"help",    no_argument,       NULL, 'h'},
+        {NULL,      no_argument,       NULL,   0},
+    };
+
+    const char *conf_path = "/dev/null";
+    const char *workers = "1,2,4,8";
+    int frame_count = 100;
+    int width = 1920;
+    int height = 1080;
+
+    while (true) {
+        int c = getopt_long(argc, argv, "c:f:s:w:h", longopts, NULL);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'c':
+            conf_path = optarg;
+            break;
+
+        case 'f':
+            frame_count = atoi(optarg);
+            if (frame_count <= 0) {
+                fprintf(stderr, "error: %s: invalid frame count\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 's':
+            if (sscanf(optarg, "%dx%d", &width, &height) != 2 ||
+                width <= 0 || height <= 0)
+            {
+                fprintf(stderr, "error: %s: invalid size\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'w':
+            workers = optarg;
+            break;
+
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+
+        case '?':
+            return EXIT_FAILURE;
+        }
+    }
+
+    setlocale(LC_CTYPE, "");
+    log_init(LOG_COLORIZE_AUTO, false, LOG_FACILITY_USER, LOG_CLASS_WARNING);
+    fcft_init(FCFT_LOG_COLORIZE_AUTO, false, FCFT_LOG_CLASS_WARNING);
+
+    int ret = EXIT_FAILURE;
+
+    struct config conf = {0};
+    user_notifications_t user_notifications = tll_init();
+    config_override_t overrides = tll_init();
+
+    if (!config_load(&conf, conf_path, &user_notifications, &overrides,
+                     true, false))
+    {
+        goto out;
+    }
+
+    fcft_set_scaling_filter(conf.tweak.fcft_filter);
+    shm_set_max_pool_size(conf.tweak.max_shm_pool_size);
+
+    struct wl_window win = {0};
+    struct terminal term = {
+        .conf = &conf,
+        .window = &win,
+        .grid = &term.normal,
+        .scale = 1.,
+        .font_dpi = 96.,
+        .font_line_height = {.px = -1},
+        .font_subpixel = conf.colors.alpha == 0xffff
+            ? FCFT_SUBPIXEL_DEFAULT : FCFT_SUBPIXEL_NONE,
+        .kbd_focus = true,
+        .cursor_style = conf.cursor.style,
+        .colors = {
+            .fg = conf.colors.fg,
+            .bg = conf.colors.bg,
+            .alpha = conf.colors.alpha,
+            .cursor_fg = conf.cursor.color.text,
+            .cursor_bg = conf.cursor.color.cursor,
+            .selection_fg = conf.colors.selection_fg,
+            .selection_bg = conf.colors.selection_bg,
+            .use_custom_selection = conf.colors.use_custom.selection,
+        },
+        .blink = {.fd = -1},
+        .selection = {
+            .coords = {
+                .start = {-1, -1},
+                .end = {-1, -1},
+            },
+        },
+        .normal = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
+        .alt = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
+        .tab_stops = tll_init(),
+        .sixel = {
+            .palette_size = SIXEL_MAX_COLORS,
+            .max_width = SIXEL_MAX_WIDTH,
+            .max_height = SIXEL_MAX_HEIGHT,
+        },
+    };
+    memcpy(term.colors.table, conf.colors.table, sizeof(term.colors.table));
+
+    static const char *const font_attrs[4] = {
+        "dpi=96", "dpi=96:weight=bold", "dpi=96:slant=italic",
+        "dpi=96:weight=bold:slant=italic",
+    };
+
+    for (size_t i = 0; i < ALEN(term.fonts); i++) {
+        if ((term.fonts[i] = load_font(&conf, font_attrs[i])) == NULL)
+            goto out_fonts;
+    }
+
+    const struct fcft_glyph *M = fcft_rasterize_char_utf32(
+        term.fonts[0], U'M', term.font_subpixel);
+
+    term.cell_width = M != NULL ? M->advance.x : term.fonts[0]->max_advance.x;
+    term.cell_height = max(term.fonts[0]->height,
+                           term.fonts[0]->ascent + term.fonts[0]->descent);
+    term.font_baseline = term_font_baseline(&term);
+
+    term.width = width;
+    term.height = height;
+    term.cols = width / term.cell_width;
+    term.rows = height / term.cell_height;
+    term.margins.left = 0;
+    term.margins.top = 0;
+    term.margins.right = width - term.cols * term.cell_width;
+    term.margins.bottom = height - term.rows * term.cell_height;
+    term.scroll_region.start = 0;
+    term.scroll_region.end = term.rows;
+
+    if (term.cols <= 1 || term.rows <= 1) {
+        LOG_ERR("%dx%d: window too small for the configured font", width, height);
+        goto out_fonts;
+    }
+
+    int grid_rows = 1;
+    while (grid_rows < term.rows + 1000)
+        grid_rows *= 2;
+
+    struct grid *grids[] = {&term.normal, &term.alt};
+    for (size_t i = 0; i < ALEN(grids); i++) {
+        struct grid *grid = grids[i];
+        grid->num_rows = grid_rows;
+        grid->num_cols = term.cols;
+        grid->rows = xcalloc(grid_rows, sizeof(grid->rows[0]));
+        for (int r = 0; r < grid_rows; r++)
+            grid->rows[r] = grid_row_alloc(term.cols, true);
+        grid->cur_row = grid->rows[0];
+    }
+
+    term_update_ascii_printer(&term);
+
+    LOG_INFO("%dx%d pixels, %dx%d cells", width, height, term.cols, term.rows);
+
+    /* Fill the screen, and some of the scrollback */
+    for (int i = 0; i < 2 * term.rows; i++)
+        write_line(&term, term.cols);
+
+    printf("%7s %-12s %8s %12s %12s\n",
+           "workers", "damage", "frames", "frames/s", "us/row");
+
+    ret = EXIT_SUCCESS;
+
+    for (const char *w = workers; *w != '\0'; ) {
+        char *end;
+        long count = strtol(w, &end, 10);
+
+        if (end == w || count < 0 || count > 256 || (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "error: %s: invalid worker count list\n", workers);
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        if (!bench(&term, count, frame_count)) {
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        w = *end == ',' ? end + 1 : end;
+    }
+
+    for (size_t i = 0; i < ALEN(grids); i++) {
+        struct grid *grid = grids[i];
+        for (int r = 0; r < grid->num_rows; r++)
+            grid_row_free(grid->rows[r]);
+        free(grid->rows);
+        tll_free(grid->scroll_damage);
+    }
+
+    composed_free(&term.composed);
+
+out_fonts:
+    for (size_t i = 0; i < ALEN(term.fonts); i++)
+        fcft_destroy(term.fonts[i]);
+
+out:
+    config_free(&conf);
+    tll_free(overrides);
+    user_notifications_free(&user_notifications);
+    fcft_fini();
+    log_deinit();
+    return ret;
+}
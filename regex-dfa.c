@@ -0,0 +1,952 @@
+#include "regex-dfa.h"
+
+#include <regex.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "regex-dfa"
+#define LOG_ENABLE_DBG 0
+#include "log.h"
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+
+/*
+ * The expression is parsed to a tree, compiled to a Thompson NFA, and
+ * then converted to a DFA, one state at a time, as the DFA is run
+ * (subset construction). DFA states are cached; when the cache is
+ * full, it is flushed. If that happens too often, the DFA gives up,
+ * and reports every line as a possible match.
+ *
+ * Input symbols are bytes, plus a virtual one, marking the end of the
+ * line. '^' and '$' are zero-width assertions; '^' holds in the
+ * initial state, and '$' on the end-of-line symbol. A match may start
+ * anywhere, so the NFA's start state is added to every DFA state.
+ *
+ * Multi-byte characters are matched by '.', bracket expressions etc
+ * as a lead byte, followed by any number of continuation bytes.
+ */
+
+#define SYM_EOL 256
+#define SYM_COUNT 257
+
+#define MAX_NFA_STATES 4096
+#define MAX_DFA_STATES 256
+#define MAX_FLUSHES 16
+#define MAX_DEPTH 64
+#define MAX_REPEAT 255
+
+struct symset {
+    uint64_t bits[(SYM_COUNT + 63) / 64];
+};
+
+static inline void
+symset_add(struct symset *set, int sym)
+{
+    set->bits[sym / 64] |= 1ull << (sym % 64);
+}
+
+static inline void
+symset_add_range(struct symset *set, int first, int last)
+{
+    for (int sym = first; sym <= last; sym++)
+        symset_add(set, sym);
+}
+
+static inline bool
+symset_has(const struct symset *set, int sym)
+{
+    return (set->bits[sym / 64] >> (sym % 64)) & 1;
+}
+
+/*
+ * Parse tree
+ */
+
+enum node_type {
+    NODE_EMPTY,
+    NODE_SET,
+    NODE_CAT,
+    NODE_ALT,
+    NODE_STAR,
+    NODE_PLUS,
+    NODE_QUEST,
+    NODE_REPEAT,
+    NODE_BOL,
+    NODE_EOL,
+};
+
+struct node {
+    enum node_type type;
+    struct node *left;
+    struct node *right;
+    int min;   /* NODE_REPEAT */
+    int max;   /* NODE_REPEAT, -1 if unbounded */
+    struct symset set;
+};
+
+struct parser {
+    const char *p;
+    bool icase;
+    int depth;
+};
+
+static struct node *
+node_new(enum node_type type, struct node *left, struct node *right)
+{
+    struct node *node = xcalloc(1, sizeof(*node));
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+static void
+node_free(struct node *node)
+{
+    if (node == NULL)
+        return;
+
+    node_free(node->left);
+    node_free(node->right);
+    free(node);
+}
+
+static struct node *
+node_set(const struct symset *set)
+{
+    struct node *node = node_new(NODE_SET, NULL, NULL);
+    node->set = *set;
+    return node;
+}
+
+/* Any non-ASCII character */
+static struct node *
+node_non_ascii(void)
+{
+    struct symset lead = {0};
+    struct symset cont = {0};
+    symset_add_range(&lead, 0xc0, 0xff);
+    symset_add_range(&cont, 0x80, 0xbf);
+
+    return node_new(
+        NODE_CAT, node_set(&lead), node_new(NODE_STAR, node_set(&cont), NULL));
+}
+
+/*
+ * A set of ASCII characters, optionally along with all non-ASCII
+ * characters.
+ */
+static struct node *
+node_chars(const struct symset *set, bool non_ascii)
+{
+    struct node *node = node_set(set);
+    return non_ascii ? node_new(NODE_ALT, node, node_non_ascii()) : node;
+}
+
+static inline bool
+is_ascii_alpha(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/*
+ * Adds the other case of all letters in the set. Returns true if the
+ * set includes letters that, case insensitively, match a non-ASCII
+ * character too (e.g. 'k' and KELVIN SIGN).
+ */
+static bool
+case_close(struct symset *set)
+{
+    for (int c = 'a'; c <= 'z'; c++) {
+        if (symset_has(set, c) || symset_has(set, c - 'a' + 'A')) {
+            symset_add(set, c);
+            symset_add(set, c - 'a' + 'A');
+        }
+    }
+
+    return symset_has(set, 'i') || symset_has(set, 'k') || symset_has(set, 's');
+}
+
+static struct node *
+parse_literal(struct parser *ps, int c)
+{
+    struct symset set = {0};
+    symset_add(&set, c);
+
+    const bool non_ascii = ps->icase && is_ascii_alpha(c) && case_close(&set);
+    return node_chars(&set, non_ascii);
+}
+
+static bool
+parse_class(struct parser *ps, struct symset *set)
+{
+    static const struct {
+        const char *name;
+        const char *ranges;  /* Pairs of first/last characters */
+    } classes[] = {
+        {"alpha", "azAZ"},
+        {"digit", "09"},
+        {"alnum", "azAZ09"},
+        {"upper", "AZ"},
+        {"lower", "az"},
+        {"space", "\t\r  "},
+        {"blank", "\t\t  "},
+        {"punct", "!/:@[`{~"},
+        {"print", " ~"},
+        {"graph", "!~"},
+        {"cntrl", "\x01\x1f\x7f\x7f"},
+        {"xdigit", "09afAF"},
+    };
+
+    const char *end = strstr(ps->p, ":]");
+    if (end == NULL)
+        return false;
+
+    const size_t len = end - ps->p;
+
+    for (size_t i = 0; i < ALEN(classes); i++) {
+        if (strlen(classes[i].name) != len ||
+            strncmp(classes[i].name, ps->p, len) != 0)
+        {
+            continue;
+        }
+
+        for (const char *r = classes[i].ranges; *r != '\0'; r += 2)
+            symset_add_range(set, (uint8_t)r[0], (uint8_t)r[1]);
+
+        if (strcmp(classes[i].name, "cntrl") == 0)
+            symset_add(set, 0);
+
+        ps->p = end + 2;
+        return true;
+    }
+
+    return false;
+}
+
+static struct node *
+parse_bracket(struct parser *ps)
+{
+    struct symset set = {0};
+    bool negate = false;
+    bool has_class = false;
+    bool has_range = false;
+
+    if (*ps->p == '^') {
+        negate = true;
+        ps->p++;
+    }
+
+    for (bool first = true; first || *ps->p != ']'; first = false) {
+        const uint8_t c = *ps->p;
+
+        if (c == '\0' || c >= 0x80)
+            return NULL;
+
+        if (c == '[') {
+            const char next = ps->p[1];
+            if (next == '.' || next == '=') {
+                /* Collating elements and equivalence classes */
+                return NULL;
+            }
+
+            if (next == ':') {
+                ps->p += 2;
+                if (!parse_class(ps, &set))
+                    return NULL;
+                has_class = true;
+                continue;
+            }
+        }
+
+        ps->p++;
+
+        if (*ps->p == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+            const uint8_t last = ps->p[1];
+            if (last < c || last >= 0x80 || last == '[')
+                return NULL;
+
+            symset_add_range(&set, c, last);
+            has_range = true;
+            ps->p += 2;
+            continue;
+        }
+
+        symset_add(&set, c);
+    }
+
+    ps->p++;  /* ']' */
+
+    bool non_ascii = false;
+    if (ps->icase)
+        non_ascii = case_close(&set);
+
+    if (negate) {
+        struct symset complement = {0};
+        for (int c = 0; c < 0x80; c++) {
+            if (!symset_has(&set, c) && c != '\n')
+                symset_add(&complement, c);
+        }
+
+        /* Non-ASCII characters may, or may not, be in the set */
+        return node_chars(&complement, true);
+    }
+
+    /* Ranges are collation order dependent */
+    return node_chars(&set, non_ascii || has_class || has_range);
+}
+
+static struct node *parse_alt(struct parser *ps);
+
+static struct node *
+parse_atom(struct parser *ps)
+{
+    const uint8_t c = *ps->p;
+
+    if (c >= 0x80)
+        return NULL;
+
+    ps->p++;
+
+    switch (c) {
+    case '(': {
+        if (++ps->depth > MAX_DEPTH)
+            return NULL;
+
+        struct node *node = *ps->p == ')'
+            ? node_new(NODE_EMPTY, NULL, NULL)
+            : parse_alt(ps);
+
+        if (node == NULL || *ps->p != ')') {
+            node_free(node);
+            return NULL;
+        }
+
+        ps->p++;
+        ps->depth--;
+        return node;
+    }
+
+    case '.': {
+        struct symset set = {0};
+        symset_add_range(&set, 0, 0x7f);
+        set.bits[0] &= ~(1ull << '\n');
+        return node_chars(&set, true);
+    }
+
+    case '^':
+        return node_new(NODE_BOL, NULL, NULL);
+
+    case '$':
+        return node_new(NODE_EOL, NULL, NULL);
+
+    case '[':
+        return parse_bracket(ps);
+
+    case '\\': {
+        const uint8_t escaped = *ps->p;
+
+        /* Back references, and GNU extensions (\w, \b, \< etc) */
+        if (escaped == '\0' || escaped >= 0x80 ||
+            is_ascii_alpha(escaped) || (escaped >= '0' && escaped <= '9'))
+        {
+            return NULL;
+        }
+
+        ps->p++;
+        return parse_literal(ps, escaped);
+    }
+
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        /* Quantifier without anything to repeat */
+        return NULL;
+
+    default:
+        return parse_literal(ps, c);
+    }
+}
+
+static bool
+parse_number(struct parser *ps, int *value)
+{
+    if (*ps->p < '0' || *ps->p > '9')
+        return false;
+
+    *value = 0;
+    while (*ps->p >= '0' && *ps->p <= '9') {
+        *value = *value * 10 + *ps->p++ - '0';
+        if (*value > MAX_REPEAT)
+            return false;
+    }
+
+    return true;
+}
+
+static struct node *
+parse_piece(struct parser *ps)
+{
+    struct node *node = parse_atom(ps);
+
+    while (node != NULL) {
+        switch (*ps->p) {
+        case '*':
+            ps->p++;
+            node = node_new(NODE_STAR, node, NULL);
+            break;
+
+        case '+':
+            ps->p++;
+            node = node_new(NODE_PLUS, node, NULL);
+            break;
+
+        case '?':
+            ps->p++;
+            node = node_new(NODE_QUEST, node, NULL);
+            break;
+
+        case '{': {
+            ps->p++;
+
+            int min, max;
+            if (!parse_number(ps, &min)) {
+                node_free(node);
+                return NULL;
+            }
+
+            max = min;
+            if (*ps->p == ',') {
+                ps->p++;
+                if (*ps->p == '}')
+                    max = -1;
+                else if (!parse_number(ps, &max) || max < min) {
+                    node_free(node);
+                    return NULL;
+                }
+            }
+
+            if (*ps->p != '}') {
+                node_free(node);
+                return NULL;
+            }
+
+            ps->p++;
+            node = node_new(NODE_REPEAT, node, NULL);
+            node->min = min;
+            node->max = max;
+            break;
+        }
+
+        default:
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+static struct node *
+parse_cat(struct parser *ps)
+{
+    struct node *node = NULL;
+
+    while (*ps->p != '\0' && *ps->p != '|' && *ps->p != ')') {
+        struct node *piece = parse_piece(ps);
+        if (piece == NULL) {
+            node_free(node);
+            return NULL;
+        }
+
+        node = node != NULL ? node_new(NODE_CAT, node, piece) : piece;
+    }
+
+    return node != NULL ? node : node_new(NODE_EMPTY, NULL, NULL);
+}
+
+static struct node *
+parse_alt(struct parser *ps)
+{
+    struct node *node = parse_cat(ps);
+
+    while (node != NULL && *ps->p == '|') {
+        ps->p++;
+
+        struct node *right = parse_cat(ps);
+        if (right == NULL) {
+            node_free(node);
+            return NULL;
+        }
+
+        node = node_new(NODE_ALT, node, right);
+    }
+
+    return node;
+}
+
+/*
+ * NFA
+ */
+
+enum nfa_type {
+    NFA_SET,    /* Consumes a symbol in 'set', continues at 'out' */
+    NFA_SPLIT,  /* Continues at both 'out' and 'out1' */
+    NFA_BOL,    /* Continues at 'out', at the start of the line */
+    NFA_EOL,    /* Continues at 'out', at the end of the line */
+    NFA_MATCH,
+};
+
+struct nfa_state {
+    enum nfa_type type;
+    int out;
+    int out1;
+    struct symset set;
+};
+
+struct nfa {
+    struct nfa_state *states;
+    int count;
+    bool failed;
+};
+
+static int
+nfa_add(struct nfa *nfa, enum nfa_type type, int out, int out1)
+{
+    if (nfa->count >= MAX_NFA_STATES) {
+        nfa->failed = true;
+        return -1;
+    }
+
+    const int idx = nfa->count++;
+    nfa->states[idx] = (struct nfa_state){
+        .type = type,
+        .out = out,
+        .out1 = out1,
+    };
+    return idx;
+}
+
+/*
+ * Compiles 'node', such that it continues at 'next' once matched.
+ * Returns the entry state. The NFA is built back to front.
+ */
+static int
+nfa_compile(struct nfa *nfa, const struct node *node, int next)
+{
+    if (nfa->failed)
+        return -1;
+
+    switch (node->type) {
+    case NODE_EMPTY:
+        return next;
+
+    case NODE_SET: {
+        const int idx = nfa_add(nfa, NFA_SET, next, -1);
+        if (idx >= 0)
+            nfa->states[idx].set = node->set;
+        return idx;
+    }
+
+    case NODE_CAT:
+        return nfa_compile(nfa, node->left, nfa_compile(nfa, node->right, next));
+
+    case NODE_ALT: {
+        const int left = nfa_compile(nfa, node->left, next);
+        const int right = nfa_compile(nfa, node->right, next);
+        return nfa_add(nfa, NFA_SPLIT, left, right);
+    }
+
+    case NODE_QUEST:
+        return nfa_add(nfa, NFA_SPLIT, nfa_compile(nfa, node->left, next), next);
+
+    case NODE_STAR:
+    case NODE_PLUS: {
+        const int loop = nfa_add(nfa, NFA_SPLIT, -1, next);
+        const int body = nfa_compile(nfa, node->left, loop);
+        if (nfa->failed)
+            return -1;
+
+        nfa->states[loop].out = body;
+        return node->type == NODE_STAR ? loop : body;
+    }
+
+    case NODE_BOL:
+        return nfa_add(nfa, NFA_BOL, next, -1);
+
+    case NODE_EOL:
+        return nfa_add(nfa, NFA_EOL, next, -1);
+
+    case NODE_REPEAT: {
+        int entry = next;
+
+        if (node->max < 0) {
+            const struct node star = {.type = NODE_STAR, .left = node->left};
+            entry = nfa_compile(nfa, &star, next);
+        } else {
+            /* (x(x(x)?)?)? */
+            for (int i = node->min; i < node->max; i++) {
+                entry = nfa_add(
+                    nfa, NFA_SPLIT, nfa_compile(nfa, node->left, entry), next);
+            }
+        }
+
+        for (int i = 0; i < node->min; i++)
+            entry = nfa_compile(nfa, node->left, entry);
+
+        return entry;
+    }
+    }
+
+    BUG("unhandled node type");
+    return -1;
+}
+
+/*
+ * DFA
+ */
+
+struct dfa_state {
+    uint32_t *nfa;   /* Sorted NFA state indices (no NFA_SPLIT) */
+    uint32_t count;
+    uint32_t hash;
+    bool accept;
+    int16_t next[SYM_COUNT];  /* -1 if not yet known */
+};
+
+struct regex_dfa {
+    struct nfa_state *nfa;
+    int nfa_start;
+
+    struct dfa_state *states;
+    int count;
+    int32_t buckets[2 * MAX_DFA_STATES];
+
+    int initial;        /* State at the start of a line, -1 if not yet known */
+    unsigned flushes;
+    bool failed;        /* Gave up; everything may match */
+
+    /* Scratch, for building a state's NFA state set */
+    uint32_t *set;
+    uint32_t set_count;
+    uint32_t *stack;
+    uint32_t *mark;
+    uint32_t mark_gen;
+};
+
+enum {
+    AT_BOL = 1 << 0,
+    AT_EOL = 1 << 1,
+};
+
+/*
+ * Adds 'idx', and the states reachable from it without consuming
+ * any input, to dfa->set. Assertions that don't hold at this point
+ * ('at' is a mask of AT_BOL and AT_EOL) are added as is.
+ */
+static void
+closure_add(struct regex_dfa *dfa, int idx, unsigned at)
+{
+    size_t sp = 0;
+    dfa->stack[sp++] = idx;
+
+    while (sp > 0) {
+        const uint32_t s = dfa->stack[--sp];
+
+        if (dfa->mark[s] == dfa->mark_gen)
+            continue;
+        dfa->mark[s] = dfa->mark_gen;
+
+        const struct nfa_state *state = &dfa->nfa[s];
+
+        if (state->type == NFA_SPLIT) {
+            if (state->out1 >= 0)
+                dfa->stack[sp++] = state->out1;
+            if (state->out >= 0)
+                dfa->stack[sp++] = state->out;
+        } else if ((state->type == NFA_BOL && (at & AT_BOL)) ||
+                   (state->type == NFA_EOL && (at & AT_EOL)))
+        {
+            dfa->stack[sp++] = state->out;
+        } else
+            dfa->set[dfa->set_count++] = s;
+    }
+}
+
+static int
+u32_cmp(const void *_a, const void *_b)
+{
+    const uint32_t a = *(const uint32_t *)_a;
+    const uint32_t b = *(const uint32_t *)_b;
+    return a < b ? -1 : a > b;
+}
+
+static void
+dfa_flush(struct regex_dfa *dfa)
+{
+    LOG_DBG("flushing %d DFA states", dfa->count);
+
+    for (int i = 0; i < dfa->count; i++)
+        free(dfa->states[i].nfa);
+
+    dfa->count = 0;
+    dfa->initial = -1;
+    memset(dfa->buckets, 0xff, sizeof(dfa->buckets));
+
+    if (++dfa->flushes > MAX_FLUSHES) {
+        LOG_DBG("too many flushes, giving up");
+        dfa->failed = true;
+    }
+}
+
+/* Looks up, or adds, the state with the NFA states in dfa->set */
+static int
+dfa_state_for_set(struct regex_dfa *dfa)
+{
+    qsort(dfa->set, dfa->set_count, sizeof(dfa->set[0]), &u32_cmp);
+
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < dfa->set_count; i++)
+        hash = (hash ^ dfa->set[i]) * 16777619u;
+
+    const size_t mask = ALEN(dfa->buckets) - 1;
+    size_t b = hash & mask;
+
+    for (; dfa->buckets[b] >= 0; b = (b + 1) & mask) {
+        const struct dfa_state *state = &dfa->states[dfa->buckets[b]];
+        if (state->hash == hash &&
+            state->count == dfa->set_count &&
+            memcmp(state->nfa, dfa->set, dfa->set_count * sizeof(dfa->set[0])) == 0)
+        {
+            return dfa->buckets[b];
+        }
+    }
+
+    if (dfa->count >= MAX_DFA_STATES) {
+        dfa_flush(dfa);
+        if (dfa->failed)
+            return -1;
+
+        for (b = hash & mask; dfa->buckets[b] >= 0; b = (b + 1) & mask)
+            ;
+    }
+
+    const int idx = dfa->count++;
+    struct dfa_state *state = &dfa->states[idx];
+
+    state->nfa = xmemdup(dfa->set, dfa->set_count * sizeof(dfa->set[0]));
+    state->count = dfa->set_count;
+    state->hash = hash;
+    state->accept = false;
+    memset(state->next, 0xff, sizeof(state->next));
+
+    for (uint32_t i = 0; i < dfa->set_count; i++) {
+        if (dfa->nfa[dfa->set[i]].type == NFA_MATCH)
+            state->accept = true;
+    }
+
+    dfa->buckets[b] = idx;
+    return idx;
+}
+
+static int
+dfa_initial(struct regex_dfa *dfa)
+{
+    if (dfa->initial < 0) {
+        dfa->mark_gen++;
+        dfa->set_count = 0;
+        closure_add(dfa, dfa->nfa_start, AT_BOL);
+        dfa->initial = dfa_state_for_set(dfa);
+    }
+
+    return dfa->initial;
+}
+
+/* Computes, and caches, the transition from 'from' on 'sym' */
+static int
+dfa_step(struct regex_dfa *dfa, int from, int sym)
+{
+    dfa->mark_gen++;
+    dfa->set_count = 0;
+
+    const struct dfa_state *state = &dfa->states[from];
+
+    if (sym == SYM_EOL) {
+        /* Nothing is consumed; keep everything, and resolve '$' */
+        for (uint32_t i = 0; i < state->count; i++)
+            closure_add(dfa, state->nfa[i], AT_EOL);
+    } else {
+        for (uint32_t i = 0; i < state->count; i++) {
+            const struct nfa_state *s = &dfa->nfa[state->nfa[i]];
+            if (s->type == NFA_SET && symset_has(&s->set, sym))
+                closure_add(dfa, s->out, 0);
+        }
+
+        /* A match may start anywhere */
+        closure_add(dfa, dfa->nfa_start, 0);
+    }
+
+    const unsigned flushes = dfa->flushes;
+    const int to = dfa_state_for_set(dfa);
+
+    /* Unless the cache was flushed, invalidating 'from' */
+    if (to >= 0 && dfa->flushes == flushes)
+        dfa->states[from].next[sym] = to;
+
+    return to;
+}
+
+struct regex_dfa *
+regex_dfa_compile(const char *pattern, bool icase)
+{
+    struct parser ps = {.p = pattern, .icase = icase};
+    struct node *tree = parse_alt(&ps);
+
+    if (tree == NULL || *ps.p != '\0') {
+        LOG_DBG("%s: not supported by the DFA", pattern);
+        node_free(tree);
+        return NULL;
+    }
+
+    struct nfa nfa = {.states = xmalloc(MAX_NFA_STATES * sizeof(nfa.states[0]))};
+    const int match = nfa_add(&nfa, NFA_MATCH, -1, -1);
+    const int start = nfa_compile(&nfa, tree, match);
+    node_free(tree);
+
+    if (nfa.failed || start < 0) {
+        LOG_DBG("%s: too many NFA states", pattern);
+        free(nfa.states);
+        return NULL;
+    }
+
+    struct regex_dfa *dfa = xcalloc(1, sizeof(*dfa));
+    dfa->nfa = xrealloc(nfa.states, nfa.count * sizeof(nfa.states[0]));
+    dfa->nfa_start = start;
+    dfa->states = xmalloc(MAX_DFA_STATES * sizeof(dfa->states[0]));
+    dfa->initial = -1;
+    dfa->set = xmalloc(nfa.count * sizeof(dfa->set[0]));
+    dfa->stack = xmalloc((2 * nfa.count + 1) * sizeof(dfa->stack[0]));
+    dfa->mark = xcalloc(nfa.count, sizeof(dfa->mark[0]));
+    memset(dfa->buckets, 0xff, sizeof(dfa->buckets));
+
+    LOG_DBG("%s: %d NFA states", pattern, nfa.count);
+    return dfa;
+}
+
+void
+regex_dfa_destroy(struct regex_dfa *dfa)
+{
+    if (dfa == NULL)
+        return;
+
+    for (int i = 0; i < dfa->count; i++)
+        free(dfa->states[i].nfa);
+
+    free(dfa->states);
+    free(dfa->nfa);
+    free(dfa->set);
+    free(dfa->stack);
+    free(dfa->mark);
+    free(dfa);
+}
+
+static inline int
+dfa_next(struct regex_dfa *dfa, int from, int sym)
+{
+    const int to = dfa->states[from].next[sym];
+    return likely(to >= 0) ? to : dfa_step(dfa, from, sym);
+}
+
+bool
+regex_dfa_line_may_match(struct regex_dfa *dfa, const char *line, size_t len)
+{
+    if (dfa->failed)
+        return true;
+
+    /*
+     * '^' and '$' both hold on an empty line, in any order. Rather
+     * than tracking that, let regexec() deal with it; it's cheap.
+     */
+    if (len == 0)
+        return true;
+
+    int s = dfa_initial(dfa);
+    if (s < 0 || dfa->states[s].accept)
+        return true;
+
+    for (size_t i = 0; i < len; i++) {
+        s = dfa_next(dfa, s, (uint8_t)line[i]);
+        if (s < 0 || dfa->states[s].accept)
+            return true;
+    }
+
+    s = dfa_next(dfa, s, SYM_EOL);
+    return s < 0 || dfa->states[s].accept;
+}
+
+UNITTEST
+{
+    /* Never rules out a line regexec() matches */
+    static const char *const patterns[] = {
+        "error\\[E[0-9]+\\]", "^foo", "bar$", "^$", "a|b(c|d)*e", "x{2,3}y",
+        "[^a-z]z", "[[:digit:]]{4}-[0-9]{2}", "f.o", "(ab)+", "K", "a?b?c?",
+        "[]x]", "\\.", "[a-]", "^(foo|bar)+$", "s{3}", "é?", "\\w", "^^a",
+        "a$$", "(^|x)f", "o($|b)", "$^",
+    };
+    static const char *const lines[] = {
+        "", "foo", "xfoo", "foobar", "bar", "error[E0308]: mismatched types",
+        "error[E]", "abcde", "ae", "abdcde", "xxy", "xxxxy", "xy", "Zz", "zz",
+        "ÿz", "2024-01", "fxo", "fæo", "ababab", "ab", "k", "\u212a", "x]",
+        "a.b", "-", "foobarfoo", "ſss", "ſ",
+    };
+
+    for (size_t i = 0; i < ALEN(patterns); i++) {
+        regex_t re;
+        xassert(regcomp(&re, patterns[i], REG_EXTENDED | REG_ICASE | REG_NEWLINE) == 0);
+
+        struct regex_dfa *dfa = regex_dfa_compile(patterns[i], true);
+
+        for (size_t j = 0; j < ALEN(lines) && dfa != NULL; j++) {
+            if (regexec(&re, lines[j], 0, NULL, 0) == 0)
+                xassert(regex_dfa_line_may_match(dfa, lines[j], strlen(lines[j])));
+        }
+
+        regex_dfa_destroy(dfa);
+        regfree(&re);
+    }
+
+    /* ... but rules out the ones that can't match */
+    struct regex_dfa *dfa = regex_dfa_compile("error\\[E[0-9]+\\]", true);
+    xassert(dfa != NULL);
+    xassert(regex_dfa_line_may_match(dfa, "ERROR[E0308]", 12));
+    xassert(!regex_dfa_line_may_match(dfa, "error[E]", 8));
+    xassert(!regex_dfa_line_may_match(dfa, "warning: unused", 15));
+    regex_dfa_destroy(dfa);
+
+    dfa = regex_dfa_compile("^(foo|bar)+$", true);
+    xassert(dfa != NULL);
+    xassert(regex_dfa_line_may_match(dfa, "foobarFOO", 9));
+    xassert(!regex_dfa_line_may_match(dfa, "xfoo", 4));
+    xassert(!regex_dfa_line_may_match(dfa, "foox", 4));
+    regex_dfa_destroy(dfa);
+
+    dfa = regex_dfa_compile("^^a$$", true);
+    xassert(dfa != NULL);
+    xassert(regex_dfa_line_may_match(dfa, "A", 1));
+    xassert(!regex_dfa_line_may_match(dfa, "aa", 2));
+    regex_dfa_destroy(dfa);
+
+    dfa = regex_dfa_compile("^$", true);
+    xassert(dfa != NULL);
+    xassert(!regex_dfa_line_may_match(dfa, " ", 1));
+    regex_dfa_destroy(dfa);
+
+    /* Unsupported */
+    xassert(regex_dfa_compile("\\w+", true) == NULL);
+    xassert(regex_dfa_compile("(a)\\1", true) == NULL);
+    xassert(regex_dfa_compile("é", true) == NULL);
+    xassert(regex_dfa_compile("[[.a.]]", true) == NULL);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A DFA pre-filter for POSIX extended regular expressions, used to
+ * quickly rule out lines that cannot possibly match, before running
+ * regexec() on the remaining ones.
+ *
+ * Only a subset of ERE is supported: ASCII patterns, without back
+ * references or GNU extensions. regex_dfa_compile() returns NULL for
+ * everything else.
+ *
+ * The DFA is built lazily, as it is run, and operates on UTF-8
+ * encoded text. It may match lines regexec() doesn't (e.g. [[:alpha:]]
+ * matches all non-ASCII characters), but never the other way around.
+ */
+struct regex_dfa;
+
+struct regex_dfa *regex_dfa_compile(const char *pattern, bool icase);
+void regex_dfa_destroy(struct regex_dfa *dfa);
+
+/*
+ * Whether 'line' (without its newline) may contain a match of the
+ * expression. False means it definitely doesn't.
+ */
+bool regex_dfa_line_may_match(
+    struct regex_dfa *dfa, const char *line, size_t len);
@@ -1,7 +1,10 @@
 #include "render.h"
 
+#include <inttypes.h>
 #include <limits.h>
 #include <signal.h>
+#include <semaphore.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -44,6 +47,7 @@
 #include "selection.h"
 #include "shm.h"
 #include "sixel.h"
+#include "tile-cache.h"
 #include "url-mode.h"
 #include "util.h"
 #include "xmalloc.h"
@@ -650,21 +654,80 @@ draw_cursor(const struct terminal *term, const struct cell *cell,
     }
 }
 
-static int
-render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damage,
-            struct row *row, int row_no, int col, bool has_cursor)
+/* Per-cell state, shared between the render passes of a row */
+struct cell_render_state {
+    bool dirty;
+    bool covered;       /* Background overwritten by wide cell to the left */
+    bool is_selected;
+
+    pixman_color_t fg;
+    pixman_color_t bg;
+
+    struct fcft_font *font;
+    const struct composed *composed;
+    const struct fcft_glyph *single;
+    const struct fcft_glyph **glyphs;
+    unsigned glyph_count;
+
+    int cols;
+    int render_width;
+
+    /* Set if the glyph can be rendered without clipping */
+    const struct fcft_glyph *unclipped;
+    bool use_tile;
+};
+
+/* Solid fill source image, re-used for as long as the color stays the same */
+struct glyph_source {
+    pixman_image_t *pix;
+    pixman_color_t color;
+};
+
+static inline bool
+pixman_color_equal(const pixman_color_t *a, const pixman_color_t *b)
+{
+    return a->red == b->red && a->green == b->green &&
+           a->blue == b->blue && a->alpha == b->alpha;
+}
+
+static pixman_image_t *
+glyph_source_get(struct glyph_source *src, const pixman_color_t *color)
+{
+    if (src->pix == NULL || !pixman_color_equal(&src->color, color)) {
+        if (src->pix != NULL)
+            pixman_image_unref(src->pix);
+        src->pix = pixman_image_create_solid_fill(color);
+        src->color = *color;
+    }
+    return src->pix;
+}
+
+static void
+glyph_source_destroy(struct glyph_source *src)
+{
+    if (src->pix != NULL)
+        pixman_image_unref(src->pix);
+    src->pix = NULL;
+}
+
+/*
+ * Resolves a cell's colors and glyphs, and marks it clean. Returns
+ * false if the cell already is clean, and doesn't need rendering.
+ */
+static bool
+prepare_cell(struct terminal *term, struct row *row, int col,
+             struct cell_render_state *state)
 {
     struct cell *cell = &row->cells[col];
-    if (cell->attrs.clean)
-        return 0;
+    if (cell->attrs.clean) {
+        state->dirty = false;
+        return false;
+    }
 
     cell->attrs.clean = 1;
     cell->attrs.confined = true;
 
-    int width = term->cell_width;
-    int height = term->cell_height;
-    const int x = term->margins.left + col * width;
-    const int y = term->margins.top + row_no * height;
+    const int width = term->cell_width;
 
     bool is_selected = cell->attrs.selected;
 
@@ -860,7 +923,7 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
 
         else if (base >= CELL_COMB_CHARS_LO && base <= CELL_COMB_CHARS_HI)
         {
-            composed = composed_lookup(term->composed, base - CELL_COMB_CHARS_LO);
+            composed = composed_lookup(&term->composed, base - CELL_COMB_CHARS_LO);
             base = composed->chars[0];
 
             if (term->conf->can_shape_grapheme && term->conf->tweak.grapheme_shaping) {
@@ -925,23 +988,45 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         }
     }
 
-    pixman_region32_t clip;
-    pixman_region32_init_rect(
-        &clip, x, y,
-        render_width, term->cell_height);
-    pixman_image_set_clip_region32(pix, &clip);
+    *state = (struct cell_render_state){
+        .dirty = true,
+        .is_selected = is_selected,
+        .fg = fg,
+        .bg = bg,
+        .font = font,
+        .composed = composed,
+        .single = single,
+        .glyph_count = glyph_count,
+        .cols = cell_cols,
+        .render_width = render_width,
+    };
 
-    if (damage != NULL) {
-        pixman_region32_union_rect(
-            damage, damage, x, y, render_width, term->cell_height);
-    }
+    /* 'glyphs' may point to our local 'single' */
+    state->glyphs = glyphs == &single ? &state->single : glyphs;
+    return true;
+}
 
-    pixman_region32_fini(&clip);
+/*
+ * Renders everything but the background of a prepared cell: the
+ * cursor, glyphs, and decorations. The caller is responsible for
+ * clipping.
+ */
+static void
+render_cell_fg(struct terminal *term, pixman_image_t *pix,
+               struct row *row, int col, int x, int y, bool has_cursor,
+               const struct cell_render_state *state,
+               struct glyph_source *src)
+{
+    const struct cell *cell = &row->cells[col];
+    const bool is_selected = state->is_selected;
+    struct fcft_font *font = state->font;
+    const struct composed *composed = state->composed;
+    const struct fcft_glyph **glyphs = state->glyphs;
+    const unsigned glyph_count = state->glyph_count;
+    const int cell_cols = state->cols;
 
-    /* Background */
-    pixman_image_fill_rectangles(
-        PIXMAN_OP_SRC, pix, &bg, 1,
-        &(pixman_rectangle16_t){x, y, cell_cols * width, height});
+    pixman_color_t fg = state->fg;
+    pixman_color_t bg = state->bg;
 
     if (cell->attrs.blink && term->blink.fd < 0) {
         /* TODO: use a custom lock for this? */
@@ -959,7 +1044,7 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         goto draw_cursor;
     }
 
-    pixman_image_t *clr_pix = pixman_image_create_solid_fill(&fg);
+    pixman_image_t *clr_pix = glyph_source_get(src, &fg);
 
     int pen_x = x;
     for (unsigned i = 0; i < glyph_count; i++) {
@@ -1035,8 +1120,6 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
         pen_x += glyph->advance.x;
     }
 
-    pixman_image_unref(clr_pix);
-
     /* Underline */
     if (cell->attrs.underline) {
         pixman_color_t underline_color = fg;
@@ -1097,17 +1180,368 @@ render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damag
 draw_cursor:
     if (has_cursor && (term->cursor_style != CURSOR_BLOCK || !term->kbd_focus))
         draw_cursor(term, cell, font, pix, &fg, &bg, x, y, cell_cols);
+}
+
+static int
+render_cell(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damage,
+            struct row *row, int row_no, int col, bool has_cursor)
+{
+    struct cell_render_state state;
+    if (!prepare_cell(term, row, col, &state))
+        return 0;
+
+    const int x = term->margins.left + col * term->cell_width;
+    const int y = term->margins.top + row_no * term->cell_height;
+
+    pixman_region32_t clip;
+    pixman_region32_init_rect(
+        &clip, x, y,
+        state.render_width, term->cell_height);
+    pixman_image_set_clip_region32(pix, &clip);
+
+    if (damage != NULL) {
+        pixman_region32_union_rect(
+            damage, damage, x, y, state.render_width, term->cell_height);
+    }
+
+    pixman_region32_fini(&clip);
+
+    /* Background */
+    pixman_image_fill_rectangles(
+        PIXMAN_OP_SRC, pix, &state.bg, 1,
+        &(pixman_rectangle16_t){
+            x, y, state.cols * term->cell_width, term->cell_height});
+
+    struct glyph_source src = {0};
+    render_cell_fg(term, pix, row, col, x, y, has_cursor, &state, &src);
+    glyph_source_destroy(&src);
 
     pixman_image_set_clip_region32(pix, NULL);
-    return cell_cols;
+    return state.cols;
+}
+
+/*
+ * Renders the dirty cells in [start, end) of a row, in three passes:
+ *
+ *  1. resolve colors and glyphs of all dirty cells
+ *  2. fill backgrounds, one fill (and one damage rect) per run of
+ *     adjacent dirty cells sharing the same background color
+ *  3. render glyphs and decorations
+ *
+ * Glyphs that are fully contained in their cell, in cells without
+ * decorations or cursor, are composited without a clip region, using
+ * a solid fill source shared by all glyphs with the same color.
+ * Everything else takes the per-cell, clipped, path.
+ *
+ * Each pass runs right-to-left, like rendering used to when done
+ * cell-by-cell, so that overflowing glyphs, and wide cells, are
+ * painted over their right neighbors.
+ */
+/*
+ * Returns the cell's glyph if it is the only thing to render, apart
+ * from the background, and it lies fully inside the cell. Such glyphs
+ * need no clipping, and can be cached (together with the background)
+ * as pre-rendered tiles.
+ */
+static const struct fcft_glyph *
+unclipped_glyph(const struct terminal *term, const struct cell *cell,
+                const struct cell_render_state *state, bool has_cursor,
+                int x, int y)
+{
+    if (has_cursor ||
+        cell->attrs.underline ||
+        cell->attrs.strikethrough ||
+        cell->attrs.url ||
+        cell->attrs.blink)
+    {
+        return NULL;
+    }
+
+    if (cell->wc == 0 || cell->wc >= CELL_SPACER || cell->wc == U'\t' ||
+        (unlikely(cell->attrs.conceal) && !state->is_selected))
+    {
+        return NULL;
+    }
+
+    if (state->glyph_count != 1 || state->composed != NULL)
+        return NULL;
+
+    const struct fcft_glyph *glyph = state->glyphs[0];
+    if (glyph == NULL || pixman_image_get_format(glyph->pix) == PIXMAN_a8r8g8b8)
+        return NULL;
+
+    const int g_x = x + term->font_x_ofs + glyph->x;
+    const int g_y = y + term->font_baseline - glyph->y;
+
+    if (g_x < x || g_x + glyph->width > x + state->cols * term->cell_width ||
+        g_y < y || g_y + glyph->height > y + term->cell_height)
+    {
+        return NULL;
+    }
+
+    return glyph;
+}
+
+static struct tile_cache *
+tile_cache_for_slot(const struct terminal *term, int slot)
+{
+    return (size_t)slot < term->render.tiles.count
+        ? term->render.tiles.caches[slot]
+        : NULL;
 }
 
+/* Renders a cell's background and glyph into a tile, for the tile cache */
+static pixman_image_t *
+render_tile(const struct terminal *term, pixman_format_code_t format,
+            const struct cell_render_state *state, struct glyph_source *src)
+{
+    const struct fcft_glyph *glyph = state->unclipped;
+    const int width = state->cols * term->cell_width;
+    const int height = term->cell_height;
+
+    pixman_image_t *tile = pixman_image_create_bits_no_clear(
+        format, width, height, NULL, 0);
+
+    if (tile == NULL)
+        return NULL;
+
+    pixman_image_fill_rectangles(
+        PIXMAN_OP_SRC, tile, &state->bg, 1,
+        &(pixman_rectangle16_t){0, 0, width, height});
+
+    pixman_image_composite32(
+        PIXMAN_OP_OVER, glyph_source_get(src, &state->fg), glyph->pix, tile,
+        0, 0, 0, 0,
+        term->font_x_ofs + glyph->x, term->font_baseline - glyph->y,
+        glyph->width, glyph->height);
+
+    return tile;
+}
+
+/*
+ * Renders the dirty cells in [start, end) of a row, in three passes:
+ *
+ *  1. resolve colors and glyphs of all dirty cells
+ *  2. fill backgrounds, one fill per run of adjacent dirty cells
+ *     sharing the same background color, and one damage rect per run
+ *     of adjacent dirty cells
+ *  3. render glyphs and decorations
+ *
+ * Glyphs that are fully contained in their cell, in cells without
+ * decorations or cursor, are composited without a clip region, using
+ * a solid fill source shared by all glyphs with the same color. With
+ * a tile cache, such cells (background included) are instead copied
+ * from a pre-rendered tile. Everything else takes the per-cell,
+ * clipped, path.
+ *
+ * Each pass runs right-to-left, like rendering used to when done
+ * cell-by-cell, so that overflowing glyphs, and wide cells, are
+ * painted over their right neighbors.
+ */
+static void
+render_row_range(struct terminal *term, pixman_image_t *pix,
+                 pixman_region32_t *damage, struct row *row, int row_no,
+                 int start, int end, int cursor_col,
+                 struct cell_render_state *states, struct glyph_source *src,
+                 struct tile_cache *tiles)
+{
+    const int width = term->cell_width;
+    const int height = term->cell_height;
+    const int y = term->margins.top + row_no * height;
+    const int count = end - start;
+
+    /* Note: 'states' is indexed by column, relative to 'start' */
+
+    for (int i = count - 1; i >= 0; i--) {
+        prepare_cell(term, row, start + i, &states[i]);
+        states[i].covered = false;
+    }
+
+    /* Cells overwritten by a wide cell's background */
+    for (int i = 0; i < count; i++) {
+        if (!states[i].dirty)
+            continue;
+        for (int j = 1; j < states[i].cols && i + j < count; j++)
+            states[i + j].covered = true;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct cell_render_state *state = &states[i];
+        if (!state->dirty || state->covered) {
+            state->unclipped = NULL;
+            state->use_tile = false;
+            continue;
+        }
+
+        const int col = start + i;
+        state->unclipped = unclipped_glyph(
+            term, &row->cells[col], state, col == cursor_col,
+            term->margins.left + col * width, y);
+        state->use_tile = tiles != NULL && state->unclipped != NULL;
+    }
+
+    /* Damage */
+    for (int i = count - 1; i >= 0; ) {
+        if (!states[i].dirty || damage == NULL) {
+            i--;
+            continue;
+        }
+
+        int first = i;
+        int damage_end =
+            term->margins.left + (start + i) * width + states[i].render_width;
+
+        while (first > 0 && states[first - 1].dirty) {
+            first--;
+            damage_end = max(
+                damage_end,
+                term->margins.left + (start + first) * width +
+                    states[first].render_width);
+        }
+
+        const int x = term->margins.left + (start + first) * width;
+        pixman_region32_union_rect(damage, damage, x, y, damage_end - x, height);
+
+        i = first - 1;
+    }
+
+    /* Backgrounds (tiles include their own) */
+    for (int i = count - 1; i >= 0; ) {
+        if (!states[i].dirty || states[i].use_tile) {
+            i--;
+            continue;
+        }
+
+        const pixman_color_t *bg = &states[i].bg;
+
+        int first = i;
+        int fill_end =
+            term->margins.left + (start + i) * width + states[i].cols * width;
+
+        while (first > 0 &&
+               states[first - 1].dirty &&
+               !states[first - 1].use_tile &&
+               pixman_color_equal(&states[first - 1].bg, bg))
+        {
+            first--;
+            fill_end = max(
+                fill_end,
+                term->margins.left + (start + first) * width +
+                    states[first].cols * width);
+        }
+
+        const int x = term->margins.left + (start + first) * width;
+
+        pixman_image_fill_rectangles(
+            PIXMAN_OP_SRC, pix, bg, 1,
+            &(pixman_rectangle16_t){x, y, fill_end - x, height});
+
+        i = first - 1;
+    }
+
+    /* Glyphs, decorations and cursor */
+    const pixman_format_code_t format = pixman_image_get_format(pix);
+
+    for (int i = count - 1; i >= 0; i--) {
+        const struct cell_render_state *state = &states[i];
+
+        if (!state->dirty || state->covered)
+            continue;
+
+        const int col = start + i;
+        const int x = term->margins.left + col * width;
+        const struct fcft_glyph *glyph = state->unclipped;
+
+        if (state->use_tile) {
+            const struct tile_cache_key key = {
+                .glyph = glyph,
+                .fg = state->fg,
+                .bg = state->bg,
+                .format = format,
+                .cols = state->cols,
+            };
+
+            pixman_image_t *tile = tile_cache_lookup(tiles, &key);
+            bool cached = tile != NULL;
+
+            if (tile == NULL)
+                tile = render_tile(term, format, state, src);
+
+            if (tile != NULL) {
+                pixman_image_composite32(
+                    PIXMAN_OP_SRC, tile, NULL, pix, 0, 0, 0, 0,
+                    x, y, state->cols * width, height);
+
+                if (!cached)
+                    tile_cache_insert(tiles, &key, tile);
+                continue;
+            }
+
+            /* Failed to allocate tile; fill background and fall through */
+            pixman_image_fill_rectangles(
+                PIXMAN_OP_SRC, pix, &state->bg, 1,
+                &(pixman_rectangle16_t){x, y, state->cols * width, height});
+        }
+
+        if (glyph != NULL) {
+            /* Fully inside its cell - no need to clip */
+            pixman_image_composite32(
+                PIXMAN_OP_OVER, glyph_source_get(src, &state->fg),
+                glyph->pix, pix, 0, 0, 0, 0,
+                x + term->font_x_ofs + glyph->x,
+                y + term->font_baseline - glyph->y,
+                glyph->width, glyph->height);
+            continue;
+        }
+
+        const struct cell *cell = &row->cells[col];
+        const bool has_cursor = col == cursor_col;
+
+        if (!has_cursor &&
+            !cell->attrs.underline &&
+            !cell->attrs.strikethrough &&
+            !cell->attrs.url &&
+            !cell->attrs.blink &&
+            (cell->wc == 0 || cell->wc >= CELL_SPACER || cell->wc == U'\t' ||
+             (unlikely(cell->attrs.conceal) && !state->is_selected)))
+        {
+            /* Nothing but background */
+            continue;
+        }
+
+        pixman_region32_t clip;
+        pixman_region32_init_rect(&clip, x, y, state->render_width, height);
+        pixman_image_set_clip_region32(pix, &clip);
+        pixman_region32_fini(&clip);
+
+        render_cell_fg(term, pix, row, col, x, y, has_cursor, state, src);
+
+        pixman_image_set_clip_region32(pix, NULL);
+    }
+}
+
+/* 'tiles' may be NULL, in which case no tiles are cached */
 static void
 render_row(struct terminal *term, pixman_image_t *pix, pixman_region32_t *damage,
-           struct row *row, int row_no, int cursor_col)
+           struct row *row, int row_no, int cursor_col, struct tile_cache *tiles)
 {
-    for (int col = term->cols - 1; col >= 0; col--)
-        render_cell(term, pix, damage, row, row_no, col, cursor_col == col);
+    struct cell_render_state states[128];
+    struct glyph_source src = {0};
+
+    const int chunk_size = ALEN(states);
+
+    /* Cells outside the dirty span are clean; no need to visit them */
+    const int first = max(row->dirty_start, 0);
+    const int last = min(row->dirty_end, term->cols - 1);
+
+    for (int end = last + 1; end > first; end -= chunk_size) {
+        const int start = max(first, end - chunk_size);
+        render_row_range(
+            term, pix, damage, row, row_no, start, end, cursor_col,
+            states, &src, tiles);
+    }
+
+    glyph_source_destroy(&src);
 }
 
 static void
@@ -1211,9 +1645,169 @@ render_margin(struct terminal *term, struct buffer *buf,
     }
 }
 
+/*
+ * Scroll damage is applied either by SHM scrolling the buffer (see
+ * shm_scroll()), or by memmove():ing its content. Which one is
+ * cheaper depends on the number of lines scrolled, the size of the
+ * scroll region, the margins (which must be restored after SHM
+ * scrolling), and on the system: memory bandwidth vs. the cost of
+ * punching holes in, and growing, the memfd.
+ *
+ * Rather than guessing, we time both, and keep a moving average of
+ * their cost per byte touched. Separate estimates are kept for each
+ * combination of buffer size, scroll region and margins (the least
+ * recently used one is replaced when a new combination is seen). The
+ * first few samples of each method are only used to seed the average,
+ * with their median, since the first scrolls tend to be outliers
+ * (page faults, a cold cache).
+ *
+ * The method with the lowest estimated cost is used, but every now and
+ * then the other one is tried, to keep its estimate up-to-date. Each
+ * time that confirms the other method is slower, the interval until
+ * the next try is doubled (up to a limit); when it turns out to be
+ * faster, the interval is reset.
+ */
+#define SCROLL_COST_EXPLORE_INTERVAL_MIN 64
+#define SCROLL_COST_EXPLORE_INTERVAL_MAX 8192
+
+static struct scroll_cost_model *
+scroll_cost_model(struct terminal *term, const struct buffer *buf,
+                  const struct damage *dmg)
+{
+    const size_t buf_size = (size_t)buf->height * buf->stride;
+    struct scroll_cost_model *models = term->render.scroll_cost.models;
+    struct scroll_cost_model *model = NULL;
+
+    for (size_t i = 0; i < ALEN(term->render.scroll_cost.models); i++) {
+        struct scroll_cost_model *m = &models[i];
+
+        if (m->buf_size == buf_size &&
+            m->region_start == dmg->region.start &&
+            m->region_end == dmg->region.end &&
+            m->margin_top == term->margins.top &&
+            m->margin_bottom == term->margins.bottom)
+        {
+            model = m;
+            break;
+        }
+
+        if (model == NULL || m->last_used < model->last_used)
+            model = m;
+    }
+
+    if (model->buf_size != buf_size ||
+        model->region_start != dmg->region.start ||
+        model->region_end != dmg->region.end ||
+        model->margin_top != term->margins.top ||
+        model->margin_bottom != term->margins.bottom)
+    {
+        /* Replace the least recently used model */
+        *model = (struct scroll_cost_model){
+            .buf_size = buf_size,
+            .region_start = dmg->region.start,
+            .region_end = dmg->region.end,
+            .margin_top = term->margins.top,
+            .margin_bottom = term->margins.bottom,
+            .explore_interval = SCROLL_COST_EXPLORE_INTERVAL_MIN,
+        };
+    }
+
+    model->last_used = ++term->render.scroll_cost.use_count;
+    return model;
+}
+
+static bool
+scroll_use_shm(struct scroll_cost_model *model, const struct buffer *buf,
+               size_t shm_bytes, size_t memmove_bytes)
+{
+    if (!shm_can_scroll(buf))
+        return false;
+
+    const struct scroll_cost *shm = &model->shm;
+    const struct scroll_cost *mm = &model->memmove;
+    const unsigned warmup = ALEN(shm->warmup);
+
+    if (shm->samples < warmup || mm->samples < warmup) {
+        /* Measure both before trusting the estimates */
+        if (shm->samples != mm->samples)
+            return shm->samples < mm->samples;
+
+        /* Assume both methods perform roughly the same */
+        return shm_bytes < memmove_bytes;
+    }
+
+    const double shm_ns = shm_bytes * shm->ns_per_byte;
+    const double memmove_ns = memmove_bytes * mm->ns_per_byte;
+    const bool use_shm = shm_ns < memmove_ns;
+
+    if (++model->explore >= model->explore_interval) {
+        model->explore = 0;
+        model->exploring_shm = !use_shm;
+        model->exploring_ns = use_shm ? shm_ns : memmove_ns;
+        return !use_shm;
+    }
+
+    return use_shm;
+}
+
+static void
+scroll_cost_update(struct terminal *term, struct scroll_cost_model *model,
+                   bool shm, size_t bytes, const struct timespec *start_time)
+{
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+    struct timespec elapsed;
+    timespec_sub(&end_time, start_time, &elapsed);
+
+    const uint64_t ns = elapsed.tv_sec * 1000000000ull + elapsed.tv_nsec;
+    const double ns_per_byte = (double)ns / bytes;
+
+    struct scroll_cost *cost = shm ? &model->shm : &model->memmove;
+    const unsigned warmup = ALEN(cost->warmup);
+
+    if (cost->samples < warmup) {
+        /* Insertion sort */
+        unsigned i = cost->samples;
+        for (; i > 0 && cost->warmup[i - 1] > ns_per_byte; i--)
+            cost->warmup[i] = cost->warmup[i - 1];
+        cost->warmup[i] = ns_per_byte;
+
+        if (cost->samples + 1 == warmup) {
+            cost->ns_per_byte =
+                (cost->warmup[(warmup - 1) / 2] + cost->warmup[warmup / 2]) / 2;
+        }
+    } else
+        cost->ns_per_byte += (ns_per_byte - cost->ns_per_byte) / 8;
+
+    if (cost->samples < UINT_MAX)
+        cost->samples++;
+
+    if (model->exploring_ns > 0.) {
+        /* A failed SHM scroll doesn't tell us anything */
+        if (shm == model->exploring_shm) {
+            if (ns < model->exploring_ns)
+                model->explore_interval = SCROLL_COST_EXPLORE_INTERVAL_MIN;
+            else {
+                model->explore_interval = min(
+                    model->explore_interval * 2,
+                    SCROLL_COST_EXPLORE_INTERVAL_MAX);
+            }
+        }
+
+        model->exploring_ns = 0.;
+    }
+
+    if (shm)
+        term->render.scroll_cost.shm_count++;
+    else
+        term->render.scroll_cost.memmove_count++;
+    term->render.scroll_cost.ns += ns;
+}
+
 static void
 grid_render_scroll(struct terminal *term, struct buffer *buf,
-                   const struct damage *dmg)
+                   pixman_region32_t *damage, const struct damage *dmg)
 {
     LOG_DBG(
         "damage: SCROLL: %d-%d by %d lines",
@@ -1229,52 +1823,25 @@ grid_render_scroll(struct terminal *term, struct buffer *buf,
     const int height = (region_size - dmg->lines) * term->cell_height;
     xassert(height > 0);
 
-#if TIME_SCROLL_DAMAGE
     struct timespec start_time;
     clock_gettime(CLOCK_MONOTONIC, &start_time);
-#endif
 
     int dst_y = term->margins.top + (dmg->region.start + 0) * term->cell_height;
     int src_y = term->margins.top + (dmg->region.start + dmg->lines) * term->cell_height;
 
     /*
-     * SHM scrolling can be *much* faster, but it depends on how many
-     * lines we're scrolling, and how much repairing we need to do.
-     *
-     * In short, scrolling a *large* number of rows is faster with a
-     * memmove, while scrolling a *small* number of lines is faster
-     * with SHM scrolling.
-     *
-     * However, since we need to restore the scrolling regions when
-     * SHM scrolling, we also need to take this into account.
-     *
-     * Finally, we also have to restore the window margins, and this
-     * is a *huge* performance hit when scrolling a large number of
-     * lines (in addition to the sloweness of SHM scrolling as
-     * method).
-     *
-     * So, we need to figure out when to SHM scroll, and when to
-     * memmove.
-     *
-     * For now, assume that the both methods perform roughly the same,
-     * given an equal number of bytes to move/allocate, and use the
-     * method that results in the least amount of bytes to touch.
-     *
-     * Since number of lines directly translates to bytes, we can
-     * simply count lines.
-     *
      * SHM scrolling needs to first "move" (punch hole + allocate)
-     * dmg->lines number of lines, and then we need to restore
-     * the bottom scroll region.
-     *
-     * If the total number of lines is less than half the screen - use
-     * SHM. Otherwise use memmove.
+     * dmg->lines number of lines, and then restore the scroll
+     * regions, and the window margins. A memmove only needs to move
+     * the lines that remain in the scroll region.
      */
-    bool try_shm_scroll =
-        shm_can_scroll(buf) && (
-            dmg->lines +
-            dmg->region.start +
-            (term->rows - dmg->region.end)) < term->rows / 2;
+    const size_t shm_bytes = (size_t)buf->stride * (
+        (dmg->lines + dmg->region.start + (term->rows - dmg->region.end)) * term->cell_height +
+        term->margins.top + term->margins.bottom);
+    const size_t memmove_bytes = (size_t)height * buf->stride;
+
+    struct scroll_cost_model *model = scroll_cost_model(term, buf, dmg);
+    bool try_shm_scroll = scroll_use_shm(model, buf, shm_bytes, memmove_bytes);
 
     bool did_shm_scroll = false;
 
@@ -1294,12 +1861,21 @@ grid_render_scroll(struct terminal *term, struct buffer *buf,
             term, buf, dmg->region.end - dmg->lines, term->rows, false);
     } else {
         /* Fallback for when we either cannot do SHM scrolling, or it failed */
+        if (try_shm_scroll) {
+            /* Don't charge the failed attempt to memmove */
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
+        }
+
         uint8_t *raw = buf->data;
         memmove(raw + dst_y * buf->stride,
                 raw + src_y * buf->stride,
                 height * buf->stride);
     }
 
+    scroll_cost_update(
+        term, model, did_shm_scroll,
+        did_shm_scroll ? shm_bytes : memmove_bytes, &start_time);
+
 #if TIME_SCROLL_DAMAGE
     struct timespec end_time;
     clock_gettime(CLOCK_MONOTONIC, &end_time);
@@ -1312,8 +1888,8 @@ grid_render_scroll(struct terminal *term, struct buffer *buf,
              (long)memmove_time.tv_sec, memmove_time.tv_nsec);
 #endif
 
-    wl_surface_damage_buffer(
-        term->window->surface.surf, term->margins.left, dst_y,
+    pixman_region32_union_rect(
+        damage, damage, term->margins.left, dst_y,
         term->width - term->margins.left - term->margins.right, height);
 
     /*
@@ -1326,7 +1902,7 @@ grid_render_scroll(struct terminal *term, struct buffer *buf,
 
 static void
 grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
-                           const struct damage *dmg)
+                           pixman_region32_t *damage, const struct damage *dmg)
 {
     LOG_DBG(
         "damage: SCROLL REVERSE: %d-%d by %d lines",
@@ -1342,19 +1918,20 @@ grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
     const int height = (region_size - dmg->lines) * term->cell_height;
     xassert(height > 0);
 
-#if TIME_SCROLL_DAMAGE
     struct timespec start_time;
     clock_gettime(CLOCK_MONOTONIC, &start_time);
-#endif
 
     int src_y = term->margins.top + (dmg->region.start + 0) * term->cell_height;
     int dst_y = term->margins.top + (dmg->region.start + dmg->lines) * term->cell_height;
 
-    bool try_shm_scroll =
-        shm_can_scroll(buf) && (
-            dmg->lines +
-            dmg->region.start +
-            (term->rows - dmg->region.end)) < term->rows / 2;
+    /* See grid_render_scroll() */
+    const size_t shm_bytes = (size_t)buf->stride * (
+        (dmg->lines + dmg->region.start + (term->rows - dmg->region.end)) * term->cell_height +
+        term->margins.top + term->margins.bottom);
+    const size_t memmove_bytes = (size_t)height * buf->stride;
+
+    struct scroll_cost_model *model = scroll_cost_model(term, buf, dmg);
+    bool try_shm_scroll = scroll_use_shm(model, buf, shm_bytes, memmove_bytes);
 
     bool did_shm_scroll = false;
 
@@ -1371,12 +1948,21 @@ grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
             term, buf, dmg->region.start, dmg->region.start + dmg->lines, false);
     } else {
         /* Fallback for when we either cannot do SHM scrolling, or it failed */
+        if (try_shm_scroll) {
+            /* Don't charge the failed attempt to memmove */
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
+        }
+
         uint8_t *raw = buf->data;
         memmove(raw + dst_y * buf->stride,
                 raw + src_y * buf->stride,
                 height * buf->stride);
     }
 
+    scroll_cost_update(
+        term, model, did_shm_scroll,
+        did_shm_scroll ? shm_bytes : memmove_bytes, &start_time);
+
 #if TIME_SCROLL_DAMAGE
     struct timespec end_time;
     clock_gettime(CLOCK_MONOTONIC, &end_time);
@@ -1389,8 +1975,8 @@ grid_render_scroll_reverse(struct terminal *term, struct buffer *buf,
              (long)memmove_time.tv_sec, memmove_time.tv_nsec);
 #endif
 
-    wl_surface_damage_buffer(
-        term->window->surface.surf, term->margins.left, dst_y,
+    pixman_region32_union_rect(
+        damage, damage, term->margins.left, dst_y,
         term->width - term->margins.left - term->margins.right, height);
 
     /*
@@ -1515,7 +2101,7 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
         }
 
         /* Is the row dirty? */
-        struct row *row = term->grid->rows[abs_row_no];
+        struct row *row = grid_row_uncompact(term->grid, term->grid->rows[abs_row_no]);
         xassert(row != NULL);  /* Should be visible */
 
         if (!row->dirty) {
@@ -1541,7 +2127,8 @@ render_sixel(struct terminal *term, pixman_image_t *pix,
          */
         if (!sixel->opaque) {
             /* TODO: multithreading */
-            render_row(term, pix, damage, row, term_row_no, cursor_col);
+            render_row(term, pix, damage, row, term_row_no, cursor_col,
+                       tile_cache_for_slot(term, 0));
         } else {
             for (int col = sixel->pos.col;
                  col < min(sixel->pos.col + sixel->cols, term->cols);
@@ -1713,7 +2300,7 @@ render_ime_preedit_for_seat(struct terminal *term, struct seat *seat,
         real_cells[i] = row->cells[col_idx + i];
         real_cells[i].attrs.clean = 0;
     }
-    row->dirty = true;
+    grid_row_dirty_range(row, col_idx, col_idx + cells_used - 1);
 
     /* Render pre-edit text */
     xassert(seat->ime.preedit.cells[ime_ofs].wc < CELL_SPACER);
@@ -2036,114 +2623,389 @@ render_overlay(struct terminal *term)
          * paint call is done below */
         pixman_image_set_clip_region32(buf->pix[0], &new_dimmed);
 
-        pixman_region32_fini(&new_see_through);
-        pixman_region32_fini(&new_dimmed);
-        pixman_region32_fini(&damage);
-    }
+        pixman_region32_fini(&new_see_through);
+        pixman_region32_fini(&new_dimmed);
+        pixman_region32_fini(&damage);
+    }
+
+    else if (buf == term->render.last_overlay_buf &&
+             style == term->render.last_overlay_style)
+    {
+        xassert(style == OVERLAY_FLASH || style == OVERLAY_UNICODE_MODE);
+        shm_did_not_use_buf(buf);
+        return;
+    } else {
+        pixman_image_set_clip_region32(buf->pix[0], NULL);
+        damage_bounds = (pixman_box32_t){0, 0, buf->width, buf->height};
+    }
+
+    pixman_image_fill_rectangles(
+        PIXMAN_OP_SRC, buf->pix[0], &color, 1,
+        &(pixman_rectangle16_t){0, 0, term->width, term->height});
+
+    quirk_weston_subsurface_desync_on(overlay->sub);
+    wayl_surface_scale(
+        term->window, &overlay->surface, buf, term->scale);
+    wl_subsurface_set_position(overlay->sub, 0, 0);
+    wl_surface_attach(overlay->surface.surf, buf->wl_buf, 0, 0);
+
+    wl_surface_damage_buffer(
+        overlay->surface.surf,
+        damage_bounds.x1, damage_bounds.y1,
+        damage_bounds.x2 - damage_bounds.x1,
+        damage_bounds.y2 - damage_bounds.y1);
+
+    wl_surface_commit(overlay->surface.surf);
+    quirk_weston_subsurface_desync_off(overlay->sub);
+
+    buf->age = 0;
+    term->render.last_overlay_buf = buf;
+    term->render.last_overlay_style = style;
+}
+
+static void
+tile_caches_init(struct terminal *term)
+{
+    const size_t size = (size_t)term->conf->tweak.glyph_tile_cache_size_kb * 1024;
+    if (size == 0)
+        return;
+
+    /* One cache per render thread, main thread included */
+    const size_t count = 1 + term->render.workers.count;
+
+    term->render.tiles.caches = xcalloc(count, sizeof(term->render.tiles.caches[0]));
+    term->render.tiles.count = count;
+
+    for (size_t i = 0; i < count; i++)
+        term->render.tiles.caches[i] = tile_cache_new(size / count);
+}
+
+static void
+tile_caches_destroy(struct terminal *term)
+{
+    struct tile_cache_stats total = {0};
+
+    for (size_t i = 0; i < term->render.tiles.count; i++) {
+        struct tile_cache_stats stats;
+        tile_cache_get_stats(term->render.tiles.caches[i], &stats);
+
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.evictions += stats.evictions;
+        total.count += stats.count;
+        total.size += stats.size;
+
+        tile_cache_destroy(term->render.tiles.caches[i]);
+    }
+
+    if (total.hits + total.misses > 0) {
+        LOG_INFO("glyph tile cache: %zu hits, %zu misses (%.1f%% hit rate), "
+                 "%zu evictions, %zu tiles using %zu KiB",
+                 total.hits, total.misses,
+                 100. * total.hits / (total.hits + total.misses),
+                 total.evictions, total.count, total.size / 1024);
+    }
+
+    free(term->render.tiles.caches);
+    term->render.tiles.caches = NULL;
+    term->render.tiles.count = 0;
+}
+
+void
+render_tile_caches_flush(struct terminal *term)
+{
+    for (size_t i = 0; i < term->render.tiles.count; i++)
+        tile_cache_flush(term->render.tiles.caches[i]);
+}
+
+/*
+ * Render worker threads are shared by all terminal instances in the
+ * process. In server mode, this means the number of threads depends
+ * on the configured worker count (by default, the number of CPUs),
+ * rather than on the number of open windows.
+ *
+ * Frames are submitted from the main thread, and thus one at a
+ * time, in the order terminals are rendered. Each frame gets all
+ * (up to its terminal's configured worker count) threads to itself.
+ *
+ * Between frames, the main thread may also hand the threads other
+ * work (a "job"); see render_workers_run().
+ */
+struct render_pool {
+    size_t ref_count;
+
+    uint16_t count;
+    sem_t start;
+    sem_t done;
+    thrd_t *threads;
+    bool quit;
+
+    /* Current frame */
+    struct terminal *term;
+    struct buffer *buf;
+    int *rows;              /* Dirty rows (view relative) */
+    int row_count;
+    int rows_size;          /* Allocated size of 'rows' */
+    atomic_int next_row;    /* Index into 'rows' of next row to render */
+    atomic_int next_slot;   /* Next free pix/dirty index in 'buf' */
+
+    /* Current job, if any (instead of a frame) */
+    void (*job)(void *data);
+    void *job_data;
+};
+
+static struct render_pool *render_pool = NULL;
+
+int
+render_worker_thread(void *_ctx)
+{
+    struct render_worker_context *ctx = _ctx;
+    struct render_pool *pool = ctx->pool;
+    const int my_id = ctx->my_id;
+    free(ctx);
+
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    char proc_title[16];
+    snprintf(proc_title, sizeof(proc_title), "foot:render:%d", my_id);
+
+    if (pthread_setname_np(pthread_self(), proc_title) < 0)
+        LOG_ERRNO("render worker %d: failed to set process title", my_id);
+
+    while (true) {
+        sem_wait(&pool->start);
+
+        if (pool->quit)
+            return 0;
+
+        if (pool->job != NULL) {
+            pool->job(pool->job_data);
+            sem_post(&pool->done);
+            continue;
+        }
+
+        struct terminal *term = pool->term;
+        struct buffer *buf = pool->buf;
+        xassert(term != NULL);
+        xassert(buf != NULL);
+
+        /*
+         * Workers are woken in no particular order; claim one of the
+         * buffer's per-worker pix/damage slots (index 0 belongs to
+         * the main thread)
+         */
+        const int slot = 1 + atomic_fetch_add_explicit(
+            &pool->next_slot, 1, memory_order_relaxed);
+        xassert(slot <= term->render.workers.count);
+
+        /* Translate offset-relative cursor row to view-relative */
+        struct coord cursor = {-1, -1};
+        if (!term->hide_cursor) {
+            cursor = term->grid->cursor.point;
+            cursor.row += term->grid->offset;
+            cursor.row -= term->grid->view;
+            cursor.row &= term->grid->num_rows - 1;
+        }
+
+        /*
+         * The row list is written before, and not modified until
+         * after, the frame. Rows are claimed by atomically bumping
+         * the index of the next row; no lock needed.
+         */
+        const int *rows = pool->rows;
+        const int row_count = pool->row_count;
+
+        while (true) {
+            int idx = atomic_fetch_add_explicit(
+                &pool->next_row, 1, memory_order_relaxed);
+
+            if (idx >= row_count)
+                break;
+
+            int row_no = rows[idx];
+            struct row *row = grid_row_in_view(term->grid, row_no);
+            int cursor_col = cursor.row == row_no ? cursor.col : -1;
+
+            render_row(term, buf->pix[slot], &buf->dirty[slot],
+                       row, row_no, cursor_col, tile_cache_for_slot(term, slot));
+        }
+
+        sem_post(&pool->done);
+    };
+
+    return -1;
+}
+
+static void
+render_pool_stop_threads(struct render_pool *pool)
+{
+    pool->quit = true;
+    for (size_t i = 0; i < pool->count; i++)
+        sem_post(&pool->start);
+
+    for (size_t i = 0; i < pool->count; i++)
+        thrd_join(pool->threads[i], NULL);
+}
+
+static void
+render_pool_destroy(struct render_pool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    render_pool_stop_threads(pool);
+
+    free(pool->threads);
+    free(pool->rows);
+    sem_destroy(&pool->start);
+    sem_destroy(&pool->done);
+    free(pool);
+}
+
+static bool
+render_pool_grow(struct render_pool *pool, uint16_t count)
+{
+    if (count <= pool->count)
+        return true;
+
+    LOG_INFO("using %hu rendering threads", count);
+
+    pool->threads = xrealloc(pool->threads, count * sizeof(pool->threads[0]));
+
+    for (size_t i = pool->count; i < count; i++) {
+        struct render_worker_context *ctx = xmalloc(sizeof(*ctx));
+        *ctx = (struct render_worker_context) {
+            .pool = pool,
+            .my_id = 1 + i,
+        };
+
+        int ret = thrd_create(&pool->threads[i], &render_worker_thread, ctx);
+        if (ret != thrd_success) {
+            LOG_ERR("failed to create render worker thread: %s (%d)",
+                    thrd_err_as_string(ret), ret);
+            free(ctx);
 
-    else if (buf == term->render.last_overlay_buf &&
-             style == term->render.last_overlay_style)
-    {
-        xassert(style == OVERLAY_FLASH || style == OVERLAY_UNICODE_MODE);
-        shm_did_not_use_buf(buf);
-        return;
-    } else {
-        pixman_image_set_clip_region32(buf->pix[0], NULL);
-        damage_bounds = (pixman_box32_t){0, 0, buf->width, buf->height};
+            /* Only the threads started so far are living */
+            pool->count = i;
+            return false;
+        }
     }
 
-    pixman_image_fill_rectangles(
-        PIXMAN_OP_SRC, buf->pix[0], &color, 1,
-        &(pixman_rectangle16_t){0, 0, term->width, term->height});
+    pool->count = count;
+    return true;
+}
 
-    quirk_weston_subsurface_desync_on(overlay->sub);
-    wayl_surface_scale(
-        term->window, &overlay->surface, buf, term->scale);
-    wl_subsurface_set_position(overlay->sub, 0, 0);
-    wl_surface_attach(overlay->surface.surf, buf->wl_buf, 0, 0);
+static struct render_pool *
+render_pool_new(void)
+{
+    struct render_pool *pool = xcalloc(1, sizeof(*pool));
 
-    wl_surface_damage_buffer(
-        overlay->surface.surf,
-        damage_bounds.x1, damage_bounds.y1,
-        damage_bounds.x2 - damage_bounds.x1,
-        damage_bounds.y2 - damage_bounds.y1);
+    if (sem_init(&pool->start, 0, 0) < 0) {
+        LOG_ERRNO("failed to instantiate render worker semaphores");
+        free(pool);
+        return NULL;
+    }
 
-    wl_surface_commit(overlay->surface.surf);
-    quirk_weston_subsurface_desync_off(overlay->sub);
+    if (sem_init(&pool->done, 0, 0) < 0) {
+        LOG_ERRNO("failed to instantiate render worker semaphores");
+        sem_destroy(&pool->start);
+        free(pool);
+        return NULL;
+    }
 
-    buf->age = 0;
-    term->render.last_overlay_buf = buf;
-    term->render.last_overlay_style = style;
+    return pool;
 }
 
-int
-render_worker_thread(void *_ctx)
+bool
+render_workers_init(struct terminal *term)
 {
-    struct render_worker_context *ctx = _ctx;
-    struct terminal *term = ctx->term;
-    const int my_id = ctx->my_id;
-    free(ctx);
+    int err;
+    if ((err = mtx_init(&term->render.workers.lock, mtx_plain)) != thrd_success) {
+        LOG_ERR("failed to instantiate render worker mutex: %s (%d)",
+                thrd_err_as_string(err), err);
+        return false;
+    }
 
-    sigset_t mask;
-    sigfillset(&mask);
-    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+    if (term->render.workers.count == 0)
+        return true;
 
-    char proc_title[16];
-    snprintf(proc_title, sizeof(proc_title), "foot:render:%d", my_id);
+    if (render_pool == NULL) {
+        render_pool = render_pool_new();
+        if (render_pool == NULL)
+            return false;
+    }
 
-    if (pthread_setname_np(pthread_self(), proc_title) < 0)
-        LOG_ERRNO("render worker %d: failed to set process title", my_id);
+    render_pool->ref_count++;
+    term->render.workers.pool = render_pool;
+
+    if (!render_pool_grow(render_pool, term->render.workers.count)) {
+        /*
+         * Can't tear down the threads while other terminals may be
+         * using them; just don't use more threads than we've got
+         */
+        if (render_pool->ref_count > 1) {
+            uint16_t count = render_pool->count;
+            LOG_WARN("failed to grow render worker pool, "
+                     "continuing with %hu threads", count);
+            term->render.workers.count = min(term->render.workers.count, count);
+            return true;
+        }
+        return false;
+    }
 
-    sem_t *start = &term->render.workers.start;
-    sem_t *done = &term->render.workers.done;
-    mtx_t *lock = &term->render.workers.lock;
+    return true;
+}
 
-    while (true) {
-        sem_wait(start);
+void
+render_workers_destroy(struct terminal *term)
+{
+    struct render_pool *pool = term->render.workers.pool;
 
-        struct buffer *buf = term->render.workers.buf;
-        bool frame_done = false;
+    if (pool != NULL) {
+        xassert(pool == render_pool);
+        xassert(pool->ref_count > 0);
 
-        /* Translate offset-relative cursor row to view-relative */
-        struct coord cursor = {-1, -1};
-        if (!term->hide_cursor) {
-            cursor = term->grid->cursor.point;
-            cursor.row += term->grid->offset;
-            cursor.row -= term->grid->view;
-            cursor.row &= term->grid->num_rows - 1;
+        if (--pool->ref_count == 0) {
+            render_pool_destroy(pool);
+            render_pool = NULL;
         }
 
-        while (!frame_done) {
-            mtx_lock(lock);
-            xassert(tll_length(term->render.workers.queue) > 0);
+        term->render.workers.pool = NULL;
+    }
+
+    tile_caches_destroy(term);
+    mtx_destroy(&term->render.workers.lock);
+}
+
+bool
+render_workers_run(struct terminal *term, void (*job)(void *data), void *data)
+{
+    struct render_pool *pool = term->render.workers.count > 0
+        ? term->render.workers.pool : NULL;
 
-            int row_no = tll_pop_front(term->render.workers.queue);
-            mtx_unlock(lock);
+    if (pool == NULL)
+        return false;
 
-            switch (row_no) {
-            default: {
-                xassert(buf != NULL);
+    xassert(pool->term == NULL);
+    xassert(pool->job == NULL);
 
-                struct row *row = grid_row_in_view(term->grid, row_no);
-                int cursor_col = cursor.row == row_no ? cursor.col : -1;
+    pool->job = job;
+    pool->job_data = data;
 
-                render_row(term, buf->pix[my_id], &buf->dirty[my_id],
-                           row, row_no, cursor_col);
-                break;
-            }
+    for (size_t i = 0; i < term->render.workers.count; i++)
+        sem_post(&pool->start);
 
-            case -1:
-                frame_done = true;
-                sem_post(done);
-                break;
+    /* Don't just sit around waiting */
+    job(data);
 
-            case -2:
-                return 0;
-            }
-        }
-    };
+    for (size_t i = 0; i < term->render.workers.count; i++)
+        sem_wait(&pool->done);
 
-    return -1;
+    pool->job = NULL;
+    pool->job_data = NULL;
+    return true;
 }
 
 struct csd_data
@@ -3065,15 +3927,17 @@ reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old
             continue;
         }
 
-        bool row_all_dirty = true;
-        for (int c = 0; c < term->cols; c++) {
-            if (row->cells[c].attrs.clean) {
+        bool row_all_dirty =
+            row->dirty_start <= 0 && row->dirty_end >= term->cols - 1;
+
+        for (int c = 0; row_all_dirty && c < term->cols; c++) {
+            if (row->cells[c].attrs.clean)
                 row_all_dirty = false;
-                full_repaint_needed = false;
-                break;
-            }
         }
 
+        if (!row_all_dirty)
+            full_repaint_needed = false;
+
         if (row_all_dirty) {
             pixman_region32_union_rect(
                 &dirty, &dirty,
@@ -3126,11 +3990,16 @@ reapply_old_damage(struct terminal *term, struct buffer *new, struct buffer *old
 static void
 dirty_old_cursor(struct terminal *term)
 {
-    if (term->render.last_cursor.row != NULL && !term->render.last_cursor.hidden) {
+    /* A compacted row will be fully re-rendered when expanded */
+    if (term->render.last_cursor.row != NULL &&
+        term->render.last_cursor.row->compact == NULL &&
+        !term->render.last_cursor.hidden)
+    {
         struct row *row = term->render.last_cursor.row;
         struct cell *cell = &row->cells[term->render.last_cursor.col];
         cell->attrs.clean = 0;
-        row->dirty = true;
+        grid_row_dirty_range(
+            row, term->render.last_cursor.col, term->render.last_cursor.col);
     }
 
     /* Remember current cursor position, for the next frame */
@@ -3150,82 +4019,41 @@ dirty_cursor(struct terminal *term)
     struct row *row = grid_row(term->grid, cursor->row);
     struct cell *cell = &row->cells[cursor->col];
     cell->attrs.clean = 0;
-    row->dirty = true;
+    grid_row_dirty_range(row, cursor->col, cursor->col);
 }
 
-static void
-grid_render(struct terminal *term)
+void
+render_grid_to_buffer(struct terminal *term, struct buffer *buf,
+                      pixman_region32_t *damage)
 {
-    if (term->shutdown.in_progress)
-        return;
-
-    struct timespec start_time, start_double_buffering = {0}, stop_double_buffering = {0};
-
-    if (term->conf->tweak.render_timer != RENDER_TIMER_NONE)
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
-
-    xassert(term->width > 0);
-    xassert(term->height > 0);
-
-    struct buffer_chain *chain = term->render.chains.grid;
-    bool use_alpha = !term->window->is_fullscreen &&
-                     term->colors.alpha != 0xffff;
-    struct buffer *buf = shm_get_buffer(
-        chain, term->width, term->height, use_alpha);
-
-    /* Dirty old and current cursor cell, to ensure they're repainted */
-    dirty_old_cursor(term);
-    dirty_cursor(term);
-
-    if (term->render.last_buf == NULL ||
-        term->render.last_buf->width != buf->width ||
-        term->render.last_buf->height != buf->height ||
-        term->render.margins)
-    {
-        force_full_repaint(term, buf);
-    }
-
-    else if (buf->age > 0) {
-        LOG_DBG("buffer age: %u (%p)", buf->age, (void *)buf);
-
-        xassert(term->render.last_buf != NULL);
-        xassert(term->render.last_buf != buf);
-        xassert(term->render.last_buf->width == buf->width);
-        xassert(term->render.last_buf->height == buf->height);
-
-        clock_gettime(CLOCK_MONOTONIC, &start_double_buffering);
-        reapply_old_damage(term, buf, term->render.last_buf);
-        clock_gettime(CLOCK_MONOTONIC, &stop_double_buffering);
-    }
-
-    if (term->render.last_buf != NULL) {
-        shm_unref(term->render.last_buf);
-        term->render.last_buf = NULL;
-    }
-
-    term->render.last_buf = buf;
-    shm_addref(buf);
-    buf->age = 0;
+    if (unlikely(term->render.tiles.caches == NULL))
+        tile_caches_init(term);
 
+    /*
+     * Compact rows scrolled out into the scrollback, and re-compact
+     * the ones expanded by e.g. a scrollback search
+     */
+    if (term->normal.view == term->normal.offset && !term->is_searching)
+        grid_compact_scrollback(&term->normal, term->rows);
 
     tll_foreach(term->grid->scroll_damage, it) {
         switch (it->item.type) {
         case DAMAGE_SCROLL:
             if (term->grid->view == term->grid->offset)
-                grid_render_scroll(term, buf, &it->item);
+                grid_render_scroll(term, buf, damage, &it->item);
             break;
 
         case DAMAGE_SCROLL_REVERSE:
             if (term->grid->view == term->grid->offset)
-                grid_render_scroll_reverse(term, buf, &it->item);
+                grid_render_scroll_reverse(term, buf, damage, &it->item);
             break;
 
         case DAMAGE_SCROLL_IN_VIEW:
-            grid_render_scroll(term, buf, &it->item);
+            grid_render_scroll(term, buf, damage, &it->item);
             break;
 
         case DAMAGE_SCROLL_REVERSE_IN_VIEW:
-            grid_render_scroll_reverse(term, buf, &it->item);
+            grid_render_scroll_reverse(term, buf, damage, &it->item);
             break;
         }
 
@@ -3279,9 +4107,15 @@ grid_render(struct terminal *term)
             if (!row->dirty)
                 continue;
 
-            /* Loop row from left to right, looking for dirty cells */
-            for (struct cell *cell = &row->cells[0];
-                 cell < &row->cells[term->cols];
+            /*
+             * Loop row from left to right, looking for dirty
+             * cells. Cells outside the row's dirty span are known to
+             * be clean.
+             */
+            const int last_col = min(row->dirty_end, term->cols - 1);
+
+            for (struct cell *cell = &row->cells[max(row->dirty_start, 0)];
+                 cell <= &row->cells[last_col];
                  cell++)
             {
                 if (cell->attrs.clean)
@@ -3305,6 +4139,9 @@ grid_render(struct terminal *term)
                     if (!c->attrs.clean)
                         break;
                     c->attrs.clean = false;
+
+                    const int col = c - row->cells;
+                    grid_row_dirty_range(row, col, col);
                 }
 
                 /*
@@ -3321,7 +4158,10 @@ grid_render(struct terminal *term)
                  * glyphs again, in the outer loop.
                  */
                 for (; cell < &row->cells[term->cols]; cell++) {
+                    const int col = cell - row->cells;
                     cell->attrs.clean = false;
+                    grid_row_dirty_range(row, col, col);
+
                     if (cell->attrs.confined)
                         break;
                 }
@@ -3343,6 +4183,16 @@ grid_render(struct terminal *term)
             }
             if (all_clean)
                 BUG("row #%d is dirty, but all cells are marked as clean", r);
+
+            for (int c = 0; c < term->cols; c++) {
+                if (!row->cells[c].attrs.clean &&
+                    (c < row->dirty_start || c > row->dirty_end))
+                {
+                    BUG("row #%d: cell #%d is dirty, but outside the "
+                        "row's dirty span (%d-%d)",
+                        r, c, row->dirty_start, row->dirty_end);
+                }
+            }
         } else {
             for (int c = 0; c < term->cols; c++) {
                 if (!row->cells[c].attrs.clean)
@@ -3352,21 +4202,19 @@ grid_render(struct terminal *term)
     }
 #endif
 
-    pixman_region32_t damage;
-    pixman_region32_init(&damage);
+    render_sixel_images(term, buf->pix[0], damage, &cursor);
 
-    render_sixel_images(term, buf->pix[0], &damage, &cursor);
 
+    struct render_pool *pool = term->render.workers.count > 0
+        ? term->render.workers.pool : NULL;
 
-    if (term->render.workers.count > 0) {
-        mtx_lock(&term->render.workers.lock);
-        term->render.workers.buf = buf;
-        for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_post(&term->render.workers.start);
-
-        xassert(tll_length(term->render.workers.queue) == 0);
+    if (pool != NULL && pool->rows_size < term->rows) {
+        pool->rows = xrealloc(pool->rows, term->rows * sizeof(pool->rows[0]));
+        pool->rows_size = term->rows;
     }
 
+    int row_count = 0;
+
     for (int r = 0; r < term->rows; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
 
@@ -3375,31 +4223,107 @@ grid_render(struct terminal *term)
 
         row->dirty = false;
 
-        if (term->render.workers.count > 0)
-            tll_push_back(term->render.workers.queue, r);
+        if (pool != NULL)
+            pool->rows[row_count++] = r;
 
         else {
             /* TODO: damage region */
             int cursor_col = cursor.row == r ? cursor.col : -1;
-            render_row(term, buf->pix[0], &damage, row, r, cursor_col);
+            render_row(term, buf->pix[0], damage, row, r, cursor_col,
+                       tile_cache_for_slot(term, 0));
         }
     }
 
-    /* Signal workers the frame is done */
-    if (term->render.workers.count > 0) {
+    if (row_count > 0) {
+        xassert(pool->term == NULL);
+
+        pool->term = term;
+        pool->buf = buf;
+        pool->row_count = row_count;
+        atomic_store_explicit(&pool->next_row, 0, memory_order_relaxed);
+        atomic_store_explicit(&pool->next_slot, 0, memory_order_relaxed);
+
+        /* Wake the workers; the semaphore orders the writes above
+         * before the workers' reads */
         for (size_t i = 0; i < term->render.workers.count; i++)
-            tll_push_back(term->render.workers.queue, -1);
-        mtx_unlock(&term->render.workers.lock);
+            sem_post(&pool->start);
 
         for (size_t i = 0; i < term->render.workers.count; i++)
-            sem_wait(&term->render.workers.done);
-        term->render.workers.buf = NULL;
+            sem_wait(&pool->done);
+
+        pool->term = NULL;
+        pool->buf = NULL;
+        pool->row_count = 0;
     }
 
     for (size_t i = 0; i < term->render.workers.count; i++)
-        pixman_region32_union(&damage, &damage, &buf->dirty[i + 1]);
+        pixman_region32_union(damage, damage, &buf->dirty[i + 1]);
+
+    pixman_region32_union(&buf->dirty[0], &buf->dirty[0], damage);
+}
+
+static void
+grid_render(struct terminal *term)
+{
+    if (term->shutdown.in_progress)
+        return;
+
+    struct timespec start_time, start_double_buffering = {0}, stop_double_buffering = {0};
+
+    if (term->conf->tweak.render_timer != RENDER_TIMER_NONE)
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    term->render.scroll_cost.shm_count = 0;
+    term->render.scroll_cost.memmove_count = 0;
+    term->render.scroll_cost.ns = 0;
+
+    xassert(term->width > 0);
+    xassert(term->height > 0);
+
+    struct buffer_chain *chain = term->render.chains.grid;
+    bool use_alpha = !term->window->is_fullscreen &&
+                     term->colors.alpha != 0xffff;
+    struct buffer *buf = shm_get_buffer(
+        chain, term->width, term->height, use_alpha);
+
+    /* Dirty old and current cursor cell, to ensure they're repainted */
+    dirty_old_cursor(term);
+    dirty_cursor(term);
+
+    if (term->render.last_buf == NULL ||
+        term->render.last_buf->width != buf->width ||
+        term->render.last_buf->height != buf->height ||
+        term->render.margins)
+    {
+        force_full_repaint(term, buf);
+    }
+
+    else if (buf->age > 0) {
+        LOG_DBG("buffer age: %u (%p)", buf->age, (void *)buf);
+
+        xassert(term->render.last_buf != NULL);
+        xassert(term->render.last_buf != buf);
+        xassert(term->render.last_buf->width == buf->width);
+        xassert(term->render.last_buf->height == buf->height);
+
+        clock_gettime(CLOCK_MONOTONIC, &start_double_buffering);
+        reapply_old_damage(term, buf, term->render.last_buf);
+        clock_gettime(CLOCK_MONOTONIC, &stop_double_buffering);
+    }
+
+    if (term->render.last_buf != NULL) {
+        shm_unref(term->render.last_buf);
+        term->render.last_buf = NULL;
+    }
+
+    term->render.last_buf = buf;
+    shm_addref(buf);
+    buf->age = 0;
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
 
-    pixman_region32_union(&buf->dirty[0], &buf->dirty[0], &damage);
+    render_grid_to_buffer(term, buf, &damage);
 
     {
         int box_count = 0;
@@ -3444,6 +4368,28 @@ grid_render(struct terminal *term)
                 render_time.tv_nsec,
                 (long)double_buffering_time.tv_sec,
                 double_buffering_time.tv_nsec);
+
+            if (term->render.scroll_cost.shm_count > 0 ||
+                term->render.scroll_cost.memmove_count > 0)
+            {
+                /* Estimates of the most recently used model */
+                const struct scroll_cost_model *model = NULL;
+                for (size_t i = 0; i < ALEN(term->render.scroll_cost.models); i++) {
+                    const struct scroll_cost_model *m =
+                        &term->render.scroll_cost.models[i];
+                    if (model == NULL || m->last_used > model->last_used)
+                        model = m;
+                }
+
+                LOG_INFO(
+                    "  scroll damage: %uxSHM, %uxmemmove in %9"PRIu64"ns "
+                    "(estimated cost: SHM %.3f ns/KB, memmove %.3f ns/KB)",
+                    term->render.scroll_cost.shm_count,
+                    term->render.scroll_cost.memmove_count,
+                    term->render.scroll_cost.ns,
+                    model->shm.ns_per_byte * 1024,
+                    model->memmove.ns_per_byte * 1024);
+            }
             break;
 
         case RENDER_TIMER_OSD:
@@ -3563,8 +4509,12 @@ render_search_box(struct terminal *term)
         widths[i] = max(0, c32width(text[i]));
     widths[text_len] = 0;
 
+    /* Regex mode is indicated by a marker, before the search string */
+    static const char32_t regex_marker[] = U".* ";
+    const size_t marker_cells = term->search.regex ? ALEN(regex_marker) - 1 : 0;
+
     const size_t total_cells = c32swidth(text, text_len);
-    const size_t wanted_visible_cells = max(20, total_cells);
+    const size_t wanted_visible_cells = max(20, marker_cells + total_cells);
 
     const float scale = term->scale;
     xassert(scale >= 1.);
@@ -3582,7 +4532,8 @@ render_search_box(struct terminal *term)
         term->width - 2 * margin,
         margin + wanted_visible_cells * term->cell_width + margin);
 
-    const size_t visible_cells = (visible_width - 2 * margin) / term->cell_width;
+    const size_t box_cells = (visible_width - 2 * margin) / term->cell_width;
+    const size_t visible_cells = box_cells - min(marker_cells, box_cells);
     size_t glyph_offset = term->render.search_glyph_offset;
 
     struct buffer_chain *chain = term->render.chains.search;
@@ -3632,6 +4583,22 @@ render_search_box(struct terminal *term)
            : term->conf->colors.search_box.no_match.fg)
         : term->colors.table[0]);
 
+    for (size_t i = 0; i < marker_cells; i++) {
+        const struct fcft_glyph *glyph = fcft_rasterize_char_utf32(
+            font, regex_marker[i], term->font_subpixel);
+
+        if (glyph != NULL) {
+            pixman_image_t *src = pixman_image_create_solid_fill(&fg);
+            pixman_image_composite32(
+                PIXMAN_OP_OVER, src, glyph->pix, buf->pix[0], 0, 0, 0, 0,
+                x + x_ofs + glyph->x, y + term->font_baseline - glyph->y,
+                glyph->width, glyph->height);
+            pixman_image_unref(src);
+        }
+
+        x += term->cell_width;
+    }
+
     /* Move offset we start rendering at, to ensure the cursor is visible */
     for (size_t i = 0, cell_idx = 0; i <= term->search.cursor; cell_idx += widths[i], i++) {
         if (i != term->search.cursor)
@@ -4176,6 +5143,8 @@ delayed_reflow_of_normal_grid(struct terminal *term)
         &term->selection.coords.end,
     };
 
+    term_text_streams_snapshot(term);
+
     /* Reflow the original (since before the resize was started) grid,
      * to the *current* dimensions */
     grid_resize_and_reflow(
@@ -4191,6 +5160,8 @@ delayed_reflow_of_normal_grid(struct terminal *term)
     term->normal = *term->interactive_resizing.grid;
     free(term->interactive_resizing.grid);
 
+    term_reflow_pending_schedule(term);
+
     term->hide_cursor = term->interactive_resizing.old_hide_cursor;
 
     /* Reset */
@@ -4490,6 +5461,9 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
         goto damage_view;
     }
 
+    /* Text streams read directly from the grid */
+    term_text_streams_snapshot(term);
+
 
     /*
      * Since text reflow is slow, don't do it *while* resizing. Only
@@ -4559,6 +5533,7 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
              i++, j = (j + 1) & (orig->num_rows - 1))
         {
             g.rows[i] = grid_row_alloc(g.num_cols, false);
+            grid_row_uncompact(orig, orig->rows[j]);
             memcpy(g.rows[i]->cells,
                    orig->rows[j]->cells,
                    g.num_cols * sizeof(g.rows[i]->cells[0]));
@@ -4656,6 +5631,8 @@ render_resize(struct terminal *term, int width, int height, uint8_t opts)
             &term->normal, new_normal_grid_rows, new_cols, old_normal_rows, new_rows,
             term->selection.coords.end.row >= 0 ? ALEN(tracking_points) : 0,
             tracking_points);
+
+        term_reflow_pending_schedule(term);
     }
 
     grid_resize_without_reflow(
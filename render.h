@@ -35,10 +35,36 @@ void render_overlay(struct terminal *term);
 
 struct render_worker_context {
     int my_id;
-    struct terminal *term;
+    struct render_pool *pool;
 };
 int render_worker_thread(void *_ctx);
 
+bool render_workers_init(struct terminal *term);
+void render_workers_destroy(struct terminal *term);
+
+/*
+ * Runs 'job' on each of the terminal's render worker threads, and on
+ * the calling (main) thread, and waits for all of them to return. The
+ * job is expected to split its work between the threads itself, e.g.
+ * with an atomic counter.
+ *
+ * Returns false, without running the job, if the terminal has no
+ * worker threads.
+ */
+bool render_workers_run(
+    struct terminal *term, void (*job)(void *data), void *data);
+
+/* Must be called whenever the fonts, or the cell size, change */
+void render_tile_caches_flush(struct terminal *term);
+
+/*
+ * Renders the grid's scroll damage, and all dirty rows, to 'buf',
+ * without touching the Wayland surface. Damaged areas are added to
+ * 'damage'.
+ */
+void render_grid_to_buffer(
+    struct terminal *term, struct buffer *buf, pixman_region32_t *damage);
+
 struct csd_data {
     int x;
     int y;
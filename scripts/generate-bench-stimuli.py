@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import random
+import sys
+
+
+def compiler_log(out, opts, rnd):
+    """Build output; progress lines, and colored GCC diagnostics"""
+    words = ['buffer', 'render', 'grid', 'row', 'cell', 'parse', 'state',
+             'alloc', 'free', 'count', 'width', 'height', 'index', 'term']
+    dirs = ['src', 'src/core', 'src/render', 'lib/util', 'tests']
+
+    total = 2000
+    step = 0
+    while out.tell() < opts.size:
+        step = step % total + 1
+        d = rnd.choice(dirs)
+        name = f'{rnd.choice(words)}-{rnd.choice(words)}'
+        out.write(f'[{step}/{total}] Compiling C object '
+                  f'{d}/lib{rnd.choice(words)}.a.p/{name}.c.o\n')
+
+        if rnd.randrange(8) != 0:
+            continue
+
+        kind, color = rnd.choice([('warning', '35'), ('error', '31'),
+                                  ('note', '36')])
+        line = rnd.randrange(1, 5000)
+        col = rnd.randrange(1, 80)
+        var = '_'.join(rnd.choice(words) for _ in range(2))
+        src = f'    int {var} = {rnd.choice(words)}->{rnd.choice(words)};'
+
+        out.write(f'\033[01m\033[K{d}/{name}.c:{line}:{col}:\033[m\033[K '
+                  f'\033[01;{color}m\033[K{kind}:\033[m\033[K unused variable '
+                  f'‘\033[01m\033[K{var}\033[m\033[K’ '
+                  f'[\033[01;{color}m\033[K-Wunused-variable\033[m\033[K]\n')
+        out.write(f' {line:4} | {src}\n')
+        out.write(f'      |     \033[01;{color}m\033[K^~~~\033[m\033[K\n')
+
+
+def ls_lr(out, opts, rnd):
+    """ls -lR --color=always style listing"""
+    names = ['README', 'Makefile', 'main', 'config', 'util', 'data',
+             'notes', 'index', 'test', 'vendor', 'build', 'docs']
+    exts = ['', '.c', '.h', '.txt', '.md', '.py', '.json', '.o', '.so']
+    months = ['Jan', 'Feb', 'Mar', 'Apr', 'May', 'Jun',
+              'Jul', 'Aug', 'Sep', 'Oct', 'Nov', 'Dec']
+
+    path = '.'
+    while out.tell() < opts.size:
+        entries = rnd.randrange(2, 40)
+        out.write(f'{path}:\ntotal {entries * 4}\n')
+
+        subdirs = []
+        for _ in range(entries):
+            is_dir = rnd.randrange(5) == 0
+            name = rnd.choice(names) + ('' if is_dir else rnd.choice(exts))
+            mode = 'drwxr-xr-x' if is_dir else rnd.choice(
+                ['-rw-r--r--', '-rwxr-xr-x', '-rw-------'])
+            size = 4096 if is_dir else rnd.randrange(0, 10**7)
+            stamp = (f'{rnd.choice(months)} {rnd.randrange(1, 29):2} '
+                     f'{rnd.randrange(24):02}:{rnd.randrange(60):02}')
+
+            if is_dir:
+                colored = f'\033[01;34m{name}\033[0m'
+                subdirs.append(name)
+            elif mode[3] == 'x':
+                colored = f'\033[01;32m{name}\033[0m'
+            else:
+                colored = name
+
+            out.write(f'{mode} {rnd.randrange(1, 9)} user group '
+                      f'{size:8} {stamp} {colored}\n')
+
+        out.write('\n')
+        path = os.path.join(path, rnd.choice(subdirs)) if subdirs else '.'
+        if path.count('/') > 6:
+            path = '.'
+
+
+def cjk(out, opts, rnd):
+    """UTF-8 encoded CJK text (double width characters)"""
+    ranges = [(0x4e00, 0x9fff), (0x3041, 0x3096), (0x30a1, 0x30fa),
+              (0xac00, 0xd7a3)]
+    punct = '、。「」（）'
+
+    while out.tell() < opts.size:
+        length = rnd.randrange(1, opts.cols)
+        chars = []
+        for _ in range(length):
+            if rnd.randrange(16) == 0:
+                chars.append(rnd.choice(punct))
+            else:
+                lo, hi = rnd.choice(ranges)
+                chars.append(chr(rnd.randrange(lo, hi + 1)))
+        out.write(''.join(chars) + '\n')
+
+
+def emoji_zwj(out, opts, rnd):
+    """Emoji; ZWJ sequences, skin tone modifiers, flags, VS-16"""
+    zwj = '\u200d'
+    people = ['👨', '👩', '🧒', '👧', '👦']
+    tones = ['', '🏻', '🏼', '🏽', '🏾', '🏿']
+    jobs = ['🔬', '💻', '🚀', '🎨', '🍳', '🌾']
+    flags = ['🇸🇪', '🇳🇴', '🇫🇮', '🇩🇰', '🇮🇸', '🇯🇵']
+    vs16 = ['❤️', '☀️', '✈️', '☎️', '✏️']
+
+    while out.tell() < opts.size:
+        words = []
+        for _ in range(rnd.randrange(1, opts.cols // 4)):
+            kind = rnd.randrange(5)
+            if kind == 0:
+                words.append(zwj.join(rnd.choice(people)
+                                      for _ in range(rnd.randrange(2, 5))))
+            elif kind == 1:
+                words.append(rnd.choice(people) + rnd.choice(tones) +
+                             zwj + rnd.choice(jobs))
+            elif kind == 2:
+                words.append(rnd.choice(flags))
+            elif kind == 3:
+                words.append(rnd.choice(vs16))
+            else:
+                words.append('text')
+        out.write(' '.join(words) + '\n')
+
+
+def sgr(out, opts, rnd):
+    """Dense SGR changes; every couple of characters changes attributes"""
+    alphabet = 'abcdefghijklmnopqrstuvwxyz0123456789 (){};=+-*/'
+
+    while out.tell() < opts.size:
+        line = []
+        width = 0
+        while width < opts.cols:
+            kind = rnd.randrange(6)
+            if kind == 0:
+                line.append(f'\033[{rnd.randrange(30, 38)};'
+                            f'{rnd.randrange(40, 48)}m')
+            elif kind == 1:
+                line.append(f'\033[38;5;{rnd.randrange(256)}m')
+            elif kind == 2:
+                line.append(f'\033[38:2::{rnd.randrange(256)}:'
+                            f'{rnd.randrange(256)}:{rnd.randrange(256)}m')
+            elif kind == 3:
+                line.append(f'\033[{rnd.choice([1, 3, 4, 7, 9])}m')
+            elif kind == 4:
+                line.append(f'\033[4:{rnd.randrange(1, 6)}m'
+                            f'\033[58:5:{rnd.randrange(256)}m')
+            else:
+                line.append('\033[m')
+
+            count = min(rnd.randrange(1, 8), opts.cols - width)
+            line.append(''.join(rnd.choice(alphabet) for _ in range(count)))
+            width += count
+
+        out.write(''.join(line) + '\033[m\n')
+
+
+def sixel(out, opts, rnd):
+    """Sixel images, with a mix of literal sixels and repeat sequences"""
+    sixels = '?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~'
+    width = opts.cols * 8
+    height = opts.rows * 15
+
+    while out.tell() < opts.size:
+        six_width = rnd.randrange(16, width // 2)
+        six_height = rnd.randrange(16, height // 2)
+
+        out.write('\033[H')
+        out.write(f'\033P;{rnd.randrange(2)}q"1;1;{six_width};{six_height}')
+
+        for idx in range(16):
+            out.write(f'#{idx};2;{rnd.randrange(101)};{rnd.randrange(101)};'
+                      f'{rnd.randrange(101)}')
+
+        for row in range((six_height + 5) // 6):
+            bands = rnd.randrange(1, 5)
+            for band in range(bands):
+                out.write(f'#{rnd.randrange(16)}')
+
+                left = six_width
+                while left > 0:
+                    count = min(left, rnd.randrange(1, 32))
+                    if count > 3:
+                        out.write(f'!{count}{rnd.choice(sixels)}')
+                    else:
+                        out.write(''.join(rnd.choice(sixels)
+                                          for _ in range(count)))
+                    left -= count
+
+                out.write('$' if band + 1 < bands else '-')
+
+        out.write('\033\\')
+
+
+def scroll_region(out, opts, rnd):
+    """Scroll region thrashing; DECSTBM, IND/RI, SU/SD, IL/DL"""
+    alphabet = 'abcdefghijklmnopqrstuvwxyz0123456789 '
+
+    while out.tell() < opts.size:
+        top = rnd.randrange(1, opts.rows // 2)
+        bottom = rnd.randrange(opts.rows // 2 + 1, opts.rows + 1)
+        out.write(f'\033[{top};{bottom}r')
+
+        for _ in range(rnd.randrange(1, 64)):
+            kind = rnd.randrange(6)
+            if kind == 0:
+                out.write(f'\033[{bottom};1H' + '\n' * rnd.randrange(1, 8))
+            elif kind == 1:
+                out.write(f'\033[{top};1H' + '\033M' * rnd.randrange(1, 8))
+            elif kind == 2:
+                out.write(f'\033[{rnd.randrange(1, 8)}S')
+            elif kind == 3:
+                out.write(f'\033[{rnd.randrange(1, 8)}T')
+            elif kind == 4:
+                out.write(f'\033[{rnd.randrange(top, bottom + 1)};1H'
+                          f'\033[{rnd.randrange(1, 4)}'
+                          f'{rnd.choice(["L", "M"])}')
+            else:
+                out.write(f'\033[{rnd.randrange(top, bottom + 1)};1H')
+                out.write(''.join(rnd.choice(alphabet)
+                                  for _ in range(rnd.randrange(opts.cols))))
+
+    out.write('\033[r')
+
+
+CORPORA = {
+    'compiler-log': compiler_log,
+    'ls-lR': ls_lr,
+    'cjk': cjk,
+    'emoji-zwj': emoji_zwj,
+    'sgr': sgr,
+    'sixel': sixel,
+    'scroll-region': scroll_region,
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Generate stimuli files for foot-bench')
+    parser.add_argument('outdir', help='directory to write stimuli files to')
+    parser.add_argument('--cols', type=int, default=135)
+    parser.add_argument('--rows', type=int, default=67)
+    parser.add_argument('--size', type=int, default=4 * 1024**2,
+                        help='approximate size, in bytes, of each file')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('corpora', nargs='*', metavar='CORPUS',
+                        help=f'corpora to generate (default: all); '
+                             f'one of: {", ".join(CORPORA)}')
+
+    opts = parser.parse_intermixed_args()
+
+    for name in opts.corpora:
+        if name not in CORPORA:
+            parser.error(f'{name}: invalid corpus')
+
+    for name in opts.corpora or CORPORA:
+        # Seed per corpus, to make each file independent of which
+        # other files are generated
+        rnd = random.Random(f'{opts.seed}-{name}')
+
+        # Emulate the TTY's output processing (ONLCR), since the
+        # files are fed directly to the VT parser
+        path = os.path.join(opts.outdir, f'{name}.vt')
+        with open(path, 'w', encoding='utf-8', newline='\r\n') as out:
+            CORPORA[name](out, opts, rnd)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
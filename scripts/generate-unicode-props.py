@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+
+import argparse
+import re
+import sys
+
+
+MAX_CODEPOINT = 0x10ffff
+BLOCK_SHIFT = 8
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+
+# Format characters (Cf) that are nevertheless visible (the
+# Prepended_Concatenation_Mark property, from PropList.txt)
+PREPENDED_CONCATENATION_MARKS = {
+    *range(0x600, 0x606), 0x6dd, 0x70f, 0x890, 0x891, 0x8e2, 0x110bd,
+    0x110cd,
+}
+
+
+class UCD:
+    """
+    The properties we need, parsed from UnicodeData.txt and
+    EastAsianWidth.txt (the Unicode Character Database, see the
+    unicode-data-dir meson option). The host's unicodedata module is
+    not used, since its Unicode version (and its unassigned codepoint
+    widths) depends on the Python version.
+    """
+    def __init__(self, unicode_data, east_asian_width):
+        self.version = None
+        self.category: dict[int, str] = {}
+        self.lower: dict[int, int] = {}
+        self.east_asian_width: dict[int, str] = {}
+
+        range_first = None
+        for line in unicode_data:
+            fields = line.rstrip('\n').split(';')
+            if len(fields) < 15:
+                continue
+
+            cp = int(fields[0], 16)
+            name = fields[1]
+            category = fields[2]
+
+            if name.endswith(', First>'):
+                range_first = cp
+                continue
+
+            if name.endswith(', Last>'):
+                assert range_first is not None
+                for c in range(range_first, cp + 1):
+                    self.category[c] = category
+                range_first = None
+                continue
+
+            self.category[cp] = category
+            if fields[13]:
+                self.lower[cp] = int(fields[13], 16)
+
+        missing = re.compile(
+            r'^#\s*@missing:\s*([0-9A-F]+)\.\.([0-9A-F]+)\s*;\s*(\w+)')
+        version = re.compile(r'^#\s*EastAsianWidth-(\d+\.\d+\.\d+)\.txt')
+
+        for line in east_asian_width:
+            if m := version.match(line):
+                self.version = m.group(1)
+                continue
+
+            # Default values for unlisted codepoints
+            if m := missing.match(line):
+                first, last, value = m.groups()
+                for cp in range(int(first, 16), int(last, 16) + 1):
+                    self.east_asian_width[cp] = value
+                continue
+
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+
+            cps, value = (x.strip() for x in line.split(';'))
+            first, _, last = cps.partition('..')
+            for cp in range(int(first, 16), int(last or first, 16) + 1):
+                self.east_asian_width[cp] = value
+
+    def width(self, cp: int) -> int:
+        """
+        wcwidth(3)-like width of a single codepoint:
+
+          -1: control characters, surrogates and noncharacters
+           0: NUL, combining marks, format characters, Hangul medial
+              vowels/final consonants and ZERO WIDTH SPACE
+           2: East Asian Wide and Fullwidth (this includes all emojis
+              with default emoji presentation)
+           1: everything else, including unassigned codepoints
+        """
+        if cp == 0:
+            return 0
+        if cp < 0x20 or 0x7f <= cp < 0xa0:
+            return -1
+
+        cat = self.category.get(cp, 'Cn')
+
+        if cat == 'Cs':
+            return -1
+        if 0xfdd0 <= cp <= 0xfdef or (cp & 0xfffe) == 0xfffe:
+            return -1
+        if cat == 'Cn':
+            # Unassigned; even in blocks/planes defaulting to wide
+            return 1
+        if cp == 0xad:  # SOFT HYPHEN
+            return 1
+        if cp in PREPENDED_CONCATENATION_MARKS:
+            return 1
+        if cat in ('Mn', 'Me', 'Cf'):
+            return 0
+        if 0x1160 <= cp <= 0x11ff or cp == 0x200b:
+            return 0
+        if self.east_asian_width.get(cp, 'N') in ('W', 'F'):
+            return 2
+        return 1
+
+    def fold(self, cp: int) -> int:
+        """
+        Simple (single codepoint) lower case mapping, or the codepoint
+        itself if there is none.
+        """
+        return self.lower.get(cp, cp)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('unicode_data', type=argparse.FileType('r'))
+    parser.add_argument('east_asian_width', type=argparse.FileType('r'))
+    parser.add_argument('output', type=argparse.FileType('w'))
+    opts = parser.parse_args()
+
+    ucd = UCD(opts.unicode_data, opts.east_asian_width)
+    assert ucd.version is not None
+
+    props: dict[tuple[int, int], int] = {}
+    blocks: dict[tuple[int, ...], int] = {}
+    stage1: list[int] = []
+    stage2: list[int] = []
+
+    for block_start in range(0, MAX_CODEPOINT + 1, BLOCK_SIZE):
+        block = []
+        for cp in range(block_start, block_start + BLOCK_SIZE):
+            prop = (ucd.width(cp), ucd.fold(cp) - cp)
+            if prop not in props:
+                props[prop] = len(props)
+            block.append(props[prop])
+
+        block = tuple(block)
+        if block not in blocks:
+            blocks[block] = len(blocks)
+            stage2.extend(block)
+        stage1.append(blocks[block])
+
+    assert len(props) <= 256
+    assert len(blocks) <= 65536
+
+    out = opts.output
+    out.write('#pragma once\n')
+    out.write('\n')
+    out.write(f'/* Generated from Unicode {ucd.version} */\n')
+    out.write('\n')
+    out.write('#include <stdint.h>\n')
+    out.write('\n')
+    out.write(f'_Static_assert(C32_PROPS_BLOCK_SHIFT == {BLOCK_SHIFT}, '
+              '"block size mismatch");\n')
+    out.write('\n')
+
+    out.write(f'const struct c32_props c32_props_table[{len(props)}] = {{\n')
+    for (w, delta), _ in sorted(props.items(), key=lambda x: x[1]):
+        out.write(f'    {{.width = {w}, .fold_delta = {delta}}},\n')
+    out.write('};\n')
+    out.write('\n')
+
+    out.write(f'const uint16_t c32_props_stage1[{len(stage1)}] = {{\n')
+    for i in range(0, len(stage1), 12):
+        out.write('    ' + ' '.join(f'{x},' for x in stage1[i:i + 12]) + '\n')
+    out.write('};\n')
+    out.write('\n')
+
+    out.write(f'const uint8_t c32_props_stage2[{len(stage2)}] = {{\n')
+    for i in range(0, len(stage2), 16):
+        out.write('    ' + ' '.join(f'{x},' for x in stage2[i:i + 16]) + '\n')
+    out.write('};\n')
+
+
+if __name__ == '__main__':
+    sys.exit(main())
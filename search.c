@@ -1,5 +1,6 @@
 #include "search.h"
 
+#include <stdatomic.h>
 #include <string.h>
 
 #include <wayland-client.h>
@@ -17,6 +18,7 @@
 #include "key-binding.h"
 #include "misc.h"
 #include "quirks.h"
+#include "regex-dfa.h"
 #include "render.h"
 #include "selection.h"
 #include "shm.h"
@@ -96,6 +98,234 @@ has_wrapped_around_right(const struct terminal *term, int abs_row_no)
     return rebased_row == 0;
 }
 
+/*
+ * Search text index
+ *
+ * Each searched row gets a case folded copy of its text, with one
+ * unit per character. A composed cell contributes its whole chain,
+ * spacer cells contribute nothing, and empty cells are stored as
+ * spaces. Only the first character of a chain is case folded; the
+ * remaining ones are matched as-is.
+ *
+ * Rows with one character per cell, all of them in Latin-1 after
+ * folding (i.e. the vast majority), store their units as bytes, with
+ * unit index == column. Other rows store char32_t units, and the
+ * column of each unit.
+ *
+ * The index is built on demand, re-built if the row has been marked
+ * dirty since, and freed when search mode is exited.
+ */
+struct row_search_text {
+    int len;
+    bool wide;  /* 'text' is char32_t, not uint8_t */
+    int *cols;  /* Column of each unit, NULL if unit index == column */
+    void *text;
+
+    /* First/last cell is empty (used to find logical lines) */
+    bool first_empty;
+    bool last_empty;
+};
+
+static struct row_search_text *
+row_search_text(const struct terminal *term, struct row *row)
+{
+    if (likely(row->search_text != NULL && !row->search_text_stale))
+        return row->search_text;
+
+    free(row->search_text);
+
+    const int cols = term->cols;
+    struct cell scratch[row->compact != NULL ? cols : 1];
+    const struct cell *cells = grid_row_peek_cells(row, scratch);
+
+    int len = 0;
+    bool simple = true;
+    bool wide = false;
+
+    for (int c = 0; c < cols; c++) {
+        const char32_t wc = cells[c].wc;
+
+        if (wc >= CELL_SPACER)
+            simple = false;
+        else if (wc >= CELL_COMB_CHARS_LO) {
+            const struct composed *composed = composed_lookup(
+                &term->composed, wc - CELL_COMB_CHARS_LO);
+            len += composed->count;
+            simple = false;
+            wide = true;
+        } else {
+            if (c32fold(wc) > 0xff)
+                wide = true;
+            len++;
+        }
+    }
+
+    const size_t cols_size = simple ? 0 : len * sizeof(int);
+    const size_t text_size = len * (wide ? sizeof(char32_t) : sizeof(uint8_t));
+
+    struct row_search_text *text = xmalloc(
+        sizeof(*text) + cols_size + text_size);
+    text->len = len;
+    text->wide = wide;
+    text->cols = simple ? NULL : (int *)(text + 1);
+    text->text = (uint8_t *)(text + 1) + cols_size;
+    text->first_empty = cells[0].wc == 0;
+    text->last_empty = cells[cols - 1].wc == 0;
+
+    char32_t *text32 = text->text;
+    uint8_t *text8 = text->text;
+
+    for (int c = 0, i = 0; c < cols; c++) {
+        char32_t wc = cells[c].wc;
+        const char32_t *chars = &wc;
+        size_t count = 1;
+
+        if (wc >= CELL_SPACER)
+            continue;
+
+        if (wc >= CELL_COMB_CHARS_LO) {
+            const struct composed *composed = composed_lookup(
+                &term->composed, wc - CELL_COMB_CHARS_LO);
+            chars = composed->chars;
+            count = composed->count;
+        }
+
+        for (size_t j = 0; j < count; j++, i++) {
+            char32_t unit = chars[j];
+
+            if (j == 0)
+                unit = unit == 0 ? U' ' : c32fold(unit);
+
+            if (wide)
+                text32[i] = unit;
+            else
+                text8[i] = unit;
+
+            if (!simple)
+                text->cols[i] = c;
+        }
+    }
+
+    row->search_text = text;
+    row->search_text_stale = false;
+    return text;
+}
+
+static void
+search_text_free_all(struct grid *grid)
+{
+    for (int r = 0; r < grid->num_rows; r++) {
+        struct row *row = grid->rows[r];
+        if (row == NULL)
+            continue;
+
+        free(row->search_text);
+        row->search_text = NULL;
+    }
+}
+
+/*
+ * (Re-)compiles the search buffer, unless it hasn't changed since the
+ * last time. Returns false if it isn't a valid regular expression.
+ */
+static bool
+regex_compile(struct terminal *term)
+{
+    char *source = ac32tombs(term->search.buf);
+    if (source == NULL)
+        return false;
+
+    if (term->search.re.source != NULL &&
+        strcmp(source, term->search.re.source) == 0)
+    {
+        free(source);
+        return term->search.re.valid;
+    }
+
+    if (term->search.re.valid)
+        regfree(&term->search.re.compiled);
+
+    regex_dfa_destroy(term->search.re.dfa);
+    term->search.re.dfa = NULL;
+
+    free(term->search.re.source);
+    term->search.re.source = source;
+
+    int ret = regcomp(
+        &term->search.re.compiled, source,
+        REG_EXTENDED | REG_ICASE | REG_NEWLINE);
+
+    if (ret != 0) {
+        char msg[128];
+        regerror(ret, &term->search.re.compiled, msg, sizeof(msg));
+        LOG_DBG("%s: invalid regular expression: %s", source, msg);
+    } else
+        term->search.re.dfa = regex_dfa_compile(source, true);
+
+    term->search.re.valid = ret == 0;
+    return term->search.re.valid;
+}
+
+static void
+regex_free(struct terminal *term)
+{
+    if (term->search.re.valid)
+        regfree(&term->search.re.compiled);
+
+    regex_dfa_destroy(term->search.re.dfa);
+    free(term->search.re.source);
+    free(term->search.re.text);
+    free(term->search.re.pos);
+
+    term->search.re.source = NULL;
+    term->search.re.valid = false;
+    term->search.re.dfa = NULL;
+    term->search.re.text = NULL;
+    term->search.re.pos = NULL;
+    term->search.re.size = 0;
+}
+
+static inline char32_t
+unit_at(const struct row_search_text *text, int i)
+{
+    return text->wide
+        ? ((const char32_t *)text->text)[i]
+        : ((const uint8_t *)text->text)[i];
+}
+
+static inline int
+unit_col(const struct row_search_text *text, int i)
+{
+    return text->cols != NULL ? text->cols[i] : i;
+}
+
+static inline bool
+unit_starts_cell(const struct row_search_text *text, int i)
+{
+    return text->cols == NULL || i == 0 || text->cols[i] != text->cols[i - 1];
+}
+
+/* Index of the first unit at, or after, column 'col' */
+static int
+unit_from_col(const struct row_search_text *text, int col)
+{
+    if (text->cols == NULL)
+        return min(col, text->len);
+
+    int lo = 0;
+    int hi = text->len;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (text->cols[mid] < col)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
 static void
 search_cancel_keep_selection(struct terminal *term)
 {
@@ -112,6 +342,10 @@ search_cancel_keep_selection(struct terminal *term)
     term->search.buf = NULL;
     term->search.len = term->search.sz = 0;
 
+    search_text_free_all(&term->normal);
+    search_text_free_all(&term->alt);
+    regex_free(term);
+
     term->search.cursor = 0;
     term->search.match = (struct coord){-1, -1};
     term->search.match_len = 0;
@@ -136,6 +370,9 @@ search_begin(struct terminal *term)
     search_cancel_keep_selection(term);
     selection_cancel(term);
 
+    /* Search walks the whole scrollback */
+    term_reflow_pending_finish(term);
+
     /* Reset IME state */
     if (term_ime_is_enabled(term)) {
         term_ime_disable(term);
@@ -266,157 +503,847 @@ search_update_selection(struct terminal *term, const struct range *match)
     }
 }
 
-static ssize_t
-matches_cell(const struct terminal *term, const struct cell *cell, size_t search_ofs)
+/* Last cell of a match ending in 'col', including wide character spacers */
+static struct coord
+match_end(const struct terminal *term, int row_no, int col)
 {
-    assert(search_ofs < term->search.len);
+    const struct row *row = term->grid->rows[row_no];
+    struct cell scratch[row->compact != NULL ? term->cols : 1];
+    const struct cell *cells = grid_row_peek_cells(row, scratch);
 
-    char32_t base = cell->wc;
-    const struct composed *composed = NULL;
+    while (col + 1 < term->cols && cells[col + 1].wc > CELL_SPACER)
+        col++;
 
-    if (base >= CELL_COMB_CHARS_LO && base <= CELL_COMB_CHARS_HI)
-    {
-        composed = composed_lookup(term->composed, base - CELL_COMB_CHARS_LO);
-        base = composed->chars[0];
+    return (struct coord){col, row_no};
+}
+
+/*
+ * Checks if the search buffer matches the text starting at unit 'i'
+ * of row 'row_no'. The match may continue on the following rows. On
+ * success, returns the last cell of the match in 'end'.
+ */
+static bool
+matches_at(struct terminal *term, const char32_t *folded,
+           int row_no, const struct row_search_text *text, int i,
+           struct coord *end)
+{
+    struct grid *grid = term->grid;
+    const char32_t *raw = term->search.buf;
+
+    for (size_t k = 0; k < term->search.len; k++, i++) {
+        while (i >= text->len) {
+            row_no = (row_no + 1) & (grid->num_rows - 1);
+
+            struct row *row = grid->rows[row_no];
+            if (row == NULL)
+                return false;
+
+            text = row_search_text(term, row);
+            i = 0;
+        }
+
+        const char32_t unit = unit_at(text, i);
+
+        if (unit_starts_cell(text, i) ? unit != folded[k] : unit != raw[k])
+            return false;
     }
 
-    if (composed == NULL && base == 0 && term->search.buf[search_ofs] == U' ')
-        return 1;
+    /* Composed characters must be matched completely */
+    if (i < text->len && !unit_starts_cell(text, i))
+        return false;
 
-    if (c32ncasecmp(&base, &term->search.buf[search_ofs], 1) != 0)
-        return -1;
+    *end = match_end(term, row_no, unit_col(text, i - 1));
+    return true;
+}
 
-    if (composed != NULL) {
-        if (search_ofs + composed->count > term->search.len)
-            return -1;
+/*
+ * Looks for a match starting in columns [lo, hi] (inclusive) of the
+ * row. Candidates are found by scanning for the search buffer's first
+ * character (memchr() and friends), and then verified.
+ */
+static bool
+find_in_row(struct terminal *term, const char32_t *folded, bool backward,
+            int row_no, int lo, int hi, struct range *match)
+{
+    struct row *row = term->grid->rows[row_no];
+    const struct row_search_text *text = row_search_text(term, row);
+    const char32_t first = folded[0];
 
-        for (size_t j = 1; j < composed->count; j++) {
-            if (composed->chars[j] != term->search.buf[search_ofs + j])
-                return -1;
+    if (!text->wide && first > 0xff)
+        return false;
+
+    const int start = unit_from_col(text, lo);
+    const int end = unit_from_col(text, hi + 1);
+
+    for (int n = end - start; n > 0;) {
+        int i;
+
+        if (!text->wide) {
+            const uint8_t *text8 = text->text;
+            const uint8_t *p = backward
+                ? memrchr(&text8[start], first, n)
+                : memchr(&text8[end - n], first, n);
+
+            if (p == NULL)
+                return false;
+
+            i = p - text8;
+        } else {
+            const char32_t *text32 = text->text;
+
+            if (backward) {
+                i = start + n - 1;
+                while (i >= start && text32[i] != first)
+                    i--;
+                if (i < start)
+                    return false;
+            } else {
+                const wchar_t *p = wmemchr(
+                    (const wchar_t *)&text32[end - n], (wchar_t)first, n);
+                if (p == NULL)
+                    return false;
+                i = (const char32_t *)p - text32;
+            }
         }
+
+        n = backward ? i - start : end - i - 1;
+
+        if (!unit_starts_cell(text, i))
+            continue;
+
+        struct coord match_end;
+        if (!matches_at(term, folded, row_no, text, i, &match_end))
+            continue;
+
+        LOG_DBG("search: match at row=%d, col=%d",
+                row_no, unit_col(text, i));
+
+        *match = (struct range){
+            .start = {unit_col(text, i), row_no},
+            .end = match_end,
+        };
+        return true;
     }
 
-    return composed != NULL ? composed->count : 1;
+    return false;
 }
 
+/*
+ * Regex search
+ *
+ * The search buffer is matched, as a case insensitive POSIX extended
+ * regular expression, against logical lines: rows joined where the
+ * terminal auto-wrapped, the same way text is extracted. The text
+ * comes from the row search text index.
+ *
+ * Instead of calling regexec() once per line, consecutive lines are
+ * put in chunks of (roughly) REGEX_CHUNK_SIZE bytes, separated by
+ * newlines. The expression is compiled with REG_NEWLINE, so that
+ * matches cannot span lines, and '^' and '$' match at line
+ * boundaries.
+ *
+ * Lines longer than REGEX_WINDOW_ROWS rows (e.g. a scrollback
+ * without a single hard linebreak) are instead matched in windows of
+ * that many rows, each overlapping the previous one by
+ * REGEX_WINDOW_OVERLAP rows. A match is only taken from the window in
+ * which it starts before the overlap with the next one. Matches
+ * longer than the overlap may thus be cut short, or missed.
+ *
+ * When the expression is simple enough (see regex-dfa.h), each line
+ * is first run through a DFA, and regexec() is only called on the
+ * lines that may match. Most lines don't, and regexec() is slow.
+ *
+ * Positions are compared as linear, scrollback relative, cell
+ * indices: sb_row * cols + col.
+ */
+
+#define REGEX_CHUNK_SIZE (64 * 1024)
+#define REGEX_WINDOW_ROWS 256
+#define REGEX_WINDOW_OVERLAP 64
+
+static inline struct row *
+sb_row(const struct terminal *term, int sb)
+{
+    const struct grid *grid = term->grid;
+    return grid->rows[grid_row_sb_to_abs(grid, term->rows, sb)];
+}
+
+/* Whether the logical line continues on the next row */
 static bool
-find_next(struct terminal *term, enum search_direction direction,
-          struct coord abs_start, struct coord abs_end, struct range *match)
+row_continues(const struct terminal *term, int sb)
 {
-#define ROW_DEC(_r) ((_r) = ((_r) - 1 + grid->num_rows) & (grid->num_rows - 1))
-#define ROW_INC(_r) ((_r) = ((_r) + 1) & (grid->num_rows - 1))
+    if (sb + 1 >= term->grid->num_rows)
+        return false;
 
-    struct grid *grid = term->grid;
-    const bool backward = direction != SEARCH_FORWARD;
+    struct row *row = sb_row(term, sb);
+    struct row *next = sb_row(term, sb + 1);
 
-    LOG_DBG("%s: start: %dx%d, end: %dx%d", backward ? "backward" : "forward",
-            abs_start.row, abs_start.col, abs_end.row, abs_end.col);
+    if (row == NULL || next == NULL || row->linebreak)
+        return false;
 
-    xassert(abs_start.row >= 0);
-    xassert(abs_start.row < grid->num_rows);
-    xassert(abs_start.col >= 0);
-    xassert(abs_start.col < term->cols);
+    return !row_search_text(term, row)->last_empty &&
+           !row_search_text(term, next)->first_empty;
+}
 
-    xassert(abs_end.row >= 0);
-    xassert(abs_end.row < grid->num_rows);
-    xassert(abs_end.col >= 0);
-    xassert(abs_end.col < term->cols);
+static int
+line_start(const struct terminal *term, int sb)
+{
+    while (sb > 0 && row_continues(term, sb - 1))
+        sb--;
+    return sb;
+}
 
-    for (int match_start_row = abs_start.row, match_start_col = abs_start.col;
-         ;
-         backward ? ROW_DEC(match_start_row) : ROW_INC(match_start_row)) {
+static int
+line_end(const struct terminal *term, int sb)
+{
+    while (row_continues(term, sb))
+        sb++;
+    return sb;
+}
 
-        const struct row *row = grid->rows[match_start_row];
-        if (row == NULL) {
-            if (match_start_row == abs_end.row)
-                break;
+static bool
+line_is_long(int sb, int end)
+{
+    return end - sb + 1 > REGEX_WINDOW_ROWS;
+}
+
+static void
+chunk_ensure_size(struct terminal *term, size_t size)
+{
+    if (size <= term->search.re.size)
+        return;
+
+    size_t new_size = max(size, term->search.re.size * 2);
+    term->search.re.text = xrealloc(term->search.re.text, new_size);
+    term->search.re.pos = xrealloc(
+        term->search.re.pos, new_size * sizeof(term->search.re.pos[0]));
+    term->search.re.size = new_size;
+}
+
+static size_t
+chunk_add_row(struct terminal *term, size_t len, int sb)
+{
+    const struct row_search_text *text = row_search_text(term, sb_row(term, sb));
+    chunk_ensure_size(term, len + text->len * 4 + 2);
+
+    char *out = term->search.re.text;
+    struct coord *pos = term->search.re.pos;
+
+    for (int i = 0; i < text->len; i++) {
+        const char32_t c = unit_at(text, i);
+        const size_t start = len;
+
+        len += c32toutf8(c, &out[len]);
+
+        for (size_t j = start; j < len; j++)
+            pos[j] = (struct coord){unit_col(text, i), sb};
+    }
+
+    return len;
+}
+
+/*
+ * Fills the chunk with the logical lines starting at row 'sb', which
+ * must be the first row of a line, up to and including the line
+ * containing row 'last_sb', or until the chunk has reached
+ * 'max_size', or a long line (see chunk_fill_window()). Returns the
+ * first row *not* included.
+ */
+static int
+chunk_fill(struct terminal *term, int sb, int last_sb, size_t max_size,
+           size_t *len)
+{
+    *len = 0;
+    chunk_ensure_size(term, 1);
+    term->search.re.notbol = false;
+    term->search.re.noteol = false;
+
+    while (sb <= last_sb && *len < max_size) {
+        if (sb_row(term, sb) == NULL) {
+            sb++;
             continue;
         }
 
-        for (;
-             backward ? match_start_col >= 0 : match_start_col < term->cols;
-             backward ? match_start_col-- : match_start_col++)
+        const int end = line_end(term, sb);
+        if (line_is_long(sb, end))
+            break;
+
+        for (; sb <= end; sb++)
+            *len = chunk_add_row(term, *len, sb);
+
+        term->search.re.text[*len] = '\n';
+        term->search.re.pos[*len] = *len > 0
+            ? term->search.re.pos[*len - 1]
+            : (struct coord){0, sb - 1};
+        (*len)++;
+    }
+
+    term->search.re.text[*len] = '\0';
+    return sb;
+}
+
+/*
+ * Fills the chunk with rows 'first' to 'last' (inclusive) of a single
+ * logical line, ending on row 'line_end'. Without a trailing newline,
+ * since the line may continue.
+ */
+static size_t
+chunk_fill_window(struct terminal *term, int first, int last, int line_sb,
+                  int line_end)
+{
+    size_t len = 0;
+    chunk_ensure_size(term, 1);
+    term->search.re.notbol = first > line_sb;
+    term->search.re.noteol = last < line_end;
+
+    for (int sb = first; sb <= last; sb++)
+        len = chunk_add_row(term, len, sb);
+
+    term->search.re.text[len] = '\0';
+    return len;
+}
+
+static bool
+chunk_regexec(const struct terminal *term, size_t ofs, size_t *so, size_t *eo)
+{
+    const char *text = term->search.re.text;
+    const bool notbol = ofs > 0 ? text[ofs - 1] != '\n' : term->search.re.notbol;
+    const int flags =
+        (notbol ? REG_NOTBOL : 0) | (term->search.re.noteol ? REG_NOTEOL : 0);
+
+    regmatch_t m;
+    if (regexec(&term->search.re.compiled, &text[ofs], 1, &m, flags) != 0)
+        return false;
+
+    *so = ofs + m.rm_so;
+    *eo = ofs + m.rm_eo;
+    return true;
+}
+
+/*
+ * Runs the expression on the chunk (of 'len' bytes), starting at byte
+ * 'ofs'. Returns the match's start, and end, byte offsets.
+ */
+static bool
+chunk_match(struct terminal *term, size_t ofs, size_t len,
+            size_t *so, size_t *eo)
+{
+    struct regex_dfa *dfa = term->search.re.dfa;
+    if (dfa == NULL)
+        return chunk_regexec(term, ofs, so, eo);
+
+    char *text = term->search.re.text;
+
+    while (ofs < len) {
+        const char *nl = memchr(&text[ofs], '\n', len - ofs);
+        const size_t end = nl != NULL ? (size_t)(nl - text) : len;
+
+        /* A partially searched line has already been let through */
+        const bool mid_line = ofs > 0 && text[ofs - 1] != '\n';
+
+        if (mid_line || regex_dfa_line_may_match(dfa, &text[ofs], end - ofs)) {
+            /* Matches cannot span lines; limit regexec() to this one */
+            const char saved = text[end];
+            text[end] = '\0';
+            const bool found = chunk_regexec(term, ofs, so, eo);
+            text[end] = saved;
+
+            if (found)
+                return true;
+        }
+
+        ofs = end + 1;
+    }
+
+    return false;
+}
+
+static inline int64_t
+chunk_linear_pos(const struct terminal *term, size_t ofs)
+{
+    const struct coord pos = term->search.re.pos[ofs];
+    return (int64_t)pos.row * term->cols + pos.col;
+}
+
+static inline size_t
+utf8_next(const char *text, size_t ofs)
+{
+    if (text[ofs] == '\0')
+        return ofs + 1;
+
+    do {
+        ofs++;
+    } while ((text[ofs] & 0xc0) == 0x80);
+    return ofs;
+}
+
+static struct range
+chunk_match_range(const struct terminal *term, size_t so, size_t eo)
+{
+    const struct grid *grid = term->grid;
+    const struct coord start = term->search.re.pos[so];
+    const struct coord end = term->search.re.pos[eo - 1];
+
+    return (struct range){
+        .start = {start.col, grid_row_sb_to_abs(grid, term->rows, start.row)},
+        .end = match_end(
+            term, grid_row_sb_to_abs(grid, term->rows, end.row), end.col),
+    };
+}
+
+/*
+ * First, or last, (non-empty) match starting in [a, b], in the long
+ * logical line spanning rows 'line_sb' to 'line_end'
+ */
+static bool
+regex_find_in_windows(struct terminal *term, int line_sb, int line_end,
+                      int64_t a, int64_t b, bool backward, struct range *match)
+{
+    const int cols = term->cols;
+    const int stride = REGEX_WINDOW_ROWS - REGEX_WINDOW_OVERLAP;
+    const int rows = line_end - line_sb + 1;
+
+    /* The last window is the first one reaching the end of the line */
+    const int last_window =
+        (rows - REGEX_WINDOW_ROWS + stride - 1) / stride;
+
+    /* Windows in which matches starting in [a, b] are taken */
+    const int first = max(0, min((int)(a / cols) - line_sb, rows - 1)) / stride;
+    const int last = max(0, min((int)(b / cols) - line_sb, rows - 1)) / stride;
+
+    for (int i = min(backward ? last : first, last_window);
+         i >= min(first, last_window) && i <= min(last, last_window);
+         i += backward ? -1 : 1)
+    {
+        const int start = line_sb + i * stride;
+        const int end = min(start + REGEX_WINDOW_ROWS - 1, line_end);
+        const int taken_end = i < last_window ? start + stride - 1 : line_end;
+
+        const size_t len = chunk_fill_window(term, start, end, line_sb, line_end);
+
+        bool found = false;
+        size_t so, eo;
+
+        for (size_t ofs = 0; ofs < len && chunk_match(term, ofs, len, &so, &eo);
+             ofs = utf8_next(term->search.re.text, so))
         {
-            if (matches_cell(term, &row->cells[match_start_col], 0) < 0) {
-                if (match_start_row == abs_end.row &&
-                    match_start_col == abs_end.col)
-                {
+            const int64_t p = chunk_linear_pos(term, so);
+
+            if (p > b || term->search.re.pos[so].row > taken_end)
+                break;
+
+            if (p >= a && eo > so) {
+                *match = chunk_match_range(term, so, eo);
+                found = true;
+
+                if (!backward)
                     break;
-                }
-                continue;
             }
+        }
 
-            /*
-             * Got a match on the first letter. Now we'll see if the
-             * rest of the search buffer matches.
-             */
+        if (found)
+            return true;
+    }
 
-            LOG_DBG("search: initial match at row=%d, col=%d",
-                    match_start_row, match_start_col);
+    return false;
+}
 
-            int match_end_row = match_start_row;
-            int match_end_col = match_start_col;
-            const struct row *match_row = row;
-            size_t match_len = 0;
+/* First (non-empty) match starting in [a, b] */
+static bool
+regex_find_forward(struct terminal *term, int64_t a, int64_t b,
+                   struct range *match)
+{
+    const int last_sb = b / term->cols;
 
-            for (size_t i = 0; i < term->search.len;) {
-                if (match_end_col >= term->cols) {
-                    ROW_INC(match_end_row);
-                    match_end_col = 0;
+    for (int sb = line_start(term, a / term->cols); sb <= last_sb;) {
+        const int end = line_end(term, sb);
+        if (line_is_long(sb, end)) {
+            if (regex_find_in_windows(term, sb, end, a, b, false, match))
+                return true;
 
-                    match_row = grid->rows[match_end_row];
-                    if (match_row == NULL)
-                        break;
-                }
+            sb = end + 1;
+            continue;
+        }
 
-                if (match_row->cells[match_end_col].wc >= CELL_SPACER) {
-                    match_end_col++;
-                    continue;
-                }
+        size_t len;
+        sb = chunk_fill(term, sb, last_sb, REGEX_CHUNK_SIZE, &len);
 
-                ssize_t additional_chars = matches_cell(
-                    term, &match_row->cells[match_end_col], i);
-                if (additional_chars < 0)
-                    break;
+        size_t so, eo;
+        for (size_t ofs = 0; ofs < len && chunk_match(term, ofs, len, &so, &eo);
+             ofs = utf8_next(term->search.re.text, so))
+        {
+            const int64_t p = chunk_linear_pos(term, so);
 
-                i += additional_chars;
-                match_len += additional_chars;
-                match_end_col++;
+            if (p > b)
+                return false;
 
-                while (match_end_col < term->cols &&
-                       match_row->cells[match_end_col].wc > CELL_SPACER)
-                {
-                    match_end_col++;
-                }
+            if (p >= a && eo > so) {
+                *match = chunk_match_range(term, so, eo);
+                return true;
             }
+        }
+    }
 
-            if (match_len != term->search.len) {
-                /* Didn't match (completely) */
+    return false;
+}
 
-                if (match_start_row == abs_end.row &&
-                    match_start_col == abs_end.col)
-                {
-                    break;
-                }
+/* Last (non-empty) match starting in [a, b] */
+static bool
+regex_find_backward(struct terminal *term, int64_t a, int64_t b,
+                    struct range *match)
+{
+    const int cols = term->cols;
+    const int first_sb = a / cols;
+
+    for (int last_sb = b / cols; last_sb >= first_sb;) {
+        int sb = line_start(term, last_sb);
+
+        const int end = line_end(term, sb);
+        if (line_is_long(sb, end)) {
+            if (regex_find_in_windows(term, sb, end, a, b, true, match))
+                return true;
 
-                continue;
+            last_sb = sb - 1;
+            continue;
+        }
+
+        while (sb > first_sb && (int64_t)(last_sb - sb + 1) * cols < REGEX_CHUNK_SIZE) {
+            const int prev = line_start(term, sb - 1);
+            if (line_is_long(prev, sb - 1))
+                break;
+            sb = prev;
+        }
+
+        /* Bounded, since there are no long lines in it */
+        size_t len;
+        chunk_fill(term, sb, last_sb, SIZE_MAX, &len);
+
+        bool found = false;
+        size_t so, eo;
+
+        for (size_t ofs = 0; ofs < len && chunk_match(term, ofs, len, &so, &eo);
+             ofs = utf8_next(term->search.re.text, so))
+        {
+            const int64_t p = chunk_linear_pos(term, so);
+
+            if (p > b)
+                break;
+
+            if (p >= a && eo > so) {
+                *match = chunk_match_range(term, so, eo);
+                found = true;
             }
+        }
+
+        if (found)
+            return true;
+
+        last_sb = sb - 1;
+    }
+
+    return false;
+}
+
+static bool
+regex_find_next(struct terminal *term, bool backward,
+                struct coord abs_start, struct coord abs_end,
+                struct range *match)
+{
+    if (!regex_compile(term))
+        return false;
+
+    const struct grid *grid = term->grid;
+    const int64_t cols = term->cols;
+    const int64_t last = grid->num_rows * cols - 1;
+
+    const int64_t s =
+        grid_row_abs_to_sb(grid, term->rows, abs_start.row) * cols + abs_start.col;
+    const int64_t e =
+        grid_row_abs_to_sb(grid, term->rows, abs_end.row) * cols + abs_end.col;
 
-            *match = (struct range){
-                .start = {match_start_col, match_start_row},
-                .end = {match_end_col - 1, match_end_row},
-            };
+    if (!backward) {
+        if (e >= s)
+            return regex_find_forward(term, s, e, match);
 
+        return regex_find_forward(term, s, last, match) ||
+               regex_find_forward(term, 0, e, match);
+    } else {
+        if (e <= s)
+            return regex_find_backward(term, e, s, match);
+
+        return regex_find_backward(term, 0, s, match) ||
+               regex_find_backward(term, e, last, match);
+    }
+}
+
+/*
+ * Literal search, split into "steps": one row each, starting at
+ * 'start' and moving in the search direction, until 'end'.
+ */
+struct search_scan {
+    struct terminal *term;
+    const char32_t *folded;
+    bool backward;
+    struct coord start;
+    struct coord end;
+    int steps;
+
+    /*
+     * Parallel scan: a range of steps (a "round") is split into chunks
+     * of SEARCH_CHUNK_ROWS rows, claimed, in order, by the render
+     * worker threads. The first chunk with a match wins.
+     *
+     * The rows' search text index is built in a separate pass, before
+     * matching, since a match may continue into rows scanned by
+     * another thread.
+     */
+    bool indexing;
+    int round_first;        /* First step of this round */
+    int round_steps;
+    int index_first;        /* First (absolute) row to index */
+    int index_count;
+    atomic_int next_chunk;
+    atomic_int found_chunk; /* Lowest chunk with a match */
+    struct range *matches;  /* Match, per chunk */
+};
+
+#define SEARCH_CHUNK_ROWS 256
+#define SEARCH_PARALLEL_MIN_ROWS 1024
+
+/* Row, and column range, searched in step 'k' */
+static int
+scan_step(const struct search_scan *scan, int k, int *lo, int *hi)
+{
+    const struct terminal *term = scan->term;
+    const int mask = term->grid->num_rows - 1;
+    const bool first = k == 0;
+    const bool last = k == scan->steps - 1;
+
+    if (scan->backward) {
+        *lo = last ? scan->end.col : 0;
+        *hi = first ? scan->start.col : term->cols - 1;
+        return (scan->start.row - k) & mask;
+    } else {
+        *lo = first ? scan->start.col : 0;
+        *hi = last ? scan->end.col : term->cols - 1;
+        return (scan->start.row + k) & mask;
+    }
+}
+
+static bool
+scan_steps(struct search_scan *scan, int first, int count,
+           const atomic_int *abort_below, int chunk, struct range *match)
+{
+    const struct grid *grid = scan->term->grid;
+
+    for (int k = first; k < first + count && k < scan->steps; k++) {
+        if (abort_below != NULL &&
+            atomic_load_explicit(abort_below, memory_order_relaxed) < chunk)
+        {
+            /* An earlier chunk has already matched */
+            return false;
+        }
+
+        int lo, hi;
+        const int row_no = scan_step(scan, k, &lo, &hi);
+
+        if (grid->rows[row_no] == NULL)
+            continue;
+
+        if (find_in_row(
+                scan->term, scan->folded, scan->backward, row_no, lo, hi, match))
             return true;
+    }
+
+    return false;
+}
+
+static void
+scan_job(void *data)
+{
+    struct search_scan *scan = data;
+    struct grid *grid = scan->term->grid;
+
+    if (scan->indexing) {
+        const int chunk_count =
+            (scan->index_count + SEARCH_CHUNK_ROWS - 1) / SEARCH_CHUNK_ROWS;
+
+        for (int chunk = atomic_fetch_add(&scan->next_chunk, 1);
+             chunk < chunk_count;
+             chunk = atomic_fetch_add(&scan->next_chunk, 1))
+        {
+            const int first = chunk * SEARCH_CHUNK_ROWS;
+            const int last = min(first + SEARCH_CHUNK_ROWS, scan->index_count);
+
+            for (int i = first; i < last; i++) {
+                struct row *row =
+                    grid->rows[(scan->index_first + i) & (grid->num_rows - 1)];
+                if (row != NULL)
+                    row_search_text(scan->term, row);
+            }
         }
+        return;
+    }
 
-        if (match_start_row == abs_end.row && match_start_col == abs_end.col)
+    const int chunk_count =
+        (scan->round_steps + SEARCH_CHUNK_ROWS - 1) / SEARCH_CHUNK_ROWS;
+
+    for (int chunk = atomic_fetch_add(&scan->next_chunk, 1);
+         chunk < chunk_count;
+         chunk = atomic_fetch_add(&scan->next_chunk, 1))
+    {
+        /* Chunks are claimed in order; all remaining ones come after this */
+        if (atomic_load(&scan->found_chunk) < chunk)
             break;
 
-        match_start_col = backward ? term->cols - 1 : 0;
+        const int first = scan->round_first + chunk * SEARCH_CHUNK_ROWS;
+        const int count = min(
+            SEARCH_CHUNK_ROWS, scan->round_first + scan->round_steps - first);
+
+        struct range match;
+        if (!scan_steps(scan, first, count, &scan->found_chunk, chunk, &match))
+            continue;
+
+        scan->matches[chunk] = match;
+
+        int found = atomic_load(&scan->found_chunk);
+        while (chunk < found &&
+               !atomic_compare_exchange_weak(&scan->found_chunk, &found, chunk))
+            ;
     }
+}
 
-    return false;
+/*
+ * Scans steps [first, steps) on the render worker threads. To not
+ * index (much) more than a single threaded search would have, when
+ * there's a match close to 'first', the steps are scanned in rounds
+ * of doubling size.
+ */
+static bool
+scan_parallel(struct search_scan *scan, int first, struct range *match)
+{
+    struct terminal *term = scan->term;
+    const int num_rows = term->grid->num_rows;
+    const int workers = term->render.workers.count;
+
+    int round_steps = 4 * (workers + 1) * SEARCH_CHUNK_ROWS;
+    const int max_chunks =
+        (scan->steps - first + SEARCH_CHUNK_ROWS - 1) / SEARCH_CHUNK_ROWS;
+
+    scan->matches = xmalloc(max_chunks * sizeof(scan->matches[0]));
+
+    bool found_match = false;
+
+    for (int k = first; k < scan->steps && !found_match;
+         k += scan->round_steps)
+    {
+        scan->round_first = k;
+        scan->round_steps = min(round_steps, scan->steps - k);
+
+        /*
+         * Rows to index, in (forward) row order. Since each row has at
+         * least one character, a match continues into at most
+         * search.len rows after the last scanned one.
+         */
+        const int top = scan->backward
+            ? scan->start.row - (k + scan->round_steps - 1)
+            : scan->start.row + k;
+
+        scan->indexing = true;
+        scan->index_first = top & (num_rows - 1);
+        scan->index_count = min(
+            (size_t)num_rows, scan->round_steps + term->search.len);
+        atomic_init(&scan->next_chunk, 0);
+
+        render_workers_run(term, &scan_job, scan);
+
+        const int chunk_count =
+            (scan->round_steps + SEARCH_CHUNK_ROWS - 1) / SEARCH_CHUNK_ROWS;
+
+        scan->indexing = false;
+        atomic_init(&scan->next_chunk, 0);
+        atomic_init(&scan->found_chunk, chunk_count);
+
+        render_workers_run(term, &scan_job, scan);
+
+        const int found = atomic_load(&scan->found_chunk);
+        if (found < chunk_count) {
+            *match = scan->matches[found];
+            found_match = true;
+        }
+
+        round_steps *= 2;
+    }
+
+    free(scan->matches);
+    return found_match;
+}
+
+static bool
+find_next(struct terminal *term, enum search_direction direction,
+          struct coord abs_start, struct coord abs_end, struct range *match)
+{
+    struct grid *grid = term->grid;
+    const bool backward = direction != SEARCH_FORWARD;
+
+    LOG_DBG("%s: start: %dx%d, end: %dx%d", backward ? "backward" : "forward",
+            abs_start.row, abs_start.col, abs_end.row, abs_end.col);
+
+    xassert(abs_start.row >= 0);
+    xassert(abs_start.row < grid->num_rows);
+    xassert(abs_start.col >= 0);
+    xassert(abs_start.col < term->cols);
+
+    xassert(abs_end.row >= 0);
+    xassert(abs_end.row < grid->num_rows);
+    xassert(abs_end.col >= 0);
+    xassert(abs_end.col < term->cols);
+
+    if (term->search.len == 0)
+        return false;
+
+    if (term->search.regex)
+        return regex_find_next(term, backward, abs_start, abs_end, match);
+
+    char32_t folded[term->search.len];
+    for (size_t i = 0; i < term->search.len; i++)
+        folded[i] = c32fold(term->search.buf[i]);
+
+    /* Number of rows from start to end; if they're on the same row,
+     * the search may wrap around all the way back to it */
+    int rows = backward
+        ? abs_start.row - abs_end.row
+        : abs_end.row - abs_start.row;
+    rows &= grid->num_rows - 1;
+
+    if (rows == 0 &&
+        (backward ? abs_end.col > abs_start.col : abs_end.col < abs_start.col))
+    {
+        rows = grid->num_rows;
+    }
+
+    struct search_scan scan = {
+        .term = term,
+        .folded = folded,
+        .backward = backward,
+        .start = abs_start,
+        .end = abs_end,
+        .steps = rows + 1,
+    };
+
+    /* Most of the time, there's a match nearby; no need to involve
+     * the worker threads */
+    if (scan_steps(&scan, 0, SEARCH_PARALLEL_MIN_ROWS, NULL, 0, match))
+        return true;
+
+    if (scan.steps <= SEARCH_PARALLEL_MIN_ROWS)
+        return false;
+
+    if (term->render.workers.count > 0 && term->render.workers.pool != NULL)
+        return scan_parallel(&scan, SEARCH_PARALLEL_MIN_ROWS, match);
+
+    return scan_steps(
+        &scan, SEARCH_PARALLEL_MIN_ROWS, scan.steps, NULL, 0, match);
 }
 
 static void
@@ -527,7 +1454,6 @@ search_find_next(struct terminal *term, enum search_direction direction)
         term->search.match_len = 0;
         selection_cancel(term);
     }
-#undef ROW_DEC
 }
 
 struct search_match_iterator
@@ -657,11 +1583,45 @@ search_add_chars(struct terminal *term, const char *src, size_t count)
 
 enum extend_direction {SEARCH_EXTEND_LEFT, SEARCH_EXTEND_RIGHT};
 
+/*
+ * Copies text extracted from the grid to 'dst' (if non-NULL), in a
+ * form that can be appended to the search buffer: newlines are
+ * dropped, and in regex mode, special characters are escaped. Returns
+ * the number of characters (that would have been) written.
+ */
+static size_t
+search_literal(const struct terminal *term, const char32_t *src, size_t len,
+               char32_t *dst)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == U'\n') {
+            /* extract() adds newlines, which we never match against */
+            continue;
+        }
+
+        if (term->search.regex && src[i] != 0 && src[i] < 0x80 &&
+            strchr("\\.[]()*+?{}|^$", src[i]) != NULL)
+        {
+            if (dst != NULL)
+                dst[count] = U'\\';
+            count++;
+        }
+
+        if (dst != NULL)
+            dst[count] = src[i];
+        count++;
+    }
+
+    return count;
+}
+
 static bool
 coord_advance_left(const struct terminal *term, struct coord *pos,
                    const struct row **row)
 {
-    const struct grid *grid = term->grid;
+    struct grid *grid = term->grid;
     struct coord new_pos = *pos;
 
     if (--new_pos.col < 0) {
@@ -672,7 +1632,7 @@ coord_advance_left(const struct terminal *term, struct coord *pos,
             return false;
 
         if (row != NULL)
-            *row = grid->rows[new_pos.row];
+            *row = grid_row_uncompact(grid, grid->rows[new_pos.row]);
     }
 
     *pos = new_pos;
@@ -683,7 +1643,7 @@ static bool
 coord_advance_right(const struct terminal *term, struct coord *pos,
                     const struct row **row)
 {
-    const struct grid *grid = term->grid;
+    struct grid *grid = term->grid;
     struct coord new_pos = *pos;
 
     if (++new_pos.col >= term->cols) {
@@ -694,7 +1654,7 @@ coord_advance_right(const struct terminal *term, struct coord *pos,
             return false;
 
         if (row != NULL)
-            *row = grid->rows[new_pos.row];
+            *row = grid_row_uncompact(grid, grid->rows[new_pos.row]);
     }
 
     *pos = new_pos;
@@ -715,7 +1675,7 @@ search_extend_find_char(const struct terminal *term, struct coord *target,
 
     *target = pos;
 
-    const struct row *row = term->grid->rows[pos.row];
+    const struct row *row = grid_row_uncompact(term->grid, term->grid->rows[pos.row]);
 
     while (true) {
         switch (direction) {
@@ -870,7 +1830,7 @@ search_extend_left(struct terminal *term, const struct coord *target)
 
     const struct coord last_coord = selection_get_start(term);
     struct coord pos = *target;
-    const struct row *row = term->grid->rows[pos.row];
+    const struct row *row = grid_row_uncompact(term->grid, term->grid->rows[pos.row]);
 
     const bool move_cursor = term->search.cursor != 0;
 
@@ -891,30 +1851,18 @@ search_extend_left(struct terminal *term, const struct coord *target)
     if (!extract_finish_wide(ctx, &new_text, &new_len))
         return;
 
-    if (!search_ensure_size(term, term->search.len + new_len))
-        return;
-
-    memmove(&term->search.buf[new_len], &term->search.buf[0],
-            term->search.len * sizeof(term->search.buf[0]));
-
-    size_t actually_copied = 0;
-    for (size_t i = 0; i < new_len; i++) {
-        if (new_text[i] == U'\n') {
-            /* extract() adds newlines, which we never match against */
-            continue;
-        }
+    const size_t actually_copied = search_literal(term, new_text, new_len, NULL);
 
-        term->search.buf[actually_copied++] = new_text[i];
-        term->search.len++;
+    if (!search_ensure_size(term, term->search.len + actually_copied)) {
+        free(new_text);
+        return;
     }
 
-    xassert(actually_copied <= new_len);
-    if (actually_copied < new_len) {
-        memmove(
-            &term->search.buf[actually_copied], &term->search.buf[new_len],
-            (term->search.len - actually_copied) * sizeof(term->search.buf[0]));
-    }
+    memmove(&term->search.buf[actually_copied], &term->search.buf[0],
+            term->search.len * sizeof(term->search.buf[0]));
 
+    search_literal(term, new_text, new_len, term->search.buf);
+    term->search.len += actually_copied;
     term->search.buf[term->search.len] = U'\0';
     free(new_text);
 
@@ -934,7 +1882,7 @@ search_extend_right(struct terminal *term, const struct coord *target)
         return;
 
     struct coord pos = selection_get_end(term);
-    const struct row *row = term->grid->rows[pos.row];
+    const struct row *row = grid_row_uncompact(term->grid, term->grid->rows[pos.row]);
 
     const bool move_cursor = term->search.cursor == term->search.len;
 
@@ -955,18 +1903,16 @@ search_extend_right(struct terminal *term, const struct coord *target)
     if (!extract_finish_wide(ctx, &new_text, &new_len))
         return;
 
-    if (!search_ensure_size(term, term->search.len + new_len))
-        return;
+    const size_t count = search_literal(term, new_text, new_len, NULL);
 
-    for (size_t i = 0; i < new_len; i++) {
-        if (new_text[i] == U'\n') {
-            /* extract() adds newlines, which we never match against */
-            continue;
-        }
-
-        term->search.buf[term->search.len++] = new_text[i];
+    if (!search_ensure_size(term, term->search.len + count)) {
+        free(new_text);
+        return;
     }
 
+    search_literal(
+        term, new_text, new_len, &term->search.buf[term->search.len]);
+    term->search.len += count;
     term->search.buf[term->search.len] = U'\0';
     free(new_text);
 
@@ -1361,6 +2307,11 @@ execute_binding(struct seat *seat, struct terminal *term,
         unicode_mode_activate(term);
         return true;
 
+    case BIND_ACTION_SEARCH_TOGGLE_REGEX:
+        term->search.regex = !term->search.regex;
+        *update_search_result = *redraw = true;
+        return true;
+
     case BIND_ACTION_SEARCH_COUNT:
         BUG("Invalid action type");
         return true;
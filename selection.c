@@ -15,8 +15,8 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 
-#include "async.h"
 #include "char32.h"
+#include "clipboard-data.h"
 #include "commands.h"
 #include "config.h"
 #include "extract.h"
@@ -220,7 +220,7 @@ foreach_selected_normal(
     end_row &= (grid_rows - 1);
 
     for (int r = start_row; r != end_row; r = (r + 1) & (grid_rows - 1)) {
-        struct row *row = term->grid->rows[r];
+        struct row *row = grid_row_uncompact(term->grid, term->grid->rows[r]);
         xassert(row != NULL);
 
         for (int c = start_col; c <= term->cols - 1; c++) {
@@ -232,7 +232,7 @@ foreach_selected_normal(
     }
 
     /* Last, partial row */
-    struct row *row = term->grid->rows[end_row];
+    struct row *row = grid_row_uncompact(term->grid, term->grid->rows[end_row]);
     xassert(row != NULL);
 
     for (int c = start_col; c <= end_col; c++) {
@@ -273,7 +273,7 @@ foreach_selected_block(
 
     int r = top_left.row;
     while (true) {
-        struct row *row = term->grid->rows[r];
+        struct row *row = grid_row_uncompact(term->grid, term->grid->rows[r]);
         xassert(row != NULL);
 
         for (int c = top_left.col; c <= bottom_right.col; c++) {
@@ -345,14 +345,14 @@ void
 selection_find_word_boundary_left(const struct terminal *term, struct coord *pos,
                                   bool spaces_only)
 {
-    const struct grid *grid = term->grid;
+    struct grid *grid = term->grid;
 
     xassert(pos->col >= 0);
     xassert(pos->col < term->cols);
     xassert(pos->row >= 0);
     pos->row &= grid->num_rows - 1;
 
-    const struct row *r = grid->rows[pos->row];
+    const struct row *r = grid_row_uncompact(grid, grid->rows[pos->row]);
     char32_t c = r->cells[pos->col].wc;
 
     while (c >= CELL_SPACER) {
@@ -364,7 +364,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
     }
 
     if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-        c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+        c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
     bool initial_is_space = c == 0 || isc32space(c);
     bool initial_is_delim =
@@ -376,7 +376,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
         int next_col = pos->col - 1;
         int next_row = pos->row;
 
-        const struct row *row = grid->rows[next_row];
+        const struct row *row = grid_row_uncompact(grid, grid->rows[next_row]);
 
         /* Linewrap */
         if (next_col < 0) {
@@ -391,7 +391,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
                 break;
             }
 
-            row = grid->rows[next_row];
+            row = grid_row_uncompact(grid, grid->rows[next_row]);
 
             if (row->linebreak) {
                 /* Hard linebreak, treat as space. I.e. break selection */
@@ -408,7 +408,7 @@ selection_find_word_boundary_left(const struct terminal *term, struct coord *pos
         }
 
         if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-            c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+            c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
         bool is_space = c == 0 || isc32space(c);
         bool is_delim =
@@ -434,14 +434,14 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
                                    bool spaces_only,
                                    bool stop_on_space_to_word_boundary)
 {
-    const struct grid *grid = term->grid;
+    struct grid *grid = term->grid;
 
     xassert(pos->col >= 0);
     xassert(pos->col < term->cols);
     xassert(pos->row >= 0);
     pos->row &= grid->num_rows - 1;
 
-    const struct row *r = grid->rows[pos->row];
+    const struct row *r = grid_row_uncompact(grid, grid->rows[pos->row]);
     char32_t c = r->cells[pos->col].wc;
 
     while (c >= CELL_SPACER) {
@@ -453,7 +453,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
     }
 
     if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-        c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+        c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
     bool initial_is_space = c == 0 || isc32space(c);
     bool initial_is_delim =
@@ -466,7 +466,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
         int next_col = pos->col + 1;
         int next_row = pos->row;
 
-        const struct row *row = term->grid->rows[next_row];
+        const struct row *row = grid_row_uncompact(term->grid, term->grid->rows[next_row]);
 
         /* Linewrap */
         if (next_col >= term->cols) {
@@ -483,7 +483,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
                 break;
             }
 
-            row = grid->rows[next_row];
+            row = grid_row_uncompact(grid, grid->rows[next_row]);
         }
 
         c = row->cells[next_col].wc;
@@ -497,7 +497,7 @@ selection_find_word_boundary_right(const struct terminal *term, struct coord *po
         }
 
         if (c >= CELL_COMB_CHARS_LO && c <= CELL_COMB_CHARS_HI)
-            c = composed_lookup(term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
+            c = composed_lookup(&term->composed, c - CELL_COMB_CHARS_LO)->chars[0];
 
         bool is_space = c == 0 || isc32space(c);
         bool is_delim =
@@ -906,11 +906,11 @@ mark_selected_region(struct terminal *term, pixman_box32_t *boxes,
              rel_r < box->y2;
              r = (r + 1) & (term->grid->num_rows - 1), rel_r++)
         {
-            struct row *row = term->grid->rows[r];
+            struct row *row = grid_row_uncompact(term->grid, term->grid->rows[r]);
             xassert(row != NULL);
 
             if (dirty_cells)
-                row->dirty = true;
+                grid_row_dirty_range(row, box->x1, box->x2 - 1);
 
             for (int c = box->x1, empty_count = 0; c < box->x2; c++) {
                 struct cell *cell = &row->cells[c];
@@ -965,7 +965,7 @@ mark_selected_region(struct terminal *term, pixman_box32_t *boxes,
                      */
                     cell->attrs.clean = false;
                     cell->attrs.selected = false;
-                    row->dirty = true;
+                    grid_row_dirty_range(row, c, c);
                     continue;
                 }
 
@@ -975,7 +975,7 @@ mark_selected_region(struct terminal *term, pixman_box32_t *boxes,
 
                     if (dirty_cells) {
                         cell->attrs.clean = false;
-                        row->dirty = true;
+                        grid_row_dirty_range(row, c - j, c - j);
                     }
                     cell->attrs.selected = selected;
                 }
@@ -1048,7 +1048,7 @@ set_pivot_point_for_block_and_char_wise(struct terminal *term,
     /* First, make sure 'start' isn't in the middle of a
      * multi-column character */
     while (true) {
-        const struct row *row = term->grid->rows[pivot_start->row & (term->grid->num_rows - 1)];
+        const struct row *row = grid_row_uncompact(term->grid, term->grid->rows[pivot_start->row & (term->grid->num_rows - 1)]);
         const struct cell *cell = &row->cells[pivot_start->col];
 
         if (cell->wc < CELL_SPACER)
@@ -1073,7 +1073,7 @@ set_pivot_point_for_block_and_char_wise(struct terminal *term,
     if (new_direction == SELECTION_RIGHT) {
         bool keep_going = true;
         while (keep_going) {
-            const struct row *row = term->grid->rows[pivot_end->row & (term->grid->num_rows - 1)];
+            const struct row *row = grid_row_uncompact(term->grid, term->grid->rows[pivot_end->row & (term->grid->num_rows - 1)]);
             const char32_t wc = row->cells[pivot_end->col].wc;
 
             keep_going = wc >= CELL_SPACER;
@@ -1089,7 +1089,7 @@ set_pivot_point_for_block_and_char_wise(struct terminal *term,
     } else {
         bool keep_going = true;
         while (keep_going) {
-            const struct row *row = term->grid->rows[pivot_start->row & (term->grid->num_rows - 1)];
+            const struct row *row = grid_row_uncompact(term->grid, term->grid->rows[pivot_start->row & (term->grid->num_rows - 1)]);
             const char32_t wc = pivot_start->col < term->cols - 1
                 ? row->cells[pivot_start->col + 1].wc : 0;
 
@@ -1239,8 +1239,8 @@ selection_update(struct terminal *term, int col, int row)
     size_t start_row_idx = new_start.row & (term->grid->num_rows - 1);
     size_t end_row_idx = new_end.row & (term->grid->num_rows - 1);
 
-    const struct row *row_start = term->grid->rows[start_row_idx];
-    const struct row *row_end = term->grid->rows[end_row_idx];
+    const struct row *row_start = grid_row_uncompact(term->grid, term->grid->rows[start_row_idx]);
+    const struct row *row_end = grid_row_uncompact(term->grid, term->grid->rows[end_row_idx]);
 
     /* If an end point is in the middle of a multi-column character,
      * expand the selection to cover the entire character */
@@ -1579,7 +1579,7 @@ unmark_selected(struct terminal *term, struct row *row, struct cell *cell,
     if (!cell->attrs.selected)
         return true;
 
-    row->dirty = true;
+    grid_row_dirty_range(row, col, col);
     cell->attrs.selected = false;
     cell->attrs.clean = false;
     return true;
@@ -1640,8 +1640,8 @@ selection_clipboard_unset(struct seat *seat)
     clipboard->data_source = NULL;
     clipboard->serial = 0;
 
-    free(clipboard->text);
-    clipboard->text = NULL;
+    clipboard_data_unref(clipboard->data);
+    clipboard->data = NULL;
 }
 
 void
@@ -1660,8 +1660,8 @@ selection_primary_unset(struct seat *seat)
     primary->data_source = NULL;
     primary->serial = 0;
 
-    free(primary->text);
-    primary->text = NULL;
+    clipboard_data_unref(primary->data);
+    primary->data = NULL;
 }
 
 static bool
@@ -1773,87 +1773,6 @@ target(void *data, struct wl_data_source *wl_data_source, const char *mime_type)
     LOG_DBG("TARGET: mime-type=%s", mime_type);
 }
 
-struct clipboard_send {
-    char *data;
-    size_t len;
-    size_t idx;
-};
-
-static bool
-fdm_send(struct fdm *fdm, int fd, int events, void *data)
-{
-    struct clipboard_send *ctx = data;
-
-    if (events & EPOLLHUP)
-        goto done;
-
-    switch (async_write(fd, ctx->data, ctx->len, &ctx->idx)) {
-    case ASYNC_WRITE_REMAIN:
-        return true;
-
-    case ASYNC_WRITE_DONE:
-        break;
-
-    case ASYNC_WRITE_ERR:
-        LOG_ERRNO(
-            "failed to asynchronously write %zu of selection data to FD=%d",
-            ctx->len - ctx->idx, fd);
-        break;
-    }
-
-done:
-    fdm_del(fdm, fd);
-    free(ctx->data);
-    free(ctx);
-    return true;
-}
-
-static void
-send_clipboard_or_primary(struct seat *seat, int fd, const char *selection,
-                          const char *source_name)
-{
-    /* Make it NONBLOCK:ing right away - we don't want to block if the
-     * initial attempt to send the data synchronously fails */
-    int flags;
-    if ((flags = fcntl(fd, F_GETFL)) < 0 ||
-        fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
-    {
-        LOG_ERRNO("failed to set O_NONBLOCK");
-        return;
-    }
-
-    size_t len = selection != NULL ? strlen(selection) : 0;
-    size_t async_idx = 0;
-
-    switch (async_write(fd, selection, len, &async_idx)) {
-    case ASYNC_WRITE_REMAIN: {
-        struct clipboard_send *ctx = xmalloc(sizeof(*ctx));
-        *ctx = (struct clipboard_send) {
-            .data = xstrdup(&selection[async_idx]),
-            .len = len - async_idx,
-            .idx = 0,
-        };
-
-        if (fdm_add(seat->wayl->fdm, fd, EPOLLOUT, &fdm_send, ctx))
-            return;
-
-        free(ctx->data);
-        free(ctx);
-        break;
-    }
-
-    case ASYNC_WRITE_DONE:
-        break;
-
-    case ASYNC_WRITE_ERR:
-        LOG_ERRNO("failed write %zu bytes of %s selection data to FD=%d",
-                  len, source_name, fd);
-        break;
-    }
-
-    close(fd);
-}
-
 static void
 send(void *data, struct wl_data_source *wl_data_source, const char *mime_type,
      int32_t fd)
@@ -1861,7 +1780,7 @@ send(void *data, struct wl_data_source *wl_data_source, const char *mime_type,
     struct seat *seat = data;
     const struct wl_clipboard *clipboard = &seat->clipboard;
 
-    send_clipboard_or_primary(seat, fd, clipboard->text, "clipboard");
+    clipboard_data_send(clipboard->data, seat->wayl->fdm, fd);
 }
 
 static void
@@ -1875,8 +1794,8 @@ cancelled(void *data, struct wl_data_source *wl_data_source)
     clipboard->data_source = NULL;
     clipboard->serial = 0;
 
-    free(clipboard->text);
-    clipboard->text = NULL;
+    clipboard_data_unref(clipboard->data);
+    clipboard->data = NULL;
 }
 
 /* We don't support dragging *from* */
@@ -1915,7 +1834,7 @@ primary_send(void *data,
     struct seat *seat = data;
     const struct wl_primary *primary = &seat->primary;
 
-    send_clipboard_or_primary(seat, fd, primary->text, "primary");
+    clipboard_data_send(primary->data, seat->wayl->fdm, fd);
 }
 
 static void
@@ -1929,8 +1848,8 @@ primary_cancelled(void *data,
     primary->data_source = NULL;
     primary->serial = 0;
 
-    free(primary->text);
-    primary->text = NULL;
+    clipboard_data_unref(primary->data);
+    primary->data = NULL;
 }
 
 static const struct zwp_primary_selection_source_v1_listener primary_selection_source_listener = {
@@ -1939,7 +1858,8 @@ static const struct zwp_primary_selection_source_v1_listener primary_selection_s
 };
 
 bool
-text_to_clipboard(struct seat *seat, struct terminal *term, char *text, uint32_t serial)
+data_to_clipboard(struct seat *seat, struct terminal *term,
+                  struct clipboard_data *data, uint32_t serial)
 {
     xassert(serial != 0);
 
@@ -1950,11 +1870,11 @@ text_to_clipboard(struct seat *seat, struct terminal *term, char *text, uint32_t
         xassert(clipboard->serial != 0);
         wl_data_device_set_selection(seat->data_device, NULL, clipboard->serial);
         wl_data_source_destroy(clipboard->data_source);
-        free(clipboard->text);
+        clipboard_data_unref(clipboard->data);
 
         clipboard->data_source = NULL;
         clipboard->serial = 0;
-        clipboard->text = NULL;
+        clipboard->data = NULL;
     }
 
     clipboard->data_source
@@ -1965,7 +1885,7 @@ text_to_clipboard(struct seat *seat, struct terminal *term, char *text, uint32_t
         return false;
     }
 
-    clipboard->text = text;
+    clipboard->data = clipboard_data_ref(data);
 
     /* Configure source */
     wl_data_source_offer(clipboard->data_source, mime_type_map[DATA_OFFER_MIME_TEXT_UTF8]);
@@ -1982,6 +1902,32 @@ text_to_clipboard(struct seat *seat, struct terminal *term, char *text, uint32_t
     return true;
 }
 
+static bool
+text_to_data(char *text, struct clipboard_data **data)
+{
+    *data = NULL;
+    if (text == NULL)
+        return true;
+
+    *data = clipboard_data_from_text(text, strlen(text));
+    return *data != NULL;
+}
+
+bool
+text_to_clipboard(struct seat *seat, struct terminal *term, char *text, uint32_t serial)
+{
+    struct clipboard_data *data;
+    if (!text_to_data(text, &data))
+        return false;
+
+    bool ret = data_to_clipboard(seat, term, data, serial);
+    clipboard_data_unref(data);
+
+    if (ret)
+        free(text);
+    return ret;
+}
+
 void
 selection_to_clipboard(struct seat *seat, struct terminal *term, uint32_t serial)
 {
@@ -2398,7 +2344,8 @@ selection_from_clipboard(struct seat *seat, struct terminal *term, uint32_t seri
 }
 
 bool
-text_to_primary(struct seat *seat, struct terminal *term, char *text, uint32_t serial)
+data_to_primary(struct seat *seat, struct terminal *term,
+                struct clipboard_data *data, uint32_t serial)
 {
     if (term->wl->primary_selection_device_manager == NULL)
         return false;
@@ -2415,11 +2362,11 @@ text_to_primary(struct seat *seat, struct terminal *term, char *text, uint32_t s
         zwp_primary_selection_device_v1_set_selection(
             seat->primary_selection_device, NULL, primary->serial);
         zwp_primary_selection_source_v1_destroy(primary->data_source);
-        free(primary->text);
+        clipboard_data_unref(primary->data);
 
         primary->data_source = NULL;
         primary->serial = 0;
-        primary->text = NULL;
+        primary->data = NULL;
     }
 
     primary->data_source
@@ -2431,8 +2378,7 @@ text_to_primary(struct seat *seat, struct terminal *term, char *text, uint32_t s
         return false;
     }
 
-    /* Get selection as a string */
-    primary->text = text;
+    primary->data = clipboard_data_ref(data);
 
     /* Configure source */
     zwp_primary_selection_source_v1_offer(primary->data_source, mime_type_map[DATA_OFFER_MIME_TEXT_UTF8]);
@@ -2449,6 +2395,21 @@ text_to_primary(struct seat *seat, struct terminal *term, char *text, uint32_t s
     return true;
 }
 
+bool
+text_to_primary(struct seat *seat, struct terminal *term, char *text, uint32_t serial)
+{
+    struct clipboard_data *data;
+    if (!text_to_data(text, &data))
+        return false;
+
+    bool ret = data_to_primary(seat, term, data, serial);
+    clipboard_data_unref(data);
+
+    if (ret)
+        free(text);
+    return ret;
+}
+
 void
 selection_to_primary(struct seat *seat, struct terminal *term, uint32_t serial)
 {
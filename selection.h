@@ -42,12 +42,21 @@ void selection_to_primary(
     struct seat *seat, struct terminal *term, uint32_t serial);
 void selection_from_primary(struct seat *seat, struct terminal *term);
 
-/* Copy text *to* primary/clipboard */
+/* Copy text *to* primary/clipboard. On success, 'text' is freed */
 bool text_to_clipboard(
     struct seat *seat, struct terminal *term, char *text, uint32_t serial);
 bool text_to_primary(
     struct seat *seat, struct terminal *term, char *text, uint32_t serial);
 
+/* Like above, but shares 'data' (sealed); the caller keeps its reference */
+struct clipboard_data;
+bool data_to_clipboard(
+    struct seat *seat, struct terminal *term,
+    struct clipboard_data *data, uint32_t serial);
+bool data_to_primary(
+    struct seat *seat, struct terminal *term,
+    struct clipboard_data *data, uint32_t serial);
+
 /*
  * Copy text *from* primary/clipboard
  *
@@ -259,14 +259,16 @@ instantiate_offset(struct buffer_private *buf, off_t new_offset)
 
     mmapped = (uint8_t *)pool->real_mmapped + new_offset;
 
-    wl_buf = wl_shm_pool_create_buffer(
-        pool->wl_pool, new_offset,
-        buf->public.width, buf->public.height, buf->public.stride,
-        buf->with_alpha ? WL_SHM_FORMAT_ARGB8888 : WL_SHM_FORMAT_XRGB8888);
-
-    if (wl_buf == NULL) {
-        LOG_ERR("failed to create SHM buffer");
-        goto err;
+    if (pool->wl_pool != NULL) {
+        wl_buf = wl_shm_pool_create_buffer(
+            pool->wl_pool, new_offset,
+            buf->public.width, buf->public.height, buf->public.stride,
+            buf->with_alpha ? WL_SHM_FORMAT_ARGB8888 : WL_SHM_FORMAT_XRGB8888);
+
+        if (wl_buf == NULL) {
+            LOG_ERR("failed to create SHM buffer");
+            goto err;
+        }
     }
 
     /* One pixman image for each worker thread (do we really need multiple?) */
@@ -286,7 +288,8 @@ instantiate_offset(struct buffer_private *buf, off_t new_offset)
     buf->public.pix = pix;
     buf->offset = new_offset;
 
-    wl_buffer_add_listener(wl_buf, &buffer_listener, buf);
+    if (wl_buf != NULL)
+        wl_buffer_add_listener(wl_buf, &buffer_listener, buf);
     return true;
 
 err:
@@ -438,10 +441,13 @@ get_new_buffers(struct buffer_chain *chain, size_t count,
     }
 #endif
 
-    wl_pool = wl_shm_create_pool(chain->shm, pool_fd, memfd_size);
-    if (wl_pool == NULL) {
-        LOG_ERR("failed to create SHM pool");
-        goto err;
+    /* Headless chains (no wl_shm) only use the memfd */
+    if (chain->shm != NULL) {
+        wl_pool = wl_shm_create_pool(chain->shm, pool_fd, memfd_size);
+        if (wl_pool == NULL) {
+            LOG_ERR("failed to create SHM pool");
+            goto err;
+        }
     }
 
     pool = xmalloc(sizeof(*pool));
@@ -685,8 +691,8 @@ shm_scroll_forward(struct buffer_private *buf, int rows,
     xassert(can_punch_hole);
     xassert(buf->busy);
     xassert(buf->public.pix != NULL);
-    xassert(buf->public.wl_buf != NULL);
     xassert(pool != NULL);
+    xassert(buf->public.wl_buf != NULL || pool->wl_pool == NULL);
     xassert(pool->ref_count == 1);
     xassert(pool->fd >= 0);
 
@@ -42,6 +42,12 @@ void shm_fini(void);
 void shm_set_max_pool_size(off_t max_pool_size);
 
 struct buffer_chain;
+
+/*
+ * If 'shm' is NULL, buffers are backed by a memfd only; no wl_buffer
+ * is created, and the buffers cannot be attached to a surface. This
+ * is used when rendering headless (e.g. when benchmarking).
+ */
 struct buffer_chain *shm_chain_new(
     struct wl_shm *shm, bool scrollable, size_t pix_instances);
 void shm_chain_free(struct buffer_chain *chain);
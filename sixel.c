@@ -73,6 +73,7 @@ sixel_init(struct terminal *term, int p1, int p2, int p3)
     term->sixel.image.p = NULL;
     term->sixel.image.width = 0;
     term->sixel.image.height = 0;
+    term->sixel.image.alloc_width = 0;
     term->sixel.image.alloc_height = 0;
     term->sixel.image.bottom_pixel = 0;
 
@@ -155,13 +156,14 @@ sixel_erase(struct terminal *term, struct sixel *sixel)
     for (int i = 0; i < sixel->rows; i++) {
         int r = (sixel->pos.row + i) & (term->grid->num_rows - 1);
 
-        struct row *row = term->grid->rows[r];
+        struct row *row = grid_row_uncompact(term->grid, term->grid->rows[r]);
         if (row == NULL) {
             /* A resize/reflow may cause row to now be unallocated */
             continue;
         }
 
-        row->dirty = true;
+        grid_row_dirty_range(
+            row, sixel->pos.col, sixel->pos.col + sixel->cols - 1);
 
         for (int c = sixel->pos.col; c < min(sixel->pos.col + sixel->cols, term->cols); c++)
             row->cells[c].attrs.clean = 0;
@@ -1129,6 +1131,18 @@ sixel_unhook(struct terminal *term)
         term->sixel.pos.row -= rows_to_trim * term->sixel.pan;
     }
 
+    if (term->sixel.image.alloc_width > term->sixel.image.width) {
+        /* Drop the columns reserved by resize_horizontally() */
+        const int width = term->sixel.image.width;
+        const int alloc_width = term->sixel.image.alloc_width;
+        uint32_t *data = term->sixel.image.data;
+
+        for (int r = 1; r < term->sixel.image.height; r++)
+            memmove(&data[r * width], &data[r * alloc_width], width * sizeof(data[0]));
+
+        term->sixel.image.alloc_width = width;
+    }
+
     int pixel_row_idx = 0;
     int pixel_rows_left = term->sixel.image.height;
     const int stride = term->sixel.image.width * sizeof(uint32_t);
@@ -1289,8 +1303,8 @@ sixel_unhook(struct terminal *term)
 
         /* Dirty touched cells, and scroll terminal content if necessary */
         for (size_t i = 0; i < image.rows; i++) {
-            struct row *row = term->grid->rows[cur_row + i];
-            row->dirty = true;
+            struct row *row = grid_row_uncompact(term->grid, term->grid->rows[cur_row + i]);
+            grid_row_dirty_range(row, image.pos.col, image.pos.col + image.cols - 1);
 
             for (int col = image.pos.col;
                  col < min(image.pos.col + image.cols, term->cols);
@@ -1329,6 +1343,7 @@ sixel_unhook(struct terminal *term)
     term->sixel.image.p = NULL;
     term->sixel.image.width = 0;
     term->sixel.image.height = 0;
+    term->sixel.image.alloc_width = 0;
     term->sixel.pos = (struct coord){0, 0};
 
     free(term->sixel.private_palette);
@@ -1351,6 +1366,13 @@ memset_u32(uint32_t *data, uint32_t value, size_t count)
     wmemset((wchar_t *)data, (wchar_t)value, count);
 }
 
+/*
+ * Images without raster attributes grow one sixel at a time. To avoid
+ * re-allocating (and copying) the image for each new column, the
+ * allocation grows geometrically. The unused columns (between 'width'
+ * and 'alloc_width') are initialized as they become part of the image,
+ * and dropped in sixel_unhook().
+ */
 static void
 resize_horizontally(struct terminal *term, int new_width_mutable)
 {
@@ -1366,6 +1388,7 @@ resize_horizontally(struct terminal *term, int new_width_mutable)
 
     uint32_t *old_data = term->sixel.image.data;
     const int old_width = term->sixel.image.width;
+    const int old_alloc_width = term->sixel.image.alloc_width;
     const int new_width = new_width_mutable;
 
     int height;
@@ -1387,16 +1410,32 @@ resize_horizontally(struct terminal *term, int new_width_mutable)
     xassert(new_width > 0);
     xassert(alloc_height > 0);
 
-    /* Width (and thus stride) change - need to allocate a new buffer */
-    uint32_t *new_data = xmalloc(new_width * alloc_height * sizeof(uint32_t));
-
     uint32_t bg = term->sixel.transparent_bg ? 0 : term->sixel.palette[0];
 
+    if (new_width <= old_alloc_width) {
+        /* Initialize the new columns to background color */
+        for (uint32_t *row = old_data, *end = &old_data[alloc_height * old_alloc_width];
+             row < end;
+             row += old_alloc_width)
+        {
+            memset_u32(&row[old_width], bg, new_width - old_width);
+        }
+
+        term->sixel.image.width = new_width;
+        return;
+    }
+
+    const int alloc_width = min(
+        max(new_width, 2 * old_alloc_width), (int)term->sixel.max_width);
+
+    /* Width (and thus stride) change - need to allocate a new buffer */
+    uint32_t *new_data = xmalloc(alloc_width * alloc_height * sizeof(uint32_t));
+
     /* Copy old rows, and initialize new columns to background color */
-    const uint32_t *end = &new_data[alloc_height * new_width];
+    const uint32_t *end = &new_data[alloc_height * alloc_width];
     for (uint32_t *n = new_data, *o = old_data;
          n < end;
-         n += new_width, o += old_width)
+         n += alloc_width, o += old_alloc_width)
     {
         memcpy(n, o, old_width * sizeof(uint32_t));
         memset_u32(&n[old_width], bg, new_width - old_width);
@@ -1406,8 +1445,9 @@ resize_horizontally(struct terminal *term, int new_width_mutable)
 
     term->sixel.image.data = new_data;
     term->sixel.image.width = new_width;
+    term->sixel.image.alloc_width = alloc_width;
 
-    const int ofs = term->sixel.pos.row * new_width + term->sixel.pos.col;
+    const int ofs = term->sixel.pos.row * alloc_width + term->sixel.pos.col;
     term->sixel.image.p = &term->sixel.image.data[ofs];
 }
 
@@ -1425,6 +1465,7 @@ resize_vertically(struct terminal *term, const int new_height)
 
     uint32_t *old_data = term->sixel.image.data;
     const int width = term->sixel.image.width;
+    const int stride = term->sixel.image.alloc_width;
     const int old_height = term->sixel.image.height;
     const int sixel_row_height = 6 * term->sixel.pan;
 
@@ -1440,7 +1481,7 @@ resize_vertically(struct terminal *term, const int new_height)
     }
 
     uint32_t *new_data = realloc(
-        old_data, width * alloc_height * sizeof(uint32_t));
+        old_data, stride * alloc_height * sizeof(uint32_t));
 
     if (new_data == NULL) {
         LOG_ERRNO("failed to reallocate sixel image buffer");
@@ -1449,15 +1490,14 @@ resize_vertically(struct terminal *term, const int new_height)
 
     const uint32_t bg = term->sixel.transparent_bg ? 0 : term->sixel.palette[0];
 
-    memset_u32(&new_data[old_height * width],
+    memset_u32(&new_data[old_height * stride],
                bg,
-               (alloc_height - old_height) * width);
+               (alloc_height - old_height) * stride);
 
     term->sixel.image.height = new_height;
     term->sixel.image.alloc_height = alloc_height;
 
-    const int ofs =
-        term->sixel.pos.row * term->sixel.image.width + term->sixel.pos.col;
+    const int ofs = term->sixel.pos.row * stride + term->sixel.pos.col;
 
     term->sixel.image.data = new_data;
     term->sixel.image.p = &term->sixel.image.data[ofs];
@@ -1485,6 +1525,7 @@ resize(struct terminal *term, int new_width_mutable, int new_height_mutable)
 
     uint32_t *old_data = term->sixel.image.data;
     const int old_width = term->sixel.image.width;
+    const int old_stride = term->sixel.image.alloc_width;
     const int old_height = term->sixel.image.height;
     const int new_width = new_width_mutable;
     const int new_height = new_height_mutable;
@@ -1524,11 +1565,14 @@ resize(struct terminal *term, int new_width_mutable, int new_height_mutable)
     const bool initialize_bg =
         !term->sixel.transparent_bg || new_width == old_width;
 
+    int new_stride = new_width;
+
     if (new_width == old_width) {
         /* Width (and thus stride) is the same, so we can simply
          * re-alloc the existing buffer */
 
-        new_data = realloc(old_data, new_width * alloc_new_height * sizeof(uint32_t));
+        new_stride = old_stride;
+        new_data = realloc(old_data, new_stride * alloc_new_height * sizeof(uint32_t));
         if (new_data == NULL) {
             LOG_ERRNO("failed to reallocate sixel image buffer");
             return false;
@@ -1551,7 +1595,7 @@ resize(struct terminal *term, int new_width_mutable, int new_height_mutable)
 
         for (uint32_t *n = new_data, *o = old_data;
              n < end;
-             n += new_width, o += old_width)
+             n += new_width, o += old_stride)
         {
             memcpy(n, o, old_width * sizeof(uint32_t));
             memset_u32(&n[old_width], bg, new_width - old_width);
@@ -1560,61 +1604,55 @@ resize(struct terminal *term, int new_width_mutable, int new_height_mutable)
     }
 
     if (initialize_bg) {
-        memset_u32(&new_data[old_height * new_width],
+        memset_u32(&new_data[old_height * new_stride],
                    bg,
-                   (alloc_new_height - old_height) * new_width);
+                   (alloc_new_height - old_height) * new_stride);
     }
 
     xassert(new_data != NULL);
     term->sixel.image.data = new_data;
     term->sixel.image.width = new_width;
     term->sixel.image.height = new_height;
+    term->sixel.image.alloc_width = new_stride;
     term->sixel.image.alloc_height = alloc_new_height;
-    term->sixel.image.p = &term->sixel.image.data[term->sixel.pos.row * new_width + term->sixel.pos.col];
+    term->sixel.image.p = &term->sixel.image.data[term->sixel.pos.row * new_stride + term->sixel.pos.col];
 
     return true;
 }
 
-static void
-sixel_add_generic(struct terminal *term, uint32_t *data, int stride, uint32_t color,
-                  uint8_t sixel)
+static void ALWAYS_INLINE inline
+sixel_add_ar_11(struct terminal *term, uint32_t *data, int stride, uint32_t color,
+                uint8_t sixel)
 {
-    const int pan = term->sixel.pan;
+    xassert(term->sixel.pan == 1);
 
-    for (int i = 0; i < 6; i++, sixel >>= 1) {
-        if (sixel & 1) {
-            for (int r = 0; r < pan; r++, data += stride)
-                *data = color;
-        } else
-            data += stride * pan;
+    /*
+     * Branch free: each pixel is either set to 'color', or re-written
+     * with its current value. The bit patterns of "real" images are
+     * too random for the branch predictor.
+     */
+    for (int i = 0; i < 6; i++, data += stride) {
+        const uint32_t mask = -(uint32_t)((sixel >> i) & 1);
+        *data = (color & mask) | (*data & ~mask);
     }
-
-    xassert(sixel == 0);
 }
 
+/*
+ * Writes 'count' columns of the same sixel. This is done one pixel
+ * row at a time, turning the run into (at most) 6*pan contiguous
+ * fills, instead of 'count' strided, six pixel high, columns.
+ */
 static void ALWAYS_INLINE inline
-sixel_add_ar_11(struct terminal *term, uint32_t *data, int stride, uint32_t color,
-                uint8_t sixel)
+sixel_add_run(uint32_t *data, int stride, int pan, uint32_t color,
+              uint8_t sixel, unsigned count)
 {
-    xassert(term->sixel.pan == 1);
-
-    if (sixel & 0x01)
-        *data = color;
-    data += stride;
-    if (sixel & 0x02)
-        *data = color;
-    data += stride;
-    if (sixel & 0x04)
-        *data = color;
-    data += stride;
-    if (sixel & 0x08)
-        *data = color;
-    data += stride;
-    if (sixel & 0x10)
-        *data = color;
-    data += stride;
-    if (sixel & 0x20)
-        *data = color;
+    for (; sixel != 0; sixel >>= 1) {
+        if (sixel & 1) {
+            for (int r = 0; r < pan; r++, data += stride)
+                memset_u32(data, color, count);
+        } else
+            data += stride * pan;
+    }
 }
 
 static void
@@ -1634,17 +1672,15 @@ sixel_add_many_generic(struct terminal *term, uint8_t c, unsigned count)
             return;
     }
 
-    uint32_t color = term->sixel.color;
     uint32_t *data = term->sixel.image.p;
-    uint32_t *end = data + count;
 
     term->sixel.pos.col = col + count;
-    term->sixel.image.p = end;
+    term->sixel.image.p = data + count;
     term->sixel.image.bottom_pixel |= c;
 
-    for (; data < end; data++)
-        sixel_add_generic(term, data, width, color, c);
-
+    sixel_add_run(
+        data, term->sixel.image.alloc_width, term->sixel.pan,
+        term->sixel.color, c, count);
 }
 
 static void ALWAYS_INLINE inline
@@ -1654,14 +1690,11 @@ sixel_add_one_ar_11(struct terminal *term, uint8_t c)
     xassert(term->sixel.pad == 1);
 
     int col = term->sixel.pos.col;
-    int width = term->sixel.image.width;
 
-    if (unlikely(col >= width)) {
-        resize_horizontally(term, col + count);
-        width = term->sixel.image.width;
-        count = min(count, max(width - col, 0));
+    if (unlikely(col >= term->sixel.image.width)) {
+        resize_horizontally(term, col + 1);
 
-        if (unlikely(count == 0))
+        if (unlikely(col >= term->sixel.image.width))
             return;
     }
 
@@ -1671,7 +1704,8 @@ sixel_add_one_ar_11(struct terminal *term, uint8_t c)
     term->sixel.image.p += 1;
     term->sixel.image.bottom_pixel |= c;
 
-    sixel_add_ar_11(term, data, width, term->sixel.color, c);
+    sixel_add_ar_11(
+        term, data, term->sixel.image.alloc_width, term->sixel.color, c);
 }
 
 static void
@@ -1694,15 +1728,17 @@ sixel_add_many_ar_11(struct terminal *term, uint8_t c, unsigned count)
 
     uint32_t color = term->sixel.color;
     uint32_t *data = term->sixel.image.p;
-    uint32_t *end = data + count;
+    const int stride = term->sixel.image.alloc_width;
 
     term->sixel.pos.col += count;
-    term->sixel.image.p = end;
+    term->sixel.image.p = data + count;
     term->sixel.image.bottom_pixel |= c;
 
-    for (; data < end; data++)
-        sixel_add_ar_11(term, data, width, color, c);
-
+    if (count < 4) {
+        for (uint32_t *end = data + count; data < end; data++)
+            sixel_add_ar_11(term, data, stride, color, c);
+    } else
+        sixel_add_run(data, stride, 1, color, c, count);
 }
 
 IGNORE_WARNING("-Wpedantic")
@@ -1740,7 +1776,7 @@ decsixel_generic(struct terminal *term, uint8_t c)
              * path in sixel_add().
              */
             term->sixel.pos.col = 0;
-            term->sixel.image.p = &term->sixel.image.data[term->sixel.pos.row * term->sixel.image.width];
+            term->sixel.image.p = &term->sixel.image.data[term->sixel.pos.row * term->sixel.image.alloc_width];
         }
         break;
 
@@ -1748,7 +1784,7 @@ decsixel_generic(struct terminal *term, uint8_t c)
         term->sixel.pos.row += 6 * term->sixel.pan;
         term->sixel.pos.col = 0;
         term->sixel.image.bottom_pixel = 0;
-        term->sixel.image.p = &term->sixel.image.data[term->sixel.pos.row * term->sixel.image.width];
+        term->sixel.image.p = &term->sixel.image.data[term->sixel.pos.row * term->sixel.image.alloc_width];
 
         if (term->sixel.pos.row >= term->sixel.image.alloc_height) {
             if (!resize_vertically(term, term->sixel.pos.row + 6 * term->sixel.pan))
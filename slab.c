@@ -0,0 +1,278 @@
+#include "slab.h"
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "debug.h"
+#include "macros.h"
+#include "xmalloc.h"
+
+#define MIN_CHUNK_SIZE (64 * 1024)
+#define MIN_SLOTS_PER_CHUNK 16
+
+/* Each slot is prefixed with a pointer to its chunk */
+#define SLOT_HEADER_SIZE alignof(max_align_t)
+
+struct slab_chunk {
+    struct slab *slab;
+
+    /* Link in slab->partial; only valid while the chunk has free slots */
+    struct slab_chunk *prev;
+    struct slab_chunk *next;
+
+    void *free_list;    /* Freed slots, linked through their payload */
+    size_t used;        /* Live objects */
+    size_t bumped;      /* Slots handed out at least once */
+    size_t size;        /* Size of the mapping */
+
+    alignas(max_align_t) uint8_t data[];
+};
+
+struct slab {
+    size_t obj_size;
+    size_t slot_size;
+    size_t slots_per_chunk;
+    size_t chunk_size;
+    size_t live;
+
+    struct slab_chunk *partial;  /* Chunks with at least one free slot */
+    struct slab_chunk *spare;    /* Empty chunk, kept to avoid re-mapping */
+};
+
+static inline size_t
+align_up(size_t v, size_t align)
+{
+    return (v + align - 1) / align * align;
+}
+
+static inline struct slab_chunk *
+chunk_of(const void *obj)
+{
+    const uint8_t *slot = (const uint8_t *)obj - SLOT_HEADER_SIZE;
+    return *(struct slab_chunk *const *)slot;
+}
+
+struct slab *
+slab_new(size_t obj_size)
+{
+    xassert(obj_size > 0);
+
+    /* Freed objects store the free list link in their payload */
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+
+    const size_t slot_size = align_up(
+        SLOT_HEADER_SIZE + obj_size, alignof(max_align_t));
+
+    size_t chunk_size = sizeof(struct slab_chunk) + MIN_SLOTS_PER_CHUNK * slot_size;
+    if (chunk_size < MIN_CHUNK_SIZE)
+        chunk_size = MIN_CHUNK_SIZE;
+    chunk_size = align_up(chunk_size, sysconf(_SC_PAGESIZE));
+
+    struct slab *slab = xmalloc(sizeof(*slab));
+    *slab = (struct slab){
+        .obj_size = obj_size,
+        .slot_size = slot_size,
+        .slots_per_chunk = (chunk_size - sizeof(struct slab_chunk)) / slot_size,
+        .chunk_size = chunk_size,
+    };
+    return slab;
+}
+
+static void
+chunk_link(struct slab *slab, struct slab_chunk *chunk)
+{
+    chunk->prev = NULL;
+    chunk->next = slab->partial;
+    if (slab->partial != NULL)
+        slab->partial->prev = chunk;
+    slab->partial = chunk;
+}
+
+static void
+chunk_unlink(struct slab *slab, struct slab_chunk *chunk)
+{
+    if (chunk->prev != NULL)
+        chunk->prev->next = chunk->next;
+    else
+        slab->partial = chunk->next;
+    if (chunk->next != NULL)
+        chunk->next->prev = chunk->prev;
+    chunk->prev = chunk->next = NULL;
+}
+
+static void
+chunk_unmap(struct slab_chunk *chunk)
+{
+    munmap(chunk, chunk->size);
+}
+
+void
+slab_destroy(struct slab *slab)
+{
+    if (slab == NULL)
+        return;
+
+    /* Full chunks aren't tracked; all objects must have been freed */
+    xassert(slab->live == 0);
+    xassert(slab->partial == NULL);
+
+    if (slab->spare != NULL)
+        chunk_unmap(slab->spare);
+    free(slab);
+}
+
+static struct slab_chunk *
+chunk_new(struct slab *slab)
+{
+    struct slab_chunk *chunk = slab->spare;
+
+    if (chunk != NULL)
+        slab->spare = NULL;
+    else {
+        chunk = mmap(NULL, slab->chunk_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (unlikely(chunk == MAP_FAILED))
+            FATAL_ERROR(__func__, ENOMEM);
+        chunk->slab = slab;
+        chunk->size = slab->chunk_size;
+    }
+
+    chunk->free_list = NULL;
+    chunk->used = 0;
+    chunk->bumped = 0;
+    return chunk;
+}
+
+void *
+slab_alloc(struct slab *slab)
+{
+    struct slab_chunk *chunk = slab->partial;
+
+    if (unlikely(chunk == NULL)) {
+        chunk = chunk_new(slab);
+        chunk_link(slab, chunk);
+    }
+
+    uint8_t *obj;
+
+    if (chunk->free_list != NULL) {
+        obj = chunk->free_list;
+        chunk->free_list = *(void **)obj;
+    } else {
+        xassert(chunk->bumped < slab->slots_per_chunk);
+        uint8_t *slot = &chunk->data[chunk->bumped++ * slab->slot_size];
+        *(struct slab_chunk **)slot = chunk;
+        obj = slot + SLOT_HEADER_SIZE;
+    }
+
+    if (++chunk->used == slab->slots_per_chunk)
+        chunk_unlink(slab, chunk);
+
+    slab->live++;
+    return obj;
+}
+
+void
+slab_free(void *obj)
+{
+    if (obj == NULL)
+        return;
+
+    struct slab_chunk *chunk = chunk_of(obj);
+    struct slab *slab = chunk->slab;
+
+    xassert(chunk->used > 0);
+    xassert(slab->live > 0);
+
+    const bool was_full = chunk->used == slab->slots_per_chunk;
+
+    *(void **)obj = chunk->free_list;
+    chunk->free_list = obj;
+    chunk->used--;
+    slab->live--;
+
+    if (chunk->used == 0) {
+        if (!was_full)
+            chunk_unlink(slab, chunk);
+
+        if (slab->spare == NULL)
+            slab->spare = chunk;
+        else
+            chunk_unmap(chunk);
+    } else if (was_full)
+        chunk_link(slab, chunk);
+}
+
+struct slab *
+slab_of(const void *obj)
+{
+    return chunk_of(obj)->slab;
+}
+
+size_t
+slab_obj_size(const struct slab *slab)
+{
+    return slab->obj_size;
+}
+
+size_t
+slab_live_count(const struct slab *slab)
+{
+    return slab->live;
+}
+
+UNITTEST
+{
+    struct slab *slab = slab_new(3);
+    xassert(slab_obj_size(slab) == sizeof(void *));
+
+    struct slab *big = slab_new(MIN_CHUNK_SIZE);
+    xassert(big->slots_per_chunk >= MIN_SLOTS_PER_CHUNK);
+    slab_destroy(big);
+
+    const size_t count = slab->slots_per_chunk * 3 + 5;
+    void **objs = xmalloc(count * sizeof(objs[0]));
+
+    for (size_t i = 0; i < count; i++) {
+        objs[i] = slab_alloc(slab);
+        xassert(((uintptr_t)objs[i] & (alignof(max_align_t) - 1)) == 0);
+        xassert(slab_of(objs[i]) == slab);
+        *(size_t *)objs[i] = i;
+    }
+    xassert(slab_live_count(slab) == count);
+
+    for (size_t i = 0; i < count; i++)
+        xassert(*(size_t *)objs[i] == i);
+
+    /* Free every other object; freed slots are re-used first */
+    for (size_t i = 0; i < count; i += 2)
+        slab_free(objs[i]);
+    for (size_t i = 0; i < count; i += 2) {
+        objs[i] = slab_alloc(slab);
+        xassert(slab_of(objs[i]) == slab);
+    }
+    xassert(slab_live_count(slab) == count);
+    xassert(slab->partial == NULL || slab->partial->bumped < slab->slots_per_chunk);
+
+    for (size_t i = 0; i < count; i++)
+        slab_free(objs[i]);
+    xassert(slab_live_count(slab) == 0);
+    xassert(slab->partial == NULL);
+    xassert(slab->spare != NULL);
+
+    /* The spare chunk is recycled */
+    struct slab_chunk *spare = slab->spare;
+    void *obj = slab_alloc(slab);
+    xassert(chunk_of(obj) == spare);
+    xassert(slab->spare == NULL);
+    slab_free(obj);
+
+    free(objs);
+    slab_destroy(slab);
+}
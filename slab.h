@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Fixed size object allocator.
+ *
+ * Objects are carved out of large, anonymously mapped chunks. Each
+ * object is prefixed with a pointer to its chunk, meaning an object
+ * can be freed without knowing which slab it came from. A chunk is
+ * unmapped as soon as its last object is freed (one empty chunk is
+ * kept around per slab, to avoid mmap/munmap ping-pong), so memory
+ * is returned to the OS when e.g. the scrollback is erased.
+ *
+ * Not thread safe.
+ */
+struct slab;
+
+struct slab *slab_new(size_t obj_size);
+void slab_destroy(struct slab *slab);
+
+void *slab_alloc(struct slab *slab);
+void slab_free(void *obj);
+
+/* Slab an object was allocated from */
+struct slab *slab_of(const void *obj);
+
+size_t slab_obj_size(const struct slab *slab);
+size_t slab_live_count(const struct slab *slab);
@@ -32,6 +32,7 @@
 #include "ime.h"
 #include "input.h"
 #include "notify.h"
+#include "osc.h"
 #include "quirks.h"
 #include "reaper.h"
 #include "render.h"
@@ -290,6 +291,11 @@ fdm_ptmx(struct fdm *fdm, int fd, int events, void *data)
         }
 
         xassert(term->interactive_resizing.grid == NULL);
+
+        /* Text streams read directly from the grid */
+        if (unlikely(tll_length(term->text_streams) > 0))
+            term_text_streams_snapshot(term);
+
         vt_from_slave(term, buf, count);
     }
 
@@ -463,7 +469,7 @@ fdm_blink(struct fdm *fdm, int fd, int events, void *data)
 
             if (cell->attrs.blink) {
                 cell->attrs.clean = 0;
-                row->dirty = true;
+                grid_row_dirty_range(row, col, col);
                 no_blinking_cells = false;
             }
         }
@@ -512,6 +518,88 @@ term_arm_blink_timer(struct terminal *term)
     term->blink.fd = fd;
 }
 
+static bool
+fdm_reflow_pending(struct fdm *fdm, int fd, int events, void *data)
+{
+    if (events & EPOLLHUP)
+        return false;
+
+    struct terminal *term = data;
+    uint64_t expiration_count;
+    ssize_t ret = read(
+        term->reflow.fd, &expiration_count, sizeof(expiration_count));
+
+    if (ret < 0) {
+        if (errno == EAGAIN)
+            return true;
+
+        LOG_ERRNO("failed to read scrollback reflow timer");
+        return false;
+    }
+
+    if (!grid_reflow_pending_step(&term->normal)) {
+        LOG_DBG("scrollback reflow done, disarming timer");
+        fdm_del(term->fdm, term->reflow.fd);
+        term->reflow.fd = -1;
+    }
+
+    return true;
+}
+
+void
+term_reflow_pending_schedule(struct terminal *term)
+{
+    if (term->normal.reflow_pending == NULL)
+        return;
+
+    if (term->is_searching) {
+        /* Search may need all of the scrollback */
+        term_reflow_pending_finish(term);
+        return;
+    }
+
+    if (term->reflow.fd < 0) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (fd < 0) {
+            LOG_ERRNO("failed to create scrollback reflow timer FD");
+            term_reflow_pending_finish(term);
+            return;
+        }
+
+        if (!fdm_add(term->fdm, fd, EPOLLIN, &fdm_reflow_pending, term)) {
+            close(fd);
+            term_reflow_pending_finish(term);
+            return;
+        }
+
+        term->reflow.fd = fd;
+    }
+
+    /*
+     * Wait for the resizing to settle; a resize reflows everything
+     * that has been reflowed at the time. Then reflow a chunk per
+     * expiration.
+     */
+    const struct itimerspec timer = {
+        .it_value = {.tv_sec = 0, .tv_nsec = 100 * 1000000},
+        .it_interval = {.tv_sec = 0, .tv_nsec = 1000000},
+    };
+
+    if (timerfd_settime(term->reflow.fd, 0, &timer, NULL) < 0) {
+        LOG_ERRNO("failed to arm scrollback reflow timer");
+        term_reflow_pending_finish(term);
+    }
+}
+
+void
+term_reflow_pending_finish(struct terminal *term)
+{
+    grid_reflow_pending_finish(&term->normal);
+
+    fdm_del(term->fdm, term->reflow.fd);
+    term->reflow.fd = -1;
+}
+
 static void
 cursor_refresh(struct terminal *term)
 {
@@ -519,7 +607,9 @@ cursor_refresh(struct terminal *term)
         return;
 
     term->grid->cur_row->cells[term->grid->cursor.point.col].attrs.clean = 0;
-    term->grid->cur_row->dirty = true;
+    grid_row_dirty_range(
+        term->grid->cur_row,
+        term->grid->cursor.point.col, term->grid->cursor.point.col);
     render_refresh(term);
 }
 
@@ -695,54 +785,6 @@ fdm_app_id_update_timeout(struct fdm *fdm, int fd, int events, void *data)
     return true;
 }
 
-static bool
-initialize_render_workers(struct terminal *term)
-{
-    LOG_INFO("using %hu rendering threads", term->render.workers.count);
-
-    if (sem_init(&term->render.workers.start, 0, 0) < 0 ||
-        sem_init(&term->render.workers.done, 0, 0) < 0)
-    {
-        LOG_ERRNO("failed to instantiate render worker semaphores");
-        return false;
-    }
-
-    int err;
-    if ((err = mtx_init(&term->render.workers.lock, mtx_plain)) != thrd_success) {
-        LOG_ERR("failed to instantiate render worker mutex: %s (%d)",
-                thrd_err_as_string(err), err);
-        goto err_sem_destroy;
-    }
-
-    term->render.workers.threads = xcalloc(
-        term->render.workers.count, sizeof(term->render.workers.threads[0]));
-
-    for (size_t i = 0; i < term->render.workers.count; i++) {
-        struct render_worker_context *ctx = xmalloc(sizeof(*ctx));
-        *ctx = (struct render_worker_context) {
-            .term = term,
-            .my_id = 1 + i,
-        };
-
-        int ret = thrd_create(
-            &term->render.workers.threads[i], &render_worker_thread, ctx);
-        if (ret != thrd_success) {
-
-            LOG_ERR("failed to create render worker thread: %s (%d)",
-                    thrd_err_as_string(ret), ret);
-            term->render.workers.threads[i] = 0;
-            return false;
-        }
-    }
-
-    return true;
-
-err_sem_destroy:
-    sem_destroy(&term->render.workers.start);
-    sem_destroy(&term->render.workers.done);
-    return false;
-}
-
 static void
 free_custom_glyph(struct fcft_glyph **glyph)
 {
@@ -819,6 +861,8 @@ term_set_fonts(struct terminal *term, struct fcft_font *fonts[static 4],
     free_custom_glyphs(
         &term->custom_glyphs.octants, GLYPH_OCTANTS_COUNT);
 
+    render_tile_caches_flush(term);
+
     const struct config *conf = term->conf;
 
     const struct fcft_glyph *M = fcft_rasterize_char_utf32(
@@ -1261,6 +1305,7 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .scale_before_unmap = -1,
         .flash = {.fd = flash_fd},
         .blink = {.fd = -1},
+        .reflow = {.fd = -1},
         .vt = {
             .state = 0,  /* STATE_GROUND */
         },
@@ -1303,7 +1348,7 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         .normal = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
         .alt = {.scroll_damage = tll_init(), .sixel_images = tll_init()},
         .grid = &term->normal,
-        .composed = NULL,
+        .composed = {0},
         .alt_scrolling = conf->mouse.alternate_scroll_mode,
         .meta = {
             .esc_prefix = true,
@@ -1336,7 +1381,6 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
             },
             .workers = {
                 .count = conf->render_worker_count,
-                .queue = tll_init(),
             },
         },
         .delayed_render_timer = {
@@ -1432,7 +1476,7 @@ term_init(const struct config *conf, struct fdm *fdm, struct reaper *reaper,
         break;
     }
 
-    if (!initialize_render_workers(term))
+    if (!render_workers_init(term))
         goto err;
 
     return term;
@@ -1676,6 +1720,7 @@ term_shutdown(struct terminal *term)
     fdm_del(term->fdm, term->delayed_render_timer.upper_fd);
     fdm_del(term->fdm, term->blink.fd);
     fdm_del(term->fdm, term->flash.fd);
+    fdm_del(term->fdm, term->reflow.fd);
 
     del_utmp_record(term->conf, term->reaper, term->ptmx);
 
@@ -1728,6 +1773,7 @@ term_shutdown(struct terminal *term)
     term->delayed_render_timer.upper_fd = -1;
     term->blink.fd = -1;
     term->flash.fd = -1;
+    term->reflow.fd = -1;
     term->ptmx = -1;
 
     int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
@@ -1784,6 +1830,7 @@ term_destroy(struct terminal *term)
     fdm_del(term->fdm, term->cursor_blink.fd);
     fdm_del(term->fdm, term->blink.fd);
     fdm_del(term->fdm, term->flash.fd);
+    fdm_del(term->fdm, term->reflow.fd);
     fdm_del(term->fdm, term->ptmx);
     if (term->shutdown.terminate_timeout_fd >= 0)
         fdm_del(term->fdm, term->shutdown.terminate_timeout_fd);
@@ -1793,33 +1840,21 @@ term_destroy(struct terminal *term)
         term->window = NULL;
     }
 
-    mtx_lock(&term->render.workers.lock);
-    xassert(tll_length(term->render.workers.queue) == 0);
-
-    /* Count livinig threads - we may get here when only some of the
-     * threads have been successfully started */
-    size_t worker_count = 0;
-    if (term->render.workers.threads != NULL) {
-        for (size_t i = 0; i < term->render.workers.count; i++, worker_count++) {
-            if (term->render.workers.threads[i] == 0)
-                break;
-        }
-
-        for (size_t i = 0; i < worker_count; i++) {
-            sem_post(&term->render.workers.start);
-            tll_push_back(term->render.workers.queue, -2);
-        }
-    }
-    mtx_unlock(&term->render.workers.lock);
+    render_workers_destroy(term);
 
     key_binding_unref(term->wl->key_binding_manager, term->conf);
 
     urls_reset(term);
 
+    /* Pipe commands may outlive us; extract what's left before
+     * freeing the grids (and the composed characters) */
+    term_text_streams_detach(term);
+
+    osc_stream_destroy(term);
     free(term->vt.osc.data);
     free(term->vt.osc8.uri);
 
-    composed_free(term->composed);
+    composed_free(&term->composed);
 
     free(term->app_id);
     free(term->window_title);
@@ -1843,19 +1878,6 @@ term_destroy(struct terminal *term)
     free(term->search.buf);
     free(term->search.last.buf);
 
-    if (term->render.workers.threads != NULL) {
-        for (size_t i = 0; i < term->render.workers.count; i++) {
-            if (term->render.workers.threads[i] != 0)
-                thrd_join(term->render.workers.threads[i], NULL);
-        }
-    }
-    free(term->render.workers.threads);
-    mtx_destroy(&term->render.workers.lock);
-    sem_destroy(&term->render.workers.start);
-    sem_destroy(&term->render.workers.done);
-    xassert(tll_length(term->render.workers.queue) == 0);
-    tll_free(term->render.workers.queue);
-
     shm_unref(term->render.last_buf);
     shm_chain_free(term->render.chains.grid);
     shm_chain_free(term->render.chains.search);
@@ -2001,7 +2023,7 @@ erase_cell_range(struct terminal *term, struct row *row, int start, int end)
     xassert(start < term->cols);
     xassert(end < term->cols);
 
-    row->dirty = true;
+    grid_row_dirty_range(row, start, end);
 
     const enum color_source bg_src = term->vt.attrs.bg_src;
 
@@ -2069,6 +2091,7 @@ term_reset(struct terminal *term, bool hard)
     term->scroll_region.end = term->rows;
 
     free(term->vt.osc8.uri);
+    osc_stream_destroy(term);
     free(term->vt.osc.data);
 
     term->vt = (struct vt){
@@ -2156,6 +2179,7 @@ term_reset(struct terminal *term, bool hard)
         grid_row_free(term->normal.rows[i]);
         term->normal.rows[i] = NULL;
     }
+    grid_reflow_pending_discard(&term->normal);
     for (size_t i = term->rows; i < term->alt.num_rows; i++) {
         grid_row_free(term->alt.rows[i]);
         term->alt.rows[i] = NULL;
@@ -2423,7 +2447,7 @@ term_damage_rows(struct terminal *term, int start, int end)
     xassert(start <= end);
     for (int r = start; r <= end; r++) {
         struct row *row = grid_row(term->grid, r);
-        row->dirty = true;
+        grid_row_dirty(row);
         for (int c = 0; c < term->grid->num_cols; c++)
             row->cells[c].attrs.clean = 0;
     }
@@ -2435,7 +2459,7 @@ term_damage_rows_in_view(struct terminal *term, int start, int end)
     xassert(start <= end);
     for (int r = start; r <= end; r++) {
         struct row *row = grid_row_in_view(term->grid, r);
-        row->dirty = true;
+        grid_row_dirty(row);
         for (int c = 0; c < term->grid->num_cols; c++)
             row->cells[c].attrs.clean = 0;
     }
@@ -2457,7 +2481,9 @@ void
 term_damage_cursor(struct terminal *term)
 {
     term->grid->cur_row->cells[term->grid->cursor.point.col].attrs.clean = 0;
-    term->grid->cur_row->dirty = true;
+    grid_row_dirty_range(
+        term->grid->cur_row,
+        term->grid->cursor.point.col, term->grid->cursor.point.col);
 }
 
 void
@@ -2524,8 +2550,9 @@ term_damage_color(struct terminal *term, enum color_source src, int idx)
             }
 
             if (dirty) {
+                const int col = cell - row->cells;
                 cell->attrs.clean = 0;
-                row->dirty = true;
+                grid_row_dirty_range(row, col, col);
             }
         }
 
@@ -2549,7 +2576,7 @@ term_damage_color(struct terminal *term, enum color_source src, int idx)
                     for (; c < e; c++)
                         c->attrs.clean = 0;
 
-                    row->dirty = true;
+                    grid_row_dirty_range(row, range->start, range->end);
                 }
             }
         }
@@ -2689,6 +2716,8 @@ term_erase_scrollback(struct terminal *term)
             break;
     }
 
+    grid_reflow_pending_discard(term->grid);
+
     term->grid->view = term->grid->offset;
 
 #if defined(_DEBUG)
@@ -2736,9 +2765,7 @@ UNITTEST
 #define populate_scrollback() do {                                      \
         for (int i = 0; i < scrollback_rows; i++) {                     \
             if (term.normal.rows[i] == NULL) {                          \
-                struct row *r = xcalloc(1, sizeof(*term.normal.rows[i])); \
-                r->cells = xcalloc(cols, sizeof(r->cells[0]));          \
-                term.normal.rows[i] = r;                                \
+                term.normal.rows[i] = grid_row_alloc(cols, true);       \
             }                                                           \
         }                                                               \
     } while (0)
@@ -3043,6 +3070,12 @@ term_scroll_partial(struct terminal *term, struct scroll_region region, int rows
     for (int i = term->rows - 1; i >= region.end; i--)
         grid_swap_row(term->grid, i - rows, i);
 
+    /* Lines scrolled out into the scrollback are compacted when rendering */
+    if (term->grid == &term->normal) {
+        term->grid->pending_compact = min(
+            term->grid->pending_compact + rows, term->grid->num_rows);
+    }
+
     /* Erase scrolled in lines */
     for (int r = region.end - rows; r < region.end; r++) {
         struct row *row = grid_row_and_alloc(term->grid, r);
@@ -3073,6 +3106,10 @@ term_scroll_reverse_partial(struct terminal *term,
     /* Verify scroll amount has been clamped */
     xassert(rows <= region.end - region.start);
 
+    /* The lines scrolled in are taken from the scrollback */
+    if (unlikely(term->grid->reflow_pending != NULL))
+        term_reflow_pending_finish(term);
+
     /* Cancel selections that cannot be scrolled */
     if (unlikely(term->selection.coords.end.row >= 0)) {
         /*
@@ -3116,6 +3153,11 @@ term_scroll_reverse_partial(struct terminal *term,
         term->grid->view = term->grid->offset;
     }
 
+    if (term->grid == &term->normal) {
+        term->grid->pending_compact =
+            max(term->grid->pending_compact - rows, 0);
+    }
+
     /* Bottom non-scrolling region */
     for (int i = region.end + rows; i < term->rows + rows; i++)
         grid_swap_row(term->grid, i, i - rows);
@@ -3809,6 +3851,8 @@ print_insert(struct terminal *term, int width)
     /* Mark moved cells as dirty */
     for (size_t i = term->grid->cursor.point.col + width; i < term->cols; i++)
         row->cells[i].attrs.clean = 0;
+    grid_row_dirty_range(
+        row, term->grid->cursor.point.col + width, term->cols - 1);
 }
 
 static void
@@ -3839,7 +3883,7 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
     bool use_sgr_attrs)
 {
     struct row *row = grid_row(term->grid, r);
-    row->dirty = true;
+    grid_row_dirty_range(row, c, c + count - 1);
 
     xassert(c + count <= term->cols);
 
@@ -3888,6 +3932,14 @@ term_fill(struct terminal *term, int r, int c, uint8_t data, size_t count,
     }
 }
 
+/* DEC special graphics, 0x60 - 0x7e */
+static const char32_t vt100_0[] = {
+    U'◆', U'▒', U'␉', U'␌', U'␍', U'␊', U'°', U'±', /* ` - g */
+    U'␤', U'␋', U'┘', U'┐', U'┌', U'└', U'┼', U'⎺', /* h - o */
+    U'⎻', U'─', U'⎼', U'⎽', U'├', U'┤', U'┴', U'┬', /* p - w */
+    U'│', U'≤', U'≥', U'π', U'≠', U'£', U'·',       /* x - ~ */
+};
+
 void
 term_print(struct terminal *term, char32_t wc, int width)
 {
@@ -3898,14 +3950,6 @@ term_print(struct terminal *term, char32_t wc, int width)
     if (unlikely(term->charsets.set[term->charsets.selected] == CHARSET_GRAPHIC) &&
         wc >= 0x60 && wc <= 0x7e)
     {
-        /* 0x60 - 0x7e */
-        static const char32_t vt100_0[] = {
-            U'◆', U'▒', U'␉', U'␌', U'␍', U'␊', U'°', U'±', /* ` - g */
-            U'␤', U'␋', U'┘', U'┐', U'┌', U'└', U'┼', U'⎺', /* h - o */
-            U'⎻', U'─', U'⎼', U'⎽', U'├', U'┤', U'┴', U'┬', /* p - w */
-            U'│', U'≤', U'≥', U'π', U'≠', U'£', U'·',       /* x - ~ */
-        };
-
         xassert(width == 1);
         wc = vt100_0[wc - 0x60];
     }
@@ -3922,6 +3966,7 @@ term_print(struct terminal *term, char32_t wc, int width)
          * pad with spacers */
         for (size_t i = col; i < term->cols; i++)
             print_spacer(term, i, 0);
+        grid_row_dirty_range(grid->cur_row, col, term->cols - 1);
 
         /* And force a line-wrap */
         grid->cursor.lcf = 1;
@@ -3933,7 +3978,7 @@ term_print(struct terminal *term, char32_t wc, int width)
 
     /* *Must* get current cell *after* linewrap+insert */
     struct row *row = grid->cur_row;
-    row->dirty = true;
+    grid_row_dirty_range(row, col, col + width - 1);
     row->linebreak = true;
 
     struct cell *cell = &row->cells[col];
@@ -4002,7 +4047,7 @@ ascii_printer_fast(struct terminal *term, char32_t wc)
     const int uri_start = col;
 
     struct row *row = grid->cur_row;
-    row->dirty = true;
+    grid_row_dirty_range(row, col, col);
     row->linebreak = true;
 
     struct cell *cell = &row->cells[col];
@@ -4036,6 +4081,117 @@ ascii_printer_single_shift(struct terminal *term, char32_t wc)
     term_update_ascii_printer(term);
 }
 
+static inline char32_t
+ascii_run_char(uint8_t c, bool graphic)
+{
+    if (unlikely(graphic) && c >= 0x60)
+        return vt100_0[c - 0x60];
+    return c;
+}
+
+/*
+ * Prints a run of printable ASCII characters (0x20-0x7e).
+ *
+ * Equivalent to calling term->ascii_printer() once per character,
+ * but each line segment is written in a single pass: the SGR
+ * attributes are broadcast to all cells, and the line wrap, insert
+ * mode, sixel, OSC-8 and underline range bookkeeping are done once
+ * per segment, instead of once per character.
+ */
+void
+term_print_ascii_run(struct terminal *term, const uint8_t *s, size_t count)
+{
+    xassert(count > 0);
+
+    if (unlikely(term->ascii_printer == &ascii_printer_single_shift)) {
+        /* The single shift only applies to the first character */
+        term->ascii_printer(term, *s);
+
+        if (--count == 0)
+            return;
+        s++;
+    }
+
+    struct grid *grid = term->grid;
+
+    const bool graphic =
+        term->charsets.set[term->charsets.selected] == CHARSET_GRAPHIC;
+    const char *const uri = term->vt.osc8.uri;
+    const bool styled_underline =
+        term->vt.underline.style > UNDERLINE_SINGLE ||
+        term->vt.underline.color_src != COLOR_DEFAULT;
+
+    struct attributes attrs = term->vt.attrs;
+    if (uri != NULL && term->conf->url.osc8_underline == OSC8_UNDERLINE_ALWAYS)
+        attrs.url = true;
+
+    term->vt.last_printed = ascii_run_char(s[count - 1], graphic);
+
+    while (count > 0) {
+        print_linewrap(term);
+
+        if (unlikely(grid->cursor.lcf)) {
+            /*
+             * Auto-margin disabled; each character overwrites the
+             * last column, meaning only the last one is visible
+             */
+            s += count - 1;
+            count = 1;
+        }
+
+        int col = grid->cursor.point.col;
+        const int len = min(count, (size_t)(term->cols - col));
+        const int end = col + len - 1;
+
+        print_insert(term, len);
+        sixel_overwrite_at_cursor(term, len);
+
+        /* *Must* get current row *after* linewrap+insert */
+        struct row *row = grid->cur_row;
+        grid_row_dirty_range(row, col, end);
+        row->linebreak = true;
+
+        struct cell *cell = &row->cells[col];
+
+        if (likely(!graphic)) {
+            for (int i = 0; i < len; i++, cell++) {
+                cell->wc = s[i];
+                cell->attrs = attrs;
+            }
+        } else {
+            for (int i = 0; i < len; i++, cell++) {
+                cell->wc = ascii_run_char(s[i], true);
+                cell->attrs = attrs;
+            }
+        }
+
+        if (unlikely(uri != NULL))
+            grid_row_uri_range_put_span(row, col, end, uri, term->vt.osc8.id);
+        else if (unlikely(row->extra != NULL))
+            grid_row_uri_range_erase(row, col, end);
+
+        if (unlikely(styled_underline))
+            grid_row_underline_range_put_span(row, col, end, term->vt.underline);
+        else if (unlikely(row->extra != NULL))
+            grid_row_underline_range_erase(row, col, end);
+
+        /* Advance cursor */
+        if (end + 1 >= term->cols) {
+            xassert(end + 1 == term->cols);
+            grid->cursor.lcf = true;
+            col = end;
+        } else {
+            xassert(!grid->cursor.lcf);
+            col = end + 1;
+        }
+
+        grid->cursor.point.col = col;
+
+        s += len;
+        count -= len;
+    }
+}
+
 void
 term_update_ascii_printer(struct terminal *term)
 {
@@ -4101,16 +4257,18 @@ rows_to_text(const struct terminal *term, int start, int end,
     const int grid_rows = term->grid->num_rows;
     int r = start;
 
+    /* Don't expand compacted scrollback rows; decode them here instead */
+    struct cell *scratch = xmalloc(term->cols * sizeof(scratch[0]));
+
     while (true) {
         const struct row *row = term->grid->rows[r];
         xassert(row != NULL);
 
+        const struct cell *cells = grid_row_peek_cells(row, scratch);
         const int c_end = r == end ? col_end : term->cols;
 
-        for (int c = col_start; c < c_end; c++) {
-            if (!extract_one(term, row, &row->cells[c], c, ctx))
-                goto out;
-        }
+        if (!extract_cells(term, row, cells, col_start, c_end, ctx))
+            goto out;
 
         if (r == end)
             break;
@@ -4122,12 +4280,269 @@ rows_to_text(const struct terminal *term, int start, int end,
     }
 
 out:
+    free(scratch);
     return extract_finish(ctx, text, len);
 }
 
 bool
-term_scrollback_to_text(const struct terminal *term, char **text, size_t *len)
+term_view_to_text(const struct terminal *term, char **text, size_t *len)
 {
+    int start = grid_row_absolute_in_view(term->grid, 0);
+    int end = grid_row_absolute_in_view(term->grid, term->rows - 1);
+    return rows_to_text(term, start, end, 0, term->cols, text, len);
+}
+
+/*
+ * Streams a range of rows, as UTF-8 text, in chunks. Rows are
+ * extracted on demand (i.e. when the consumer is ready for more),
+ * directly from the grid. This keeps memory usage down, and lets
+ * the consumer start processing the text right away, even when
+ * piping a huge scrollback.
+ *
+ * The grid must not change under a stream. Anything that may modify
+ * it (client output, resizing) must first call
+ * term_text_streams_snapshot(), which copies the rows not yet
+ * extracted (in compact form), after which the stream continues from
+ * the copy.
+ *
+ * The copy still refers to the terminal's composed characters. When
+ * the terminal is destroyed, term_text_streams_detach() extracts
+ * everything that's left, and detaches the streams.
+ */
+struct term_text_stream {
+    struct terminal *term;  /* NULL when detached */
+    const struct grid *grid;  /* The terminal's grid, or 'snapshot' */
+    struct grid *snapshot;
+    struct extraction_context *ctx;
+    struct cell *scratch;
+
+    int start_row;
+    int row;            /* Next row to extract */
+    int end_row;
+    int col_start;      /* First column of the next row */
+    int col_end;        /* Last column (exclusive) of the last row */
+    bool append_newline;
+    bool done;          /* All rows have been extracted */
+};
+
+/* Number of cells to extract each time the consumer wants more */
+#define TEXT_STREAM_CHUNK_CELLS (64 * 1024)
+
+static struct term_text_stream *
+text_stream_new(struct terminal *term, int start_row, int end_row,
+                int col_start, int col_end)
+{
+    struct extraction_context *ctx = extract_begin(SELECTION_NONE, true);
+    if (ctx == NULL)
+        return NULL;
+
+    struct term_text_stream *stream = xmalloc(sizeof(*stream));
+    *stream = (struct term_text_stream){
+        .term = term,
+        .grid = term->grid,
+        .ctx = ctx,
+        .scratch = xmalloc(term->cols * sizeof(stream->scratch[0])),
+        .start_row = start_row,
+        .row = start_row,
+        .end_row = end_row,
+        .col_start = col_start,
+        .col_end = col_end,
+    };
+
+    tll_push_back(term->text_streams, stream);
+    return stream;
+}
+
+/* Extracts (at least) max_cells cells, or until the end of the range */
+static void
+text_stream_extract(struct term_text_stream *stream, size_t max_cells)
+{
+    const struct terminal *term = stream->term;
+    const struct grid *grid = stream->grid;
+
+    xassert(term != NULL);
+
+    size_t count = 0;
+    while (!stream->done && count < max_cells) {
+        const int r = stream->row;
+        const struct row *row = grid->rows[r];
+        xassert(row != NULL);
+
+        /* Don't expand compacted scrollback rows; decode them here instead */
+        const struct cell *cells = grid_row_peek_cells(row, stream->scratch);
+        const int c_end = r == stream->end_row ? stream->col_end : grid->num_cols;
+
+        if (!extract_cells(term, row, cells, stream->col_start, c_end,
+                           stream->ctx))
+        {
+            /* Error is recorded in the context */
+            stream->done = true;
+            return;
+        }
+
+        count += grid->num_cols;
+
+        if (r == stream->end_row)
+            stream->done = true;
+        else {
+            stream->row = (r + 1) & (grid->num_rows - 1);
+            stream->col_start = 0;
+        }
+    }
+}
+
+static void
+text_stream_free_snapshot(struct term_text_stream *stream)
+{
+    grid_free(stream->snapshot);
+    free(stream->snapshot);
+    stream->snapshot = NULL;
+}
+
+/* Copies the rows not yet extracted, letting the grid change */
+static void
+text_stream_snapshot(struct term_text_stream *stream)
+{
+    if (stream->snapshot != NULL || stream->done)
+        return;
+
+    const struct grid *grid = stream->grid;
+    const int mask = grid->num_rows - 1;
+
+    /* The extraction context refers to the last row extracted */
+    const bool started = stream->row != stream->start_row;
+    const int first = started ? (stream->row - 1) & mask : stream->row;
+
+    stream->snapshot = grid_snapshot_rows(grid, first, stream->end_row);
+
+    if (started) {
+        extract_rebase_row(
+            stream->ctx, grid->rows[first], stream->snapshot->rows[first]);
+    }
+
+    stream->grid = stream->snapshot;
+}
+
+void
+term_text_streams_snapshot(struct terminal *term)
+{
+    tll_foreach(term->text_streams, it)
+        text_stream_snapshot(it->item);
+}
+
+void
+term_text_streams_mark_composed(const struct terminal *term)
+{
+    tll_foreach(term->text_streams, it) {
+        if (it->item->snapshot != NULL)
+            grid_mark_composed(it->item->snapshot, &term->composed);
+    }
+}
+
+static void
+text_stream_detach(struct term_text_stream *stream)
+{
+    struct terminal *term = stream->term;
+    if (term == NULL)
+        return;
+
+    text_stream_extract(stream, SIZE_MAX);
+    xassert(stream->done);
+
+    tll_foreach(term->text_streams, it) {
+        if (it->item == stream) {
+            tll_remove(term->text_streams, it);
+            break;
+        }
+    }
+
+    text_stream_free_snapshot(stream);
+    stream->term = NULL;
+    stream->grid = NULL;
+}
+
+void
+term_text_streams_detach(struct terminal *term)
+{
+    while (tll_length(term->text_streams) > 0)
+        text_stream_detach(tll_front(term->text_streams));
+}
+
+/*
+ * Returns the next chunk of text. The caller owns the returned
+ * text. Returns false when there's no more text.
+ */
+bool
+term_text_stream_next(struct term_text_stream *stream, char **text, size_t *len)
+{
+    *text = NULL;
+    *len = 0;
+
+    while (stream->ctx != NULL) {
+        if (!stream->done)
+            text_stream_extract(stream, TEXT_STREAM_CHUNK_CELLS);
+
+        if (!stream->done) {
+            if (!extract_drain(stream->ctx, text, len)) {
+                /* Let extract_finish() fail, and free the context */
+                stream->done = true;
+                continue;
+            }
+
+            if (*len > 0)
+                return true;
+
+            free(*text);
+            *text = NULL;
+            continue;
+        }
+
+        text_stream_detach(stream);
+
+        struct extraction_context *ctx = stream->ctx;
+        stream->ctx = NULL;
+
+        if (!extract_finish(ctx, text, len))
+            return false;
+
+        if (stream->append_newline) {
+            *text = xrealloc(*text, *len + 1 + 1);
+            (*text)[(*len)++] = '\n';
+            (*text)[*len] = '\0';
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void
+term_text_stream_destroy(struct term_text_stream *stream)
+{
+    if (stream == NULL)
+        return;
+
+    if (stream->term != NULL) {
+        tll_foreach(stream->term->text_streams, it) {
+            if (it->item == stream) {
+                tll_remove(stream->term->text_streams, it);
+                break;
+            }
+        }
+    }
+
+    extract_abort(stream->ctx);
+    text_stream_free_snapshot(stream);
+    free(stream->scratch);
+    free(stream);
+}
+
+struct term_text_stream *
+term_scrollback_stream(struct terminal *term)
+{
+    term_reflow_pending_finish(term);
+
     const int grid_rows = term->grid->num_rows;
     int start = (term->grid->offset + term->rows) & (grid_rows - 1);
     int end = (term->grid->offset + term->rows - 1) & (grid_rows - 1);
@@ -4150,25 +4565,19 @@ term_scrollback_to_text(const struct terminal *term, char **text, size_t *len)
             end += term->grid->num_rows;
     }
 
-    return rows_to_text(term, start, end, 0, term->cols, text, len);
-}
-
-bool
-term_view_to_text(const struct terminal *term, char **text, size_t *len)
-{
-    int start = grid_row_absolute_in_view(term->grid, 0);
-    int end = grid_row_absolute_in_view(term->grid, term->rows - 1);
-    return rows_to_text(term, start, end, 0, term->cols, text, len);
+    return text_stream_new(term, start, end, 0, term->cols);
 }
 
-bool
-term_command_output_to_text(const struct terminal *term, char **text, size_t *len)
+struct term_text_stream *
+term_command_output_stream(struct terminal *term)
 {
     int start_row = -1;
     int end_row = -1;
     int start_col = -1;
     int end_col = -1;
 
+    term_reflow_pending_finish(term);
+
     const struct grid *grid = term->grid;
     const int sb_end = grid_row_absolute(grid, term->rows - 1);
     const int sb_start = (sb_end + 1) & (grid->num_rows - 1);
@@ -4196,18 +4605,19 @@ term_command_output_to_text(const struct terminal *term, char **text, size_t *le
     }
 
     if (start_row < 0)
-        return false;
+        return NULL;
 
-    bool ret = rows_to_text(term, start_row, end_row, start_col, end_col, text, len);
-    if (!ret)
-        return false;
+    struct term_text_stream *stream = text_stream_new(
+        term, start_row, end_row, start_col, end_col);
+    if (stream == NULL)
+        return NULL;
 
     /*
      * If the FTCS_COMMAND_FINISHED marker was emitted at the *first*
      * column, then the *entire* previous line is part of the command
      * output. *Including* the newline, if any.
      *
-     * Since rows_to_text() doesn't extract the column
+     * Since the stream doesn't extract the column
      * FTCS_COMMAND_FINISHED was emitted at (that would be wrong -
      * FTCS_COMMAND_FINISHED is emitted *after* the command output,
      * not at its last character), the extraction logic will not see
@@ -4221,28 +4631,15 @@ term_command_output_to_text(const struct terminal *term, char **text, size_t *le
 
     if (end_col > 0) {
         /* Command output covers partial row - don't append newline */
-        return true;
+        return stream;
     }
 
     int next_to_last_row = (end_row - 1 + grid->num_rows) & (grid->num_rows - 1);
     const struct row *row = grid->rows[next_to_last_row];
 
     /* Add newline if last row has a hard linebreak */
-    if (row->linebreak) {
-        char *new_text = xrealloc(*text, *len + 1 + 1);
-
-        if (new_text == NULL) {
-            /* Ignore failure - use text as is (without inserting newline) */
-            return true;
-        }
-
-        *text = new_text;
-        (*len)++;
-        (*text)[*len - 1] = '\n';
-        (*text)[*len] = '\0';
-    }
-
-    return true;
+    stream->append_newline = row->linebreak;
+    return stream;
 }
 
 bool
@@ -4,8 +4,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include <regex.h>
 #include <threads.h>
-#include <semaphore.h>
 
 #if defined(FOOT_GRAPHEME_CLUSTERING)
  #include <utf8proc.h>
@@ -158,9 +158,28 @@ struct row {
     struct cell *cells;
     struct row_data *extra;
 
+    /* Compacted cells (scrollback rows); 'cells' is NULL when set */
+    struct row_compact *compact;
+
     bool dirty;
     bool linebreak;
 
+    /*
+     * Scrollback search's case folded copy of the row's text (see
+     * search.c). Built on demand, marked stale whenever the row is
+     * marked dirty.
+     */
+    bool search_text_stale;
+    struct row_search_text *search_text;
+
+    /*
+     * Columns that may contain dirty cells (inclusive). Only valid
+     * when 'dirty' is set. Use grid_row_dirty() and
+     * grid_row_dirty_range() to mark rows dirty.
+     */
+    int dirty_start;
+    int dirty_end;
+
     struct {
         bool prompt_marker;
         int cmd_start;  /* Column, -1 if unset */
@@ -246,6 +265,24 @@ struct grid {
     struct row **rows;
     struct row *cur_row;
 
+    /*
+     * Incremented each time a row is expanded; compared with
+     * 'compacted_gen' to detect when the scrollback needs to be
+     * re-compacted. See grid_compact_scrollback()
+     */
+    unsigned long uncompact_gen;
+    unsigned long compacted_gen;
+
+    /*
+     * Number of rows scrolled out into the scrollback (i.e. the rows
+     * just above the screen) since the last compaction. These are
+     * compacted in a batch, by grid_compact_scrollback()
+     */
+    int pending_compact;
+
+    /* Scrollback not yet reflowed to the current width (see grid.c) */
+    struct reflow_pending *reflow_pending;
+
     tll(struct damage) scroll_damage;
     tll(struct sixel) sixel_images;
 
@@ -292,6 +329,9 @@ struct vt {
         size_t size;
         size_t idx;
         bool bel; /* true if OSC string was terminated by BEL */
+
+        /* Handler consuming the OSC string as it arrives, see osc.h */
+        struct osc_stream *stream;
     } osc;
 
     /* Start coordinate for current OSC-8 URI */
@@ -458,8 +498,7 @@ struct terminal {
 
     tll(int) tab_stops;
 
-    size_t composed_count;
-    struct composed *composed;
+    struct composed_table composed;
 
     /* Temporary: for FDM */
     struct {
@@ -635,6 +674,22 @@ struct terminal {
             char32_t *buf;
             size_t len;
         } last;
+
+        /* Regex mode: 'buf' is a POSIX extended regular expression */
+        bool regex;
+        struct {
+            char *source;      /* 'buf', as UTF-8, 'compiled' was built from */
+            bool valid;
+            regex_t compiled;
+            struct regex_dfa *dfa;  /* Pre-filter, NULL if not supported */
+
+            /* Text being matched, and the cell each byte came from */
+            char *text;
+            struct coord *pos;
+            size_t size;
+            bool notbol;       /* Text starts mid-line... */
+            bool noteol;       /* ...or ends mid-line */
+        } re;
     } search;
 
     struct wayland *wl;
@@ -698,14 +753,16 @@ struct terminal {
         /* Render threads + synchronization primitives */
         struct {
             uint16_t count;
-            sem_t start;
-            sem_t done;
             mtx_t lock;
-            tll(int) queue;
-            thrd_t *threads;
-            struct buffer *buf;
+            struct render_pool *pool;  /* Shared by all terminals */
         } workers;
 
+        /* Pre-rendered cells, one cache per render thread */
+        struct {
+            struct tile_cache **caches;
+            size_t count;
+        } tiles;
+
         /* Last rendered cursor position */
         struct {
             struct row *row;
@@ -715,6 +772,35 @@ struct terminal {
 
         struct buffer *last_buf;     /* Buffer we rendered to last time */
 
+        /* Measured cost of applying scroll damage, see scroll_use_shm() */
+        struct {
+            /* Per buffer size, scroll region and margins; see render.c */
+            struct scroll_cost_model {
+                size_t buf_size;
+                int region_start;
+                int region_end;
+                int margin_top;
+                int margin_bottom;
+                unsigned last_used;
+
+                struct scroll_cost {
+                    double ns_per_byte;  /* Moving average */
+                    double warmup[4];    /* First samples, sorted; the median seeds the average */
+                    unsigned samples;
+                } shm, memmove;
+                unsigned explore;        /* Scrolls since last exploration */
+                unsigned explore_interval; /* Backs off, see render.c */
+                bool exploring_shm;      /* Method being explored, if any... */
+                double exploring_ns;     /* ...and the estimated cost of the other one */
+            } models[4];
+            unsigned use_count;
+
+            /* Current frame, for the render timer */
+            unsigned shm_count;
+            unsigned memmove_count;
+            uint64_t ns;
+        } scroll_cost;
+
         enum overlay_style last_overlay_style;
         struct buffer *last_overlay_buf;
         pixman_region32_t last_overlay_clip;
@@ -733,6 +819,10 @@ struct terminal {
         struct range selection_coords;
     } interactive_resizing;
 
+    struct {
+        int fd;  /* Reflows the scrollback a resize deferred, chunk by chunk */
+    } reflow;
+
     struct {
         enum {
             SIXEL_DECSIXEL,  /* DECSIXEL body part ", $, -, ? ... ~ */
@@ -753,6 +843,7 @@ struct terminal {
             uint32_t *p;     /* Pointer into data, for current position */
             int width;       /* Image width, in pixels */
             int height;      /* Image height, in pixels */
+            int alloc_width; /* Allocated width (i.e. stride), in pixels */
             int alloc_height;
             unsigned int bottom_pixel;
         } image;
@@ -790,6 +881,9 @@ struct terminal {
     struct grid *url_grid_snapshot;
     bool ime_reenable_after_url_mode;
 
+    /* Pipe commands still being fed from the grid. See term_text_stream_next() */
+    tll(struct term_text_stream *) text_streams;
+
 #if defined(FOOT_IME_ENABLED) && FOOT_IME_ENABLED
     bool ime_enabled;
 #endif
@@ -883,6 +977,9 @@ void term_erase(
     int end_row, int end_col);
 void term_erase_scrollback(struct terminal *term);
 
+void term_reflow_pending_schedule(struct terminal *term);
+void term_reflow_pending_finish(struct terminal *term);
+
 int term_row_rel_to_abs(const struct terminal *term, int row);
 void term_cursor_home(struct terminal *term);
 void term_cursor_to(struct terminal *term, int row, int col);
@@ -894,6 +991,8 @@ void term_cursor_down(struct terminal *term, int count);
 void term_cursor_blink_update(struct terminal *term);
 
 void term_print(struct terminal *term, char32_t wc, int width);
+void term_print_ascii_run(
+    struct terminal *term, const uint8_t *s, size_t count);
 void term_fill(struct terminal *term, int row, int col, uint8_t c, size_t count,
                bool use_sgr_attrs);
 
@@ -948,12 +1047,18 @@ void term_disable_app_sync_updates(struct terminal *term);
 enum term_surface term_surface_kind(
     const struct terminal *term, const struct wl_surface *surface);
 
-bool term_scrollback_to_text(
-    const struct terminal *term, char **text, size_t *len);
 bool term_view_to_text(
     const struct terminal *term, char **text, size_t *len);
-bool term_command_output_to_text(
-    const struct terminal *term, char **text, size_t *len);
+
+struct term_text_stream;
+struct term_text_stream *term_scrollback_stream(struct terminal *term);
+struct term_text_stream *term_command_output_stream(struct terminal *term);
+bool term_text_stream_next(
+    struct term_text_stream *stream, char **text, size_t *len);
+void term_text_stream_destroy(struct term_text_stream *stream);
+void term_text_streams_snapshot(struct terminal *term);
+void term_text_streams_mark_composed(const struct terminal *term);
+void term_text_streams_detach(struct terminal *term);
 
 bool term_ime_is_enabled(const struct terminal *term);
 void term_ime_enable(struct terminal *term);
@@ -0,0 +1,326 @@
+#include "tile-cache.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "debug.h"
+#include "macros.h"
+#include "util.h"
+#include "xmalloc.h"
+
+struct tile {
+    struct tile_cache_key key;
+    pixman_image_t *pix;
+    size_t size;
+    size_t hash;
+
+    struct tile *bucket_next;
+
+    /* LRU list; 'prev' is more recently used than 'next' */
+    struct tile *prev;
+    struct tile *next;
+};
+
+struct tile_cache {
+    struct tile **buckets;
+    size_t bucket_count;    /* Always a power of two */
+
+    struct tile *head;      /* Most recently used */
+    struct tile *tail;      /* Least recently used */
+
+    size_t max_size;
+    struct tile_cache_stats stats;
+};
+
+static inline size_t
+mix(size_t h, uint64_t v)
+{
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    return h;
+}
+
+static size_t
+key_hash(const struct tile_cache_key *key)
+{
+    size_t h = (uintptr_t)key->glyph;
+    h = mix(h, (uint64_t)key->fg.red << 48 | (uint64_t)key->fg.green << 32 |
+               (uint64_t)key->fg.blue << 16 | key->fg.alpha);
+    h = mix(h, (uint64_t)key->bg.red << 48 | (uint64_t)key->bg.green << 32 |
+               (uint64_t)key->bg.blue << 16 | key->bg.alpha);
+    h = mix(h, (uint64_t)key->format << 8 | (uint8_t)key->cols);
+    return h;
+}
+
+static inline bool
+color_equal(const pixman_color_t *a, const pixman_color_t *b)
+{
+    return a->red == b->red && a->green == b->green &&
+           a->blue == b->blue && a->alpha == b->alpha;
+}
+
+static inline bool
+key_equal(const struct tile_cache_key *a, const struct tile_cache_key *b)
+{
+    return a->glyph == b->glyph &&
+           a->cols == b->cols &&
+           a->format == b->format &&
+           color_equal(&a->fg, &b->fg) &&
+           color_equal(&a->bg, &b->bg);
+}
+
+static void
+lru_unlink(struct tile_cache *cache, struct tile *tile)
+{
+    if (tile->prev != NULL)
+        tile->prev->next = tile->next;
+    else
+        cache->head = tile->next;
+
+    if (tile->next != NULL)
+        tile->next->prev = tile->prev;
+    else
+        cache->tail = tile->prev;
+
+    tile->prev = tile->next = NULL;
+}
+
+static void
+lru_push_front(struct tile_cache *cache, struct tile *tile)
+{
+    tile->prev = NULL;
+    tile->next = cache->head;
+
+    if (cache->head != NULL)
+        cache->head->prev = tile;
+    else
+        cache->tail = tile;
+
+    cache->head = tile;
+}
+
+static void
+bucket_unlink(struct tile_cache *cache, struct tile *tile)
+{
+    struct tile **slot = &cache->buckets[tile->hash & (cache->bucket_count - 1)];
+
+    while (*slot != tile) {
+        xassert(*slot != NULL);
+        slot = &(*slot)->bucket_next;
+    }
+
+    *slot = tile->bucket_next;
+}
+
+static void
+tile_free(struct tile *tile)
+{
+    pixman_image_unref(tile->pix);
+    free(tile);
+}
+
+static void
+evict(struct tile_cache *cache, struct tile *tile)
+{
+    lru_unlink(cache, tile);
+    bucket_unlink(cache, tile);
+
+    cache->stats.count--;
+    cache->stats.size -= tile->size;
+    tile_free(tile);
+}
+
+static void
+rehash(struct tile_cache *cache, size_t bucket_count)
+{
+    struct tile **buckets = xcalloc(bucket_count, sizeof(buckets[0]));
+
+    for (struct tile *tile = cache->head; tile != NULL; tile = tile->next) {
+        struct tile **slot = &buckets[tile->hash & (bucket_count - 1)];
+        tile->bucket_next = *slot;
+        *slot = tile;
+    }
+
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = bucket_count;
+}
+
+struct tile_cache *
+tile_cache_new(size_t max_size)
+{
+    struct tile_cache *cache = xmalloc(sizeof(*cache));
+    *cache = (struct tile_cache){
+        .buckets = xcalloc(64, sizeof(cache->buckets[0])),
+        .bucket_count = 64,
+        .max_size = max_size,
+    };
+    return cache;
+}
+
+void
+tile_cache_destroy(struct tile_cache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    tile_cache_flush(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+void
+tile_cache_flush(struct tile_cache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    struct tile *tile = cache->head;
+    while (tile != NULL) {
+        struct tile *next = tile->next;
+        tile_free(tile);
+        tile = next;
+    }
+
+    for (size_t i = 0; i < cache->bucket_count; i++)
+        cache->buckets[i] = NULL;
+
+    cache->head = cache->tail = NULL;
+    cache->stats.count = 0;
+    cache->stats.size = 0;
+}
+
+pixman_image_t *
+tile_cache_lookup(struct tile_cache *cache, const struct tile_cache_key *key)
+{
+    const size_t hash = key_hash(key);
+
+    for (struct tile *tile = cache->buckets[hash & (cache->bucket_count - 1)];
+         tile != NULL;
+         tile = tile->bucket_next)
+    {
+        if (tile->hash != hash || !key_equal(&tile->key, key))
+            continue;
+
+        if (cache->head != tile) {
+            lru_unlink(cache, tile);
+            lru_push_front(cache, tile);
+        }
+
+        cache->stats.hits++;
+        return tile->pix;
+    }
+
+    cache->stats.misses++;
+    return NULL;
+}
+
+bool
+tile_cache_insert(struct tile_cache *cache, const struct tile_cache_key *key,
+                  pixman_image_t *pix)
+{
+    const size_t size =
+        (size_t)pixman_image_get_stride(pix) * pixman_image_get_height(pix);
+
+    if (size > cache->max_size) {
+        pixman_image_unref(pix);
+        return false;
+    }
+
+    while (cache->stats.size + size > cache->max_size) {
+        xassert(cache->tail != NULL);
+        evict(cache, cache->tail);
+        cache->stats.evictions++;
+    }
+
+    if (cache->stats.count >= cache->bucket_count)
+        rehash(cache, cache->bucket_count * 2);
+
+    struct tile *tile = xmalloc(sizeof(*tile));
+    *tile = (struct tile){
+        .key = *key,
+        .pix = pix,
+        .size = size,
+        .hash = key_hash(key),
+    };
+
+    struct tile **slot = &cache->buckets[tile->hash & (cache->bucket_count - 1)];
+    tile->bucket_next = *slot;
+    *slot = tile;
+
+    lru_push_front(cache, tile);
+
+    cache->stats.count++;
+    cache->stats.size += size;
+    return true;
+}
+
+void
+tile_cache_get_stats(const struct tile_cache *cache,
+                     struct tile_cache_stats *stats)
+{
+    *stats = cache->stats;
+}
+
+UNITTEST
+{
+    /* 4x4 ARGB tiles are 64 bytes each; room for three of them */
+    struct tile_cache *cache = tile_cache_new(3 * 64);
+
+    static const int glyphs[5];
+    struct tile_cache_key keys[5];
+
+    for (size_t i = 0; i < ALEN(keys); i++) {
+        keys[i] = (struct tile_cache_key){
+            .glyph = &glyphs[i],
+            .fg = {0xffff, 0xffff, 0xffff, 0xffff},
+            .bg = {0, 0, 0, 0xffff},
+            .format = PIXMAN_a8r8g8b8,
+            .cols = 1,
+        };
+    }
+
+    for (size_t i = 0; i < 3; i++) {
+        xassert(tile_cache_lookup(cache, &keys[i]) == NULL);
+        xassert(tile_cache_insert(
+            cache, &keys[i],
+            pixman_image_create_bits(PIXMAN_a8r8g8b8, 4, 4, NULL, 0)));
+    }
+
+    /* Bump key #0, making key #1 the least recently used */
+    xassert(tile_cache_lookup(cache, &keys[0]) != NULL);
+
+    xassert(tile_cache_insert(
+        cache, &keys[3],
+        pixman_image_create_bits(PIXMAN_a8r8g8b8, 4, 4, NULL, 0)));
+
+    xassert(tile_cache_lookup(cache, &keys[0]) != NULL);
+    xassert(tile_cache_lookup(cache, &keys[1]) == NULL);
+    xassert(tile_cache_lookup(cache, &keys[2]) != NULL);
+    xassert(tile_cache_lookup(cache, &keys[3]) != NULL);
+
+    /* Same glyph, different background */
+    struct tile_cache_key other_bg = keys[0];
+    other_bg.bg.red = 0xffff;
+    xassert(tile_cache_lookup(cache, &other_bg) == NULL);
+
+    /* Too large to ever fit */
+    xassert(!tile_cache_insert(
+        cache, &keys[4],
+        pixman_image_create_bits(PIXMAN_a8r8g8b8, 16, 16, NULL, 0)));
+
+    struct tile_cache_stats stats;
+    tile_cache_get_stats(cache, &stats);
+    xassert(stats.count == 3);
+    xassert(stats.size == 3 * 64);
+    xassert(stats.evictions == 1);
+    xassert(stats.hits == 4);
+    xassert(stats.misses == 5);
+
+    tile_cache_flush(cache);
+    tile_cache_get_stats(cache, &stats);
+    xassert(stats.count == 0);
+    xassert(stats.size == 0);
+    xassert(tile_cache_lookup(cache, &keys[0]) == NULL);
+
+    tile_cache_destroy(cache);
+}
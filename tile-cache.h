@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <pixman.h>
+
+/*
+ * LRU cache of pre-rendered cell tiles; a cell's background, with its
+ * glyph blended on top.
+ *
+ * Glyph pointers are used as keys, meaning the cache *must* be
+ * flushed whenever the fonts (or the cell geometry) changes.
+ *
+ * Not thread safe.
+ */
+
+struct tile_cache_key {
+    const void *glyph;
+    pixman_color_t fg;
+    pixman_color_t bg;
+    pixman_format_code_t format;
+    int cols;
+};
+
+struct tile_cache_stats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t count;       /* Number of cached tiles */
+    size_t size;        /* Bytes used by cached tiles */
+};
+
+struct tile_cache;
+
+struct tile_cache *tile_cache_new(size_t max_size);
+void tile_cache_destroy(struct tile_cache *cache);
+
+/* Removes all tiles. Statistics are kept */
+void tile_cache_flush(struct tile_cache *cache);
+
+/* Returns NULL on a miss. The returned tile is owned by the cache */
+pixman_image_t *tile_cache_lookup(
+    struct tile_cache *cache, const struct tile_cache_key *key);
+
+/*
+ * Takes ownership of 'tile', evicting least recently used tiles
+ * as necessary. Returns false (after releasing 'tile') if the tile
+ * is larger than the cache itself.
+ */
+bool tile_cache_insert(
+    struct tile_cache *cache, const struct tile_cache_key *key,
+    pixman_image_t *tile);
+
+void tile_cache_get_stats(
+    const struct tile_cache *cache, struct tile_cache_stats *stats);
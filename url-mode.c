@@ -156,7 +156,7 @@ activate_url(struct seat *seat, struct terminal *term, const struct url *url,
     switch (url->action) {
     case URL_ACTION_COPY:
         if (text_to_clipboard(seat, term, url_string, seat->kbd.serial)) {
-            /* Now owned by our clipboard “manager” */
+            /* Freed by text_to_clipboard() */
             url_string = NULL;
         }
         break;
@@ -330,7 +330,7 @@ auto_detected(const struct terminal *term, enum url_action action,
 
             if (cell->wc >= CELL_COMB_CHARS_LO && cell->wc <= CELL_COMB_CHARS_HI) {
                 struct composed *composed =
-                    composed_lookup(term->composed, cell->wc - CELL_COMB_CHARS_LO);
+                    composed_lookup(&term->composed, cell->wc - CELL_COMB_CHARS_LO);
                 wcs = composed->chars;
                 wc_count = composed->count;
             } else {
@@ -774,13 +774,13 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
     size_t r = start->row & (grid->num_rows - 1);
     size_t c = start->col;
 
-    struct row *row = grid->rows[r];
-    row->dirty = true;
+    struct row *row = grid_row_uncompact(grid, grid->rows[r]);
 
     while (true) {
         struct cell *cell = &row->cells[c];
         cell->attrs.url = value;
         cell->attrs.clean = 0;
+        grid_row_dirty_range(row, c, c);
 
         if (r == end_r && c == end->col)
             break;
@@ -789,13 +789,12 @@ tag_cells_for_url(struct terminal *term, const struct url *url, bool value)
             r = (r + 1) & (grid->num_rows - 1);
             c = 0;
 
-            row = grid->rows[r];
+            row = grid_row_uncompact(grid, grid->rows[r]);
             if (row == NULL) {
                 /* Un-allocated scrollback. This most likely means a
                  * runaway OSC-8 URL. */
                 break;
             }
-            row->dirty = true;
         }
     }
 }
@@ -816,11 +815,13 @@ urls_render(struct terminal *term)
 
     /* Dirty the last cursor, to ensure it is erased */
     {
-        struct row *cursor_row = term->render.last_cursor.row;
+        struct row *cursor_row = grid_row_uncompact(term->grid, term->render.last_cursor.row);
         if (cursor_row != NULL) {
             struct cell *cell = &cursor_row->cells[term->render.last_cursor.col];
             cell->attrs.clean = 0;
-            cursor_row->dirty = true;
+            grid_row_dirty_range(
+                cursor_row, term->render.last_cursor.col,
+                term->render.last_cursor.col);
         }
     }
     term->render.last_cursor.row = NULL;
@@ -833,8 +834,8 @@ urls_render(struct terminal *term)
      * now, when entering URL mode, and later, when exiting it. */
     term_damage_view(term);
 
-    /* Snapshot the current grid */
-    term->url_grid_snapshot = grid_snapshot(term->grid);
+    /* Snapshot the rows in view */
+    term->url_grid_snapshot = grid_snapshot(term->grid, term->rows);
 
     xassert(tll_length(win->urls) == 0);
     tll_foreach(win->term->urls, it) {
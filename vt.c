@@ -8,6 +8,12 @@
  #include <utf8proc.h>
 #endif
 
+#if defined(__AVX2__)
+ #include <immintrin.h>
+#elif defined(__SSE2__)
+ #include <emmintrin.h>
+#endif
+
 #define LOG_MODULE "vt"
 #define LOG_ENABLE_DBG 0
 #include "log.h"
@@ -17,6 +23,7 @@
 #include "dcs.h"
 #include "debug.h"
 #include "emoji-variation-sequences.h"
+#include "grid.h"
 #include "osc.h"
 #include "sixel.h"
 #include "util.h"
@@ -202,7 +209,7 @@ action_execute(struct terminal *term, uint8_t c)
          * subsequent cells, all the way until the next tab stop.
          */
         if (emit_tab_char) {
-            row->dirty = true;
+            grid_row_dirty_range(row, start_col, new_col - 1);
 
             row->cells[start_col].wc = U'\t';
             row->cells[start_col].attrs.clean = 0;
@@ -298,6 +305,86 @@ action_print(struct terminal *term, uint8_t c)
     term->ascii_printer(term, c);
 }
 
+/*
+ * Returns the number of leading printable ASCII characters
+ * (0x20-0x7e) in 'data'. These are the characters the ground state
+ * passes straight to action_print().
+ */
+static inline size_t
+ascii_printable_run(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i lower = _mm256_set1_epi8(0x1f);
+    const __m256i upper = _mm256_set1_epi8(0x7f);
+
+    for (; i + 32 <= len; i += 32) {
+        /* Bytes >= 0x80 are negative, and thus fail the first test */
+        __m256i v = _mm256_loadu_si256((const __m256i *)&data[i]);
+        __m256i ok = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, lower), _mm256_cmpgt_epi8(upper, v));
+
+        uint32_t mask = _mm256_movemask_epi8(ok);
+        if (mask != 0xffffffff)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    const __m128i lower_128 = _mm_set1_epi8(0x1f);
+    const __m128i upper_128 = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&data[i]);
+        __m128i ok = _mm_and_si128(
+            _mm_cmpgt_epi8(v, lower_128), _mm_cmplt_epi8(v, upper_128));
+
+        uint32_t mask = _mm_movemask_epi8(ok);
+        if (mask != 0xffff)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (data[i] < 0x20 || data[i] > 0x7e)
+            break;
+    }
+
+    return i;
+}
+
+UNITTEST
+{
+    uint8_t buf[100];
+    memset(buf, 'a', sizeof(buf));
+
+    xassert(ascii_printable_run(buf, 0) == 0);
+    xassert(ascii_printable_run(buf, sizeof(buf)) == sizeof(buf));
+
+    /* Verify every boundary, at every offset (exercises the vector,
+       and scalar tail, paths) */
+    static const uint8_t stoppers[] = {
+        0x00, 0x0a, 0x1b, 0x1f, 0x7f, 0x80, 0x9b, 0xc3, 0xff};
+
+    for (size_t i = 0; i < sizeof(stoppers); i++) {
+        for (size_t pos = 0; pos < sizeof(buf); pos++) {
+            buf[pos] = stoppers[i];
+            xassert(ascii_printable_run(buf, sizeof(buf)) == pos);
+            buf[pos] = pos & 1 ? ' ' : '~';
+        }
+
+        memset(buf, 'a', sizeof(buf));
+    }
+}
+
+static void
+action_print_run(struct terminal *term, const uint8_t *data, size_t count)
+{
+    term_reset_grapheme_state(term);
+    term_print_ascii_run(term, data, count);
+}
+
 static void
 action_param_lazy_init(struct terminal *term)
 {
@@ -599,6 +686,7 @@ action_csi_dispatch(struct terminal *term, uint8_t c)
 static void
 action_osc_start(struct terminal *term, uint8_t c)
 {
+    xassert(term->vt.osc.stream == NULL);
     term->vt.osc.idx = 0;
 }
 
@@ -607,12 +695,17 @@ action_osc_end(struct terminal *term, uint8_t c)
 {
     struct vt *vt = &term->vt;
 
-    if (!osc_ensure_size(term, vt->osc.idx + 1))
-        return;
-
-    vt->osc.data[vt->osc.idx] = '\0';
     vt->osc.bel = c == '\a';
-    osc_dispatch(term);
+
+    if (unlikely(vt->osc.stream != NULL))
+        osc_stream_end(term);
+    else {
+        if (!osc_ensure_size(term, vt->osc.idx + 1))
+            return;
+
+        vt->osc.data[vt->osc.idx] = '\0';
+        osc_dispatch(term);
+    }
 
     if (unlikely(vt->osc.idx >= 4096)) {
         free(vt->osc.data);
@@ -624,9 +717,21 @@ action_osc_end(struct terminal *term, uint8_t c)
 static void
 action_osc_put(struct terminal *term, uint8_t c)
 {
-    if (!osc_ensure_size(term, term->vt.osc.idx + 1))
+    struct vt *vt = &term->vt;
+
+    if (unlikely(vt->osc.idx >= OSC_STREAM_CHUNK_SIZE) && vt->osc.stream != NULL)
+        osc_stream_put(term);
+
+    if (!osc_ensure_size(term, vt->osc.idx + 1))
         return;
-    term->vt.osc.data[term->vt.osc.idx++] = c;
+    vt->osc.data[vt->osc.idx++] = c;
+
+    if (unlikely(c == ';') &&
+        vt->osc.stream == NULL &&
+        vt->osc.idx <= OSC_STREAM_PREFIX_MAX)
+    {
+        osc_stream_begin(term);
+    }
 }
 
 static void
@@ -699,6 +804,39 @@ UNITTEST
 }
 #endif
 
+/*
+ * Frees composed character chains no longer referenced by any cell,
+ * in any grid (including the scrollback)
+ */
+static void
+composed_gc(struct terminal *term)
+{
+    struct composed_table *composed = &term->composed;
+    const size_t UNUSED count = composed->count;
+
+    composed_unmark_all(composed);
+
+    grid_mark_composed(&term->normal, composed);
+    grid_mark_composed(&term->alt, composed);
+
+    if (term->interactive_resizing.grid != NULL)
+        grid_mark_composed(term->interactive_resizing.grid, composed);
+    if (term->url_grid_snapshot != NULL)
+        grid_mark_composed(term->url_grid_snapshot, composed);
+
+    /* Pipe commands' copies of the rows they haven't read yet */
+    term_text_streams_mark_composed(term);
+
+    /* REP may repeat the last printed character */
+    const char32_t last = term->vt.last_printed;
+    if (last >= CELL_COMB_CHARS_LO && last <= CELL_COMB_CHARS_HI)
+        composed_mark(composed, last - CELL_COMB_CHARS_LO);
+
+    const size_t UNUSED freed = composed_sweep(composed);
+    LOG_DBG("composed chains: %zu live, %zu freed (of %zu)",
+            composed->count, freed, count);
+}
+
 static void
 action_utf8_print(struct terminal *term, char32_t wc)
 {
@@ -729,7 +867,7 @@ action_utf8_print(struct terminal *term, char32_t wc)
         /* Is base cell already a cluster? */
         const struct composed *composed =
             (base >= CELL_COMB_CHARS_LO && base <= CELL_COMB_CHARS_HI)
-            ? composed_lookup(term->composed, base - CELL_COMB_CHARS_LO)
+            ? composed_lookup(&term->composed, base - CELL_COMB_CHARS_LO)
             : NULL;
 
         uint32_t key;
@@ -825,7 +963,7 @@ action_utf8_print(struct terminal *term, char32_t wc)
                     return;
                 }
 
-                const struct composed *cc = composed_lookup(term->composed, key);
+                const struct composed *cc = composed_lookup(&term->composed, key);
                 if (cc == NULL)
                     break;
 
@@ -865,7 +1003,13 @@ action_utf8_print(struct terminal *term, char32_t wc)
                 goto out;
             }
 
-            if (unlikely(term->composed_count >=
+            if (unlikely(term->composed.gc_threshold > 0 &&
+                         term->composed.count >= term->composed.gc_threshold))
+            {
+                composed_gc(term);
+            }
+
+            if (unlikely(term->composed.count >=
                          (CELL_COMB_CHARS_HI - CELL_COMB_CHARS_LO)))
             {
                 /* We reached our maximum number of allowed composed
@@ -936,7 +1080,6 @@ action_utf8_print(struct terminal *term, char32_t wc)
                 break;
             }
 
-            term->composed_count++;
             composed_insert(&term->composed, new_cc);
 
             wc = CELL_COMB_CHARS_LO + key;
@@ -1407,6 +1550,22 @@ vt_from_slave(struct terminal *term, const uint8_t *data, size_t len)
 
     const uint8_t *p = data;
     for (size_t i = 0; i < len; i++, p++) {
+        if (current_state == STATE_GROUND && *p >= 0x20 && *p <= 0x7e) {
+            /*
+             * Fast path: printable ASCII doesn't change state, so
+             * hand the whole run to the printer in one go, instead
+             * of dispatching it byte-by-byte.
+             */
+            const size_t count = ascii_printable_run(p, len - i);
+            action_print_run(term, p, count);
+
+            i += count;
+            p += count;
+
+            if (i >= len)
+                break;
+        }
+
         switch (current_state) {
         case STATE_GROUND:              current_state = state_ground_switch(term, *p); break;
         case STATE_ESCAPE:              current_state = state_escape_switch(term, *p); break;
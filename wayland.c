@@ -24,6 +24,7 @@
 #define LOG_ENABLE_DBG 0
 #include "log.h"
 
+#include "clipboard-data.h"
 #include "config.h"
 #include "terminal.h"
 #include "ime.h"
@@ -228,8 +229,8 @@ seat_destroy(struct seat *seat)
         wl_seat_release(seat->wl_seat);
 
     ime_reset_pending(seat);
-    free(seat->clipboard.text);
-    free(seat->primary.text);
+    clipboard_data_unref(seat->clipboard.data);
+    clipboard_data_unref(seat->primary.data);
     free(seat->pointer.last_custom_xcursor);
     free(seat->name);
 }
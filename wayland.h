@@ -70,7 +70,7 @@ struct wl_clipboard {
     struct wl_data_source *data_source;
     struct wl_data_offer *data_offer;
     enum data_offer_mime_type mime_type;
-    char *text;
+    struct clipboard_data *data;
     uint32_t serial;
 };
 
@@ -78,7 +78,7 @@ struct wl_primary {
     struct zwp_primary_selection_source_v1 *data_source;
     struct zwp_primary_selection_offer_v1 *data_offer;
     enum data_offer_mime_type mime_type;
-    char *text;
+    struct clipboard_data *data;
     uint32_t serial;
 };
 